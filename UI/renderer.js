@@ -1,11 +1,15 @@
 const serialport = require('serialport')
 const usb = require('usb').usb;
-const Readline = require('@serialport/parser-readline')
-const ByteLength = require('@serialport/parser-byte-length')
 const {ipcRenderer} = require("electron")
+const SerialClient = require('./serial_client.js')
 var port = new serialport('/dev/tty-usbserial1', { autoOpen: false })
+var client = null; //Framed request client on the open port
+
+const CONNECT_ATTEMPTS = 20; //Info request retries while the Arduino comes out of reset
+const CONNECT_TIMEOUT = 250; //ms per attempt
+const EDGE_PAGE = 64; //Edges per 'E' request, HOST_EDGE_PAGE in the firmware
+const SWEEP_RATE = 1000; //RPM/sec used for sweeps set from the GUI
 
-var onConnectInterval;
 var isConnected=false;
 var currentRPM = 0;
 var initComplete = false;
@@ -87,43 +91,76 @@ function openSerialPort()
         initComplete = false;
       });
 
-    //Update the patterns downdown list
     port.on('open', onSerialConnect);
-    //port.on('data', onData);
-    //refreshPatternList();
+    port.on('close', onSerialClose);
+}
 
-    // Master listener for all serial actions
-    // Switches the port into "flowing mode"
-    /*
-    port.on('data', function (data) 
+//Retries the info request until the Arduino has finished resetting (Opening the port resets it)
+async function requestInfo()
+{
+  for(var attempt = 1; ; attempt++)
+  {
+    try
     {
-        //console.log('Data:', data)
-
-        if(data.length < 2) { return; }
-        var knockValue = data[0];
-        var threshold = data[1];
-
-        liveChart.config.data.datasets[0].data.push({
-            x: Date.now(),
-            y: threshold
-            });
-        liveChart.config.data.datasets[1].data.push({
-            x: Date.now(),
-            y: knockValue
-            });
-    })
-    */
-
+      var reply = await client.request('I', [], CONNECT_TIMEOUT);
+      return {
+        wheels: reply.readUInt16LE(0),
+        wheel: reply[2],
+        mode: reply[3],
+        fixedRPM: reply.readUInt16LE(4),
+        sweepLow: reply.readUInt16LE(6),
+        sweepHigh: reply.readUInt16LE(8),
+        sweepRate: reply.readUInt16LE(10),
+      };
+    }
+    catch(err)
+    {
+      if(attempt == CONNECT_ATTEMPTS) { throw err; }
+    }
+  }
 }
 
-function onSerialConnect()
+async function onSerialConnect()
 {
   console.log("Serial port opened");
-  onConnectInterval = setInterval(requestPatternList, 3000);
+  client = new SerialClient(port);
 
   //Activate the links
   document.getElementById("link_live").href = "#live";
   document.getElementById("link_config").href = "#config";
+
+  try
+  {
+    var info = await requestInfo();
+    console.log(`Number of wheels: ${info.wheels}`);
+    isConnected = true;
+    refreshRPMSettings(info);
+
+    //The name list and the current pattern are fetched side by side
+    await Promise.all([ requestPatternList(info), readPattern(info.wheel) ]);
+  }
+  catch(err)
+  {
+    console.log("Connection failed: ", err);
+    modalLoading.remove();
+    window.alert(`Error while connecting: ${err.message}`);
+    return;
+  }
+
+  //Drop the modal loading window
+  modalLoading.remove();
+  //Move to the Live tab
+  window.location.hash = '#live';
+  enableRPM();
+  initComplete = true;
+}
+
+function onSerialClose()
+{
+  console.log("Serial port closed");
+  disableRPM();
+  isConnected = false;
+  if(client != null) { client.close(); client = null; }
 }
 
 
@@ -175,19 +212,19 @@ function uploadFW()
 
 function saveData()
 {
-  //Request the arduino save the current config
-  port.write("c"); //Send the command to perform EEPROM burn
+  //The firmware doesn't keep its settings over a power cycle yet
+  console.log("Save Config is not supported by this firmware");
 }
 
-var patternOptionCounter = 0;
-var numPatterns = 0;
-function requestPatternList()
+//Fills the pattern dropdown with the name of every wheel, all requests are pipelined
+async function requestPatternList(info)
 {
-  //Clear the interval
-  clearInterval(onConnectInterval);
-
-  //Attach the readline parser
-  const parser = port.pipe(new Readline({ delimiter: '\r\n' }));
+  var requests = [];
+  for(var i = 0; i < info.wheels; i++)
+  {
+    requests.push(client.request('L', [i]));
+  }
+  var names = await Promise.all(requests);
 
   //Clear the existing list
   var select = document.getElementById('patternSelect')
@@ -195,135 +232,91 @@ function requestPatternList()
   {
       select.remove(0); //Always 0 index (As each time an item is removed, everything shuffles up 1 place)
   }
-  patternOptionCounter = 0;
-  numPatterns = 0;
-
-  //Request the number of wheels
-  console.log("Requesting number of wheels");
-  port.write("n");
-
-  //Read the available patterns from the arduino
-  console.log("Sending 'L' command");
-  //const parser = port.pipe(new ByteLength({length: 8}))
-  port.write("L"); //Send the command to issue the pattern name list
-  parser.on('data', refreshPatternList);
-  //port.on('data', refreshPatternList);
-  
 
+  for(var i = 0; i < names.length; i++)
+  {
+    var option = document.createElement("option");
+    option.text = names[i].toString('latin1', 1, names[i].length - 1); //Skip the wheel number and NUL
+    option.value = names[i][0];
+    select.add(option);
+  }
+  select.value = info.wheel;
+  console.log("Currently selected Pattern: " + info.wheel);
 }
 
-//Called back after the 'L' command has been received
-function refreshPatternList(data) 
+//Reads the 0/1/2/3 sequence of a wheel, the first page gives the edge count and the rest are requested together
+async function readPattern(wheel)
 {
-  //If this is the first line received, the number is the total number of wheels avaialable
-  if(numPatterns == 0)
+  var first = await client.request('E', edgeRequest(wheel, 0));
+  var edges = first.readUInt16LE(2);
+  var pages = [ Promise.resolve(first) ];
+  for(var edge = EDGE_PAGE; edge < edges; edge += EDGE_PAGE)
   {
-    numPatterns = parseInt(data);
-    console.log(`Number of wheels: ${numPatterns}`);
-    return;
+    pages.push(client.request('E', edgeRequest(wheel, edge)));
   }
+  var replies = await Promise.all(pages);
 
-  console.log(`Adding option #${patternOptionCounter}:\t${data}`)
-  var select = document.getElementById('patternSelect')
-  var option = document.createElement("option");
-  option.text = data;
-  option.value = patternOptionCounter;
-  
-  //Add new item
-  select.add(option);
-
-  patternOptionCounter++;
-
-  if(patternOptionCounter == numPatterns)
-  { 
-    port.unpipe(); 
-
-    //Request the currently selected patter
-    port.write("N"); //Send the command to issue the current pattern number
-    const parser = port.pipe(new Readline({ delimiter: '\r\n' })); //Attach the readline parser
-    parser.on('data', refreshPatternNumber);
+  newPattern = [];
+  for(const reply of replies)
+  {
+    var count = reply[6];
+    for(var i = 0; i < count; i++) { newPattern.push(reply[7 + i]); }
   }
+  patternDegrees = first.readUInt16LE(0);
+  console.log(`Received pattern: ${newPattern}`);
+  console.log(`Pattern duration: ${patternDegrees}`);
+  redrawGears(newPattern, patternDegrees);
 }
 
-//Callback from the 'N' command that returns the number of the selected pattern
-function refreshPatternNumber(data)
-{
-  var select = document.getElementById('patternSelect')
-  var patternID = parseInt(data);
-  port.unpipe();
-  select.value = patternID;
-  console.log("Currently selected Pattern: " + patternID);
-  updatePattern();
-}
-
-function readPattern()
+function edgeRequest(wheel, edge)
 {
-  //Read the 0/1/2/3 sequence for the current pattern from the arduino
-
-  
+  var buffer = Buffer.alloc(4);
+  buffer[0] = wheel;
+  buffer.writeUInt16LE(edge, 1);
+  buffer[3] = EDGE_PAGE;
+  return buffer;
 }
 
-var patternRow = 0;
 var newPattern;
 var patternDegrees;
-function updatePattern()
+async function updatePattern()
 {
-  var patternID = document.getElementById('patternSelect').value;
-
-  const parser = port.pipe(new Readline({ delimiter: '\r\n' }));
-  console.log(`Sending 'S' command with pattern ${patternID}`);
-
-  var buffer = Buffer.alloc(2);
-  buffer[0] = 0x53; // Ascii 'S'
-  buffer[1] = parseInt(patternID);
-  port.write(buffer); //Send the new pattern ID
+  var patternID = parseInt(document.getElementById('patternSelect').value);
 
-  //Send the command to save the pattern to EEPROM
-  saveData();
+  console.log(`Selecting pattern ${patternID}`);
+  try
+  {
+    await client.request('S', [patternID]);
+    await readPattern(patternID);
+  }
+  catch(err) { console.log("Pattern change failed: ", err); }
+}
 
-  //Request the new pattern
-  port.write("P"); //Send the command to read the new pattern out
-  parser.on('data', refreshPattern);
+//Simply redraw the gear pattern using the existing details (Used when the draw style is changed)
+function resetGears()
+{
+  redrawGears(newPattern, patternDegrees);
 }
 
-//Callback for the P command
-function refreshPattern(data)
+//Shows the firmware's RPM mode and settings (from the info request) in the config tab
+function refreshRPMSettings(info)
 {
-  
-  if(patternRow == 0)
+  if(info.mode == 0) { document.getElementById('rpmSelect').value = 1; } //Fixed
+  else if(info.mode == 1) { document.getElementById('rpmSelect').value = 0; } //Sweep
+  document.getElementById('fixedRPM').value = info.fixedRPM;
+  if(info.sweepHigh > 0)
   {
-    //First line sent is the pattern itself
-    console.log(`Received pattern: ${data}`);
-    newPattern = data.split(",");
-    patternRow++;
+    document.getElementById('rpmSweepMin').value = info.sweepLow;
+    document.getElementById('rpmSweepMax').value = info.sweepHigh;
   }
-  else
-  {
-    //2nd line received is the number of degrees the pattern runs over (360 or 720 usually)
-    console.log(`Pattern duration: ${data}`);
-    patternDegrees = parseInt(data);
-    redrawGears(newPattern, patternDegrees);
-    
-    patternRow = 0;
-    port.unpipe();
-
-    if(initComplete == false)
-    {
-      //Drop the modal loading window
-      modalLoading.remove();
-      //Move to the Live tab
-      window.location.hash = '#live';
-      enableRPM();
-      initComplete = true;
-    }
-
-  } 
+  updateRPMInputs(parseInt(document.getElementById('rpmSelect').value));
 }
 
-//Simply redraw the gear pattern using the existing details (Used when the draw style is changed)
-function resetGears()
+function updateRPMInputs(mode)
 {
-  redrawGears(newPattern, patternDegrees);
+  document.getElementById("rpmSweepMin").disabled = (mode != 0);
+  document.getElementById("rpmSweepMax").disabled = (mode != 0);
+  document.getElementById("fixedRPM").disabled = (mode != 1);
 }
 
 function setRPMMode()
@@ -331,75 +324,39 @@ function setRPMMode()
   //Change between pot, fixed and sweep RPM modes
 
   var newMode = parseInt(document.getElementById('rpmSelect').value);
+  console.log(`Changing RPM mode to ${newMode}`);
 
-  const parser = port.pipe(new Readline({ delimiter: '\r\n' }));
-  console.log(`Sending 'M' command to change RPM mode to ${newMode}`);
-
-  var buffer = Buffer.alloc(2);
-  buffer[0] = 0x4D; // Ascii 'M'
-  buffer[1] = newMode;
-  port.write(buffer); //Send the new pattern ID
-
-  //If the new mode is fixed RPM or linear sweep, then send the RPM set values for them
-  if(newMode == 0)
-  {
-    //Sweep RPM mode
-    setSweepRPM();
-
-    //Update the text box enablement
-    document.getElementById("rpmSweepMin").disabled = false;
-    document.getElementById("rpmSweepMax").disabled = false;
-    document.getElementById("fixedRPM").disabled = true;
-  }
-  else if (newMode == 1)
-  {
-    //Fixed RPM mode
-    setFixedRPM();
-    
-    //Update the text box enablement
-    document.getElementById("fixedRPM").disabled = false;
-    document.getElementById("rpmSweepMin").disabled = true;
-    document.getElementById("rpmSweepMax").disabled = true;
-  }
-  else if(newMode == 2)
-  {
-    //Pot mode
+  //Fixed RPM and linear sweep are set by sending their RPM values
+  if(newMode == 0) { setSweepRPM(); }
+  else if (newMode == 1) { setFixedRPM(); }
+  //Pot mode is not driven from the GUI
 
-    //Update the text box enablement
-    document.getElementById("rpmSweepMin").disabled = true;
-    document.getElementById("rpmSweepMax").disabled = true;
-    document.getElementById("fixedRPM").disabled = true;
-  }
-    
-  
+  updateRPMInputs(newMode);
 }
 
 function setFixedRPM()
 {
   var newRPM = parseInt(document.getElementById('fixedRPM').value);
-  //console.log(`Desired RPM: ${newRPM}`);
 
-  var rpmBuffer = Buffer.alloc(3);
-  rpmBuffer[0] = 0x66; // Ascii 'f'
-  rpmBuffer.writeInt16LE(newRPM, 1);
-  //console.log(rpmBuffer);
+  var rpmBuffer = Buffer.alloc(2);
+  rpmBuffer.writeUInt16LE(newRPM, 0);
 
-  port.write(rpmBuffer);
+  client.request('F', rpmBuffer)
+    .catch((err) => { console.log("Fixed RPM change failed: ", err); });
 }
 
 function setSweepRPM()
 {
   var newRPM_min = parseInt(document.getElementById('rpmSweepMin').value);
   var newRPM_max = parseInt(document.getElementById('rpmSweepMax').value);
-  //console.log(`Desired RPM: ${newRPM}`);
 
-  var rpmBuffer = Buffer.alloc(5);
-  rpmBuffer[0] = 0x73; // Ascii 's'
-  rpmBuffer.writeInt16LE(newRPM_min, 1);
-  rpmBuffer.writeInt16LE(newRPM_max, 3);
-  //console.log(rpmBuffer);
+  var rpmBuffer = Buffer.alloc(6);
+  rpmBuffer.writeUInt16LE(newRPM_min, 0);
+  rpmBuffer.writeUInt16LE(newRPM_max, 2);
+  rpmBuffer.writeUInt16LE(SWEEP_RATE, 4);
 
-  port.write(rpmBuffer);
+  client.request('W', rpmBuffer)
+    .catch((err) => { console.log("Sweep change failed: ", err); });
 }
 
 function redrawGears(pattern, degrees)
@@ -461,13 +418,12 @@ function animateGauges() {
 */
 
 var RPMInterval = 0;
+var rpmOutstanding = false;
 function enableRPM()
 {
-  if(RPMInterval == 0)
+  if(RPMInterval == 0 && isConnected)
   {
     RPMInterval = setInterval(updateRPM, 100);
-    const parser = port.pipe(new Readline({ delimiter: '\r\n' }));
-    parser.on('data', receiveRPM);  
   }
   
 }
@@ -477,23 +433,24 @@ function disableRPM()
   console.log("Deactivating RPM reads");
   clearInterval(RPMInterval);
   RPMInterval = 0;
-  port.unpipe();
-  port.read(); //Flush the port
 }
 
 function receiveRPM(data)
 {
-  console.log(`Received RPM: ${data}`);
-  currentRPM = parseInt(data);
-  //console.log(`New RPM: ${currentRPM}`);
+  currentRPM = data.readUInt16LE(0);
+  document.gauges[0].value = currentRPM;
 }
 
 function updateRPM()
 {
-  console.log("Requesting new RPM");
-  port.write("R"); //Request next RPM read
-  document.gauges[0].value = currentRPM;
-  //console.log(`New gauge RPM: ${document.gauges[0].value}`);
+  //Skip a poll rather than queue them up behind a slow reply
+  if(rpmOutstanding || client == null) { return; }
+
+  rpmOutstanding = true;
+  client.request('R')
+    .then(receiveRPM)
+    .catch((err) => { console.log("RPM read failed: ", err); })
+    .finally(() => { rpmOutstanding = false; });
 }
 
 async function checkForUpdates()
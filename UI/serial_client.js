@@ -0,0 +1,158 @@
+//Persistent framed request/reply client for the Ardu-Stim host protocol (see ardustim/host.h)
+//One parser stays on the port for the whole connection. Every request carries an id which the reply echoes,
+//so several requests can be in flight at once and the replies are matched up as they arrive.
+
+const FRAME_SYNC = 0x5A;
+const DEFAULT_TIMEOUT = 500; //ms
+const MAX_OUTSTANDING = 4; //Keeps requests within the Arduino's 64 byte serial receive buffer
+const MAX_REPLY_LENGTH = 8 + 64; //Longest reply payload, an 'E' page of HOST_EDGE_PAGE edges (ardustim/host.h)
+
+const HOST_ERRORS = {
+  1: "Unknown request",
+  2: "Bad request length",
+  3: "Out of range",
+  4: "Checksum error",
+};
+
+class SerialClient
+{
+  constructor(port)
+  {
+    this.port = port;
+    this.nextID = 1;
+    this.pending = new Map(); //id -> {type, resolve, reject, timer}
+    this.queue = []; //Requests waiting for a free slot
+    this.rx = Buffer.alloc(0);
+    this.onData = this.onData.bind(this);
+    this.port.on('data', this.onData);
+  }
+
+  //Sends a request and resolves with the reply payload (after the id), or rejects on an error reply or timeout
+  request(type, payload = [], timeout = DEFAULT_TIMEOUT)
+  {
+    return new Promise((resolve, reject) => {
+      this.queue.push({ type: type.charCodeAt(0), payload: Buffer.from(payload), timeout, resolve, reject });
+      this.pump();
+    });
+  }
+
+  //Starts queued requests while there are free slots
+  pump()
+  {
+    while(this.queue.length > 0 && this.pending.size < MAX_OUTSTANDING)
+    {
+      var req = this.queue.shift();
+      var id = this.allocateID();
+      req.timer = setTimeout(() => {
+        this.pending.delete(id);
+        req.reject(new Error(`Request '${String.fromCharCode(req.type)}' timed out`));
+        this.pump();
+      }, req.timeout);
+      this.pending.set(id, req);
+      this.port.write(this.buildFrame(req.type, id, req.payload));
+    }
+  }
+
+  allocateID()
+  {
+    //Ids are 1-255, skipping any still waiting for a reply
+    do
+    {
+      var id = this.nextID;
+      this.nextID = (this.nextID % 255) + 1;
+    } while(this.pending.has(id));
+    return id;
+  }
+
+  //0x5A, type, length (LE16), id + payload, xor of everything after the sync
+  buildFrame(type, id, payload)
+  {
+    var length = payload.length + 1;
+    var frame = Buffer.alloc(length + 5);
+    frame[0] = FRAME_SYNC;
+    frame[1] = type;
+    frame.writeUInt16LE(length, 2);
+    frame[4] = id;
+    payload.copy(frame, 5);
+    var sum = 0;
+    for(var i = 1; i < frame.length - 1; i++) { sum ^= frame[i]; }
+    frame[frame.length - 1] = sum;
+    return frame;
+  }
+
+  onData(data)
+  {
+    this.rx = Buffer.concat([this.rx, data]);
+
+    while(this.rx.length > 0)
+    {
+      //Skip anything that isn't the start of a frame (eg the menu greeting after a reset)
+      var start = this.rx.indexOf(FRAME_SYNC);
+      if(start < 0) { this.rx = Buffer.alloc(0); return; }
+      this.rx = this.rx.subarray(start);
+      if(this.rx.length < 4) { return; }
+
+      var length = this.rx.readUInt16LE(2);
+      if(length == 0 || length > MAX_REPLY_LENGTH)
+      {
+        //No reply is this long, a stray sync byte rather than a frame
+        this.rx = this.rx.subarray(1);
+        continue;
+      }
+      if(this.rx.length < length + 5) { return; }
+
+      var sum = 0;
+      for(var i = 1; i < length + 4; i++) { sum ^= this.rx[i]; }
+      if(sum != this.rx[length + 4])
+      {
+        //Not a real frame, resync from the next byte
+        this.rx = this.rx.subarray(1);
+        continue;
+      }
+
+      var type = this.rx[1];
+      var body = Buffer.from(this.rx.subarray(4, length + 4));
+      this.rx = this.rx.subarray(length + 5);
+      this.dispatch(type, body);
+    }
+  }
+
+  dispatch(type, body)
+  {
+    var req = this.pending.get(body[0]);
+    if(req === undefined) { return; } //Late reply to a request that already timed out
+
+    if(type == 0x21) // Ascii '!'
+    {
+      //Error reply: id, request type, code
+      if(body[1] != req.type) { return; }
+      this.finish(body[0], req);
+      req.reject(new Error(`Request '${String.fromCharCode(req.type)}' failed: ${HOST_ERRORS[body[2]] || body[2]}`));
+    }
+    else if(type == req.type)
+    {
+      this.finish(body[0], req);
+      req.resolve(body.subarray(1));
+    }
+  }
+
+  finish(id, req)
+  {
+    clearTimeout(req.timer);
+    this.pending.delete(id);
+    this.pump();
+  }
+
+  //Fails everything outstanding, used when the port goes away
+  close()
+  {
+    this.port.removeListener('data', this.onData);
+    var error = new Error("Serial port closed");
+    for(const [id, req] of this.pending) { clearTimeout(req.timer); req.reject(error); }
+    for(const req of this.queue) { req.reject(error); }
+    this.pending.clear();
+    this.queue = [];
+  }
+}
+
+module.exports = SerialClient;
@@ -29,5 +29,18 @@
 ISR(ADC_vect);         /* Analog pot for analog RPM control with no UI */
 ISR(TIMER1_COMPA_vect); /* High speed pattern output */
 ISR(TIMER2_COMPA_vect); /* Sweeper */
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+ISR(TIMER3_COMPA_vect); /* Engine 2 pattern output (twin engine mode) */
+ISR(INT4_vect);         /* Sync pulse input (slave) */
+ISR(INT5_vect);         /* Tach input (tach-follow mode) */
+ISR(INT0_vect);         /* ECU output capture channels 0-3 */
+ISR(INT1_vect);
+ISR(INT2_vect);
+ISR(INT3_vect);
+#else
+ISR(INT0_vect);         /* Sync pulse input (slave) */
+ISR(INT1_vect);         /* Tach input (tach-follow mode) */
+ISR(PCINT1_vect);       /* ECU output capture channels 0-1 */
+#endif
 
 #endif
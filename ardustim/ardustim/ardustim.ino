@@ -20,150 +20,70 @@
  *
  */
 
+#include "calibration.h"
 #include "defines.h" 
 #include "enums.h"
+#include "hal.h"
+#include "routing.h"
 #include "serialmenu.h"
+#include "structures.h"
 #include "sweep.h"
 #include "wheel_defs.h"
 #include "user_defaults.h"
 #include <avr/pgmspace.h>
-#include <SerialUI.h>
 
 /* Sensitive stuff used in ISR's */
-volatile uint8_t fraction = 0;
-volatile uint8_t selected_wheel = DEFAULT_WHEEL;
-volatile uint8_t camSignalBitShift = 0;
 volatile uint16_t adc0; /* POT RPM */
 volatile uint16_t adc1; /* Pot Wheel select */
-volatile uint32_t oc_remainder = 0;
-/* Setting rpm to any value over 0 will enabled sweeping by default */
-/* Stuff for handling prescaler changes (small tooth wheels are low RPM) */
 volatile uint8_t analog_port = 0;
 volatile bool adc0_read_complete = false;
 volatile bool adc1_read_complete = false;
-volatile bool reset_prescaler = false;
-volatile bool normal = true;
-volatile bool sweep_reset_prescaler = true; /* Force sweep to reset prescaler value */
-volatile bool sweep_lock = false;
-volatile uint8_t output_invert_mask = 0x00; /* Don't invert anything */
-volatile uint8_t sweep_direction = ASCENDING;
-volatile byte total_sweep_stages = 0;
-volatile int8_t sweep_stage = 0;
-volatile uint8_t prescaler_bits = 0;
-volatile uint8_t last_prescaler_bits = 0;
-volatile uint8_t mode = FIXED_RPM;
-volatile uint16_t new_OCR1A = 5000; /* sane default */
-volatile uint16_t edge_counter = 0;
+engine engines[NUM_ENGINES]; /* Per engine pattern, RPM and sweep state */
 
 /* Less sensitive globals */
 uint8_t bitshift = 0;
-uint16_t sweep_low_rpm = 0;
-uint16_t sweep_high_rpm = 0;
-uint16_t sweep_rate = 0;
+uint8_t active_engine = ENGINE_1; /* Engine the serial UI is configuring */
 
-SUI::SerialUI mySUI = SUI::SerialUI();
-sweep_step *SweepSteps;  /* Global pointer for the sweep steps */
+//! Sets an engine to the power-on defaults
+/*!
+ * Default wheel, normal rotation, nothing inverted, fixed DEFAULT_RPM
+ */
+void init_engine(engine *e) {
+  memset(e, 0, sizeof(engine));
+  e->selected_wheel = DEFAULT_WHEEL;
+  e->normal = true;
+  e->new_OCR1A = 5000; /* sane default */
+  e->sweep_reset_prescaler = true;
+  e->sweep_direction = ASCENDING;
+  e->mode = FIXED_RPM;
+  e->wanted_rpm = DEFAULT_RPM;
+}
 
 /* Initialization */
 void setup() {
-  mySUI.setGreeting(F("+++ Welcome to the ArduStim +++\r\nEnter ? for help"));                                  
-  extern unsigned long wanted_rpm;
+  for (uint8_t i = 0; i < NUM_ENGINES; i++)
+    init_engine(&engines[i]);
+  /* Stored clock correction (calibration.h), before any period is worked out */
+  calibration_setup();
   serial_setup();
 
   cli(); // stop interrupts
 
-  /* Configuring TIMER1 (pattern generator) */
-  // Set timer1 to generate pulses
-  TCCR1A = 0;
-  TCCR1B = 0;
-  TCNT1 = 0;
-
-  // Set compare register to sane default
-  OCR1A = 1000;  /* 8000 RPM (60-2) */
-
-  // Turn on CTC mode
-  TCCR1B |= (1 << WGM12); // Normal mode (not PWM)
-  // Set prescaler to 1
-  TCCR1B |= (1 << CS10); /* Prescaler of 1 */
-  // Enable output compare interrupt for timer channel 1 (16 bit)
-  TIMSK1 |= (1 << OCIE1A);
-
-  // Set timer2 to run sweeper routine
-  TCCR2A = 0;
-  TCCR2B = 0;
-  TCNT2 = 0;
-
-  // Set compare register to sane default
-  OCR2A = 249;  /* With prescale of x64 gives 1ms tick */
-
-  // Turn on CTC mode
-  TCCR2A |= (1 << WGM21); // Normal mode (not PWM)
-  // Set prescaler to x64
-  TCCR2B |= (1 << CS22); /* Prescaler of 64 */
-  // Enable output compare interrupt for timer channel 2
-  TIMSK2 |= (1 << OCIE2A);
-
-
-  /* Configure ADC as per http://www.glennsweeney.com/tutorials/interrupt-driven-analog-conversion-with-an-atmega328p */
-  // clear ADLAR in ADMUX (0x7C) to right-adjust the result
-  // ADCL will contain lower 8 bits, ADCH upper 2 (in last two bits)
-  ADMUX &= B11011111;
-  
-  // Set REFS1..0 in ADMUX (0x7C) to change reference voltage to the
-  // proper source (01)
-  ADMUX |= B01000000;
-  
-  // Clear MUX3..0 in ADMUX (0x7C) in preparation for setting the analog
-  // input
-  ADMUX &= B11110000;
-  
-  // Set MUX3..0 in ADMUX (0x7C) to read from AD8 (Internal temp)
-  // Do not set above 15! You will overrun other parts of ADMUX. A full
-  // list of possible inputs is available in Table 24-4 of the ATMega328
-  // datasheet
-  // ADMUX |= 8;
-  // ADMUX |= B00001000; // Binary equivalent
-  
-  // Set ADEN in ADCSRA (0x7A) to enable the ADC.
-  // Note, this instruction takes 12 ADC clocks to execute
-  ADCSRA |= B10000000;
-  
-  // Set ADATE in ADCSRA (0x7A) to enable auto-triggering.
-  ADCSRA |= B00100000;
-  
-  // Clear ADTS2..0 in ADCSRB (0x7B) to set trigger mode to free running.
-  // This means that as soon as an ADC has finished, the next will be
-  // immediately started.
-  ADCSRB &= B11111000;
-  
-  // Set the Prescaler to 128 (16000KHz/128 = 125KHz)
-  // Above 200KHz 10-bit results are not reliable.
-  ADCSRA |= B00000111;
-  
-  // Set ADIE in ADCSRA (0x7A) to enable the ADC interrupt.
-  // Without this, the internal interrupt will not trigger.
-  ADCSRA |= B00001000;
-
-//  pinMode(7, OUTPUT); /* Debug pin for Saleae to track sweep ISR execution speed */
-#if defined(__AVR_ATmega328P__)
-  DDRB = B00111111;
-  DDRD = B11111100;
-  DDRC = B00110000;
-
-
-#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
-  // pinMode(53, OUTPUT);
-  // pinMode(52, OUTPUT);
-  DDRB = B00011111;
-  DDRC = B11110000;
-  DDRA = B00000001;
-  // pinMode(22, OUTPUT);
+  hal_setup_timers();
+#if CONFIG_ADC
+  hal_setup_adc();
 #endif
+  hal_setup_ports();
+  /* Pattern pins are driven through the routing tables (routing.h) */
+  route_defaults();
+  route_compile(&engines[ENGINE_1]);
 
   sei(); // Enable interrupts
-  // Set ADSC in ADCSRA (0x7A) to start the ADC conversion
-  ADCSRA |= B01000000;
+#if CONFIG_ADC
+  hal_start_adc();
+#endif
   /* Make sure we are using the DEFAULT RPM on startup */
-  reset_new_OCR1A(wanted_rpm); 
+  for (uint8_t i = 0; i < NUM_ENGINES; i++)
+    reset_new_OCR1A(&engines[i], engines[i].wanted_rpm);
 
 } // End setup
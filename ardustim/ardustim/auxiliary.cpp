@@ -0,0 +1,348 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ * 
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+#include "auxiliary.h"
+#include "calibration.h"
+#include "defines.h"
+#include "enums.h"
+#include "structures.h"
+#include "sweep.h"
+#include "twin_engine.h"
+#include "wide_output.h"
+#include <Arduino.h>
+#include <math.h>
+#include <util/atomic.h>
+
+#ifdef AUX_SUPPORTED
+
+extern wheels Wheels[];
+extern engine engines[];
+
+uint16_t aux_speed_hz = 0;
+uint16_t aux_speed_ramp = 0;
+uint8_t aux_map_mean = 0;
+uint8_t aux_map_depth = 0;
+uint8_t aux_map_pulses = 0;
+uint8_t aux_tps = 0;
+uint16_t aux_knock_angle = 0;
+uint16_t aux_knock_width = 0;
+uint16_t aux_knock_cycles = 0;
+
+static uint32_t speed_now = 0;       /* Output right now, 1/256 Hz */
+static uint32_t speed_last_ms = 0;
+/* MAP level (8 bit) per edge of engine 1's wheel */
+static uint8_t map_levels[MAX_WHEEL_EDGES];
+/* Used in the Timer4 overflow ISR */
+static volatile bool map_active = false;
+static volatile bool knock_armed = false;
+static volatile uint16_t knock_start;       /* First edge of the window */
+static volatile uint16_t knock_edges;       /* Window length */
+static volatile uint16_t knock_left;        /* Bursts left, 0 every cycle */
+static volatile uint16_t wheel_edges;
+static uint16_t last_edge = 0xFFFF;
+static bool knock_on = false;
+
+
+//! Enables the Timer4 overflow interrupt while anything needs the crank angle
+static void update_tick() {
+  if (map_active || knock_armed)
+    TIMSK4 |= (1 << TOIE4);
+  else
+    TIMSK4 &= ~(1 << TOIE4);
+}
+
+
+//! Starts Timer4 as the PWM carrier (fast PWM, TOP = ICR4, /1) if stopped
+static void start_pwm() {
+  if (TCCR4B & (1 << CS40))
+    return;
+  PORTH &= ~((1 << PH3) | (1 << PH4) | (1 << PH5));
+  DDRH |= (1 << PH3) | (1 << PH4) | (1 << PH5);
+  TCCR4A = (1 << WGM41);
+  TCCR4B = (1 << WGM43) | (1 << WGM42);
+  ICR4 = AUX_PWM_TOP;
+  OCR4A = 0;
+  OCR4B = 0;
+  OCR4C = AUX_PWM_TOP / 2; /* Knock bursts at 50% */
+  TCNT4 = 0;
+  TCCR4B |= (1 << CS40);
+}
+
+
+//! Connects a Timer4 PWM channel to its pin, or holds the pin low
+/*!
+ * TCCR4A is shared with the knock bursts in the overflow ISR
+ * \param com COM4x1 bit of the channel
+ * \param pin PORTH bit of the channel
+ */
+static void pwm_channel(uint8_t com, uint8_t pin, bool on) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (on)
+      TCCR4A |= (1 << com);
+    else {
+      TCCR4A &= ~(1 << com);
+      PORTH &= ~(1 << pin);
+    }
+  }
+}
+
+
+//! Percent of the PWM range as a compare value
+static uint16_t pwm_percent(uint8_t percent) {
+  return (uint32_t)percent * AUX_PWM_TOP / 100;
+}
+
+
+//! Loads Timer5 for a speed output frequency
+/*!
+ * Fast PWM with TOP = OCR5A (double buffered, so a new period never
+ * glitches) toggling OC5A at TOP, i.e. F_CPU / (2 * N * (OCR5A + 1)).
+ * Below what /1024 can reach the output stops, low.
+ * \param f256 frequency in 1/256 Hz
+ */
+static void load_speed(uint32_t f256) {
+  static const uint8_t shifts[] = { 0, 3, 6, 8, 10 }; /* PRESCALE_1 to PRESCALE_1024 */
+  uint32_t ticks;
+  uint8_t bits;
+
+  if (f256 < 31) {
+    TCCR5A = 0;
+    TCCR5B = 0;
+    PORTL &= ~(1 << PL3);
+    return;
+  }
+  ticks = (half_clock << 8) / f256; /* F_CPU / 2 in 1/256 Hz */
+  for (bits = PRESCALE_1; bits < PRESCALE_1024; bits++)
+    if ((ticks >> shifts[bits - 1]) <= 65536)
+      break;
+  OCR5A = (ticks >> shifts[bits - 1]) - 1;
+  if ((TCCR5B & 0x07) != bits) {
+    if (!(TCCR5B & 0x07))
+      TCNT5 = 0;
+    TCCR5A = (1 << COM5A0) | (1 << WGM51) | (1 << WGM50);
+    TCCR5B = (1 << WGM53) | (1 << WGM52) | bits;
+  }
+}
+
+
+//! Sets the speed output target
+/*!
+ * \param hz target frequency, 0 stops (after the ramp)
+ * \param ramp Hz/sec towards it, 0 jumps straight there
+ * \returns false if out of range or PORTL belongs to twin engine or wide
+ * output mode
+ */
+bool set_aux_speed(uint16_t hz, uint16_t ramp) {
+  if (hz > AUX_MAX_SPEED_HZ)
+    return false;
+  if (hz && (twin_engine || wide_output))
+    return false;
+  if (hz)
+    DDRL |= (1 << PL3);
+  aux_speed_hz = hz;
+  aux_speed_ramp = ramp;
+  speed_last_ms = millis();
+  return true;
+}
+
+
+//! Speed output right now, Hz
+uint16_t aux_speed_now() {
+  return speed_now >> 8;
+}
+
+
+//! True while the speed output holds D46 (PORTL)
+bool aux_speed_active() {
+  return aux_speed_hz || speed_now;
+}
+
+
+//! Sets the MAP output
+/*!
+ * \param mean average level, percent
+ * \param depth pulsation peak to peak, percent
+ * \param pulses intake pulses per 720 degrees (cylinders on a 4 stroke)
+ */
+void set_aux_map(uint8_t mean, uint8_t depth, uint8_t pulses) {
+  aux_map_mean = mean;
+  aux_map_depth = depth;
+  aux_map_pulses = pulses;
+  start_pwm();
+  refresh_aux();
+  pwm_channel(COM4A1, PH3, mean || depth);
+}
+
+
+//! Sets the TPS output, percent (0 off)
+void set_aux_tps(uint8_t percent) {
+  aux_tps = percent;
+  start_pwm();
+  OCR4B = pwm_percent(percent);
+  pwm_channel(COM4B1, PH4, percent);
+}
+
+
+//! Arms knock bursts
+/*!
+ * \param angle degrees from edge 0 the burst starts at
+ * \param width degrees the burst lasts, 0 stops them
+ * \param cycles number of bursts, 0 for one every wheel cycle
+ * \returns false if the window doesn't fit the wheel of engine 1
+ */
+bool set_aux_knock(uint16_t angle, uint16_t width, uint16_t cycles) {
+  uint16_t degrees = get_wheel_degrees(engines[ENGINE_1].selected_wheel);
+
+  if (width && ((angle >= degrees) || (width >= degrees)))
+    return false;
+  aux_knock_angle = angle;
+  aux_knock_width = width;
+  aux_knock_cycles = cycles;
+  start_pwm();
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    knock_left = cycles;
+    knock_armed = false; /* refresh_aux() arms it again */
+    knock_on = false;
+    pwm_channel(COM4C1, PH5, false);
+  }
+  refresh_aux();
+  return true;
+}
+
+
+//! Rebuilds the per edge MAP levels and the knock window
+/*!
+ * Called when engine 1 changes wheel, and whenever the MAP or knock
+ * settings change. MAP dips once per intake pulse, a cosine around the
+ * mean. Wheels covering 360 degrees get half the pulses per revolution.
+ * A running speed output is reloaded too, for a new clock correction.
+ */
+void refresh_aux() {
+  uint8_t wheel = engines[ENGINE_1].selected_wheel;
+  uint16_t edges = Wheels[wheel].wheel_max_edges;
+  uint16_t degrees = get_wheel_degrees(wheel);
+  bool pulsate = aux_map_depth && aux_map_pulses;
+
+  if (speed_now)
+    load_speed(speed_now);
+  if (!(TCCR4B & (1 << CS40)))
+    return; /* No PWM output set up yet */
+  if (edges > MAX_WHEEL_EDGES)
+    edges = MAX_WHEEL_EDGES;
+  map_active = false;
+  if (pulsate) {
+    float pulses = (float)aux_map_pulses * degrees / 720.0;
+    for (uint16_t i = 0; i < edges; i++) {
+      float level = aux_map_mean - 0.5 * aux_map_depth * cos(2.0 * M_PI * pulses * i / edges);
+      if (level < 0)
+        level = 0;
+      if (level > 100)
+        level = 100;
+      map_levels[i] = (uint8_t)(level * 2.55 + 0.5);
+    }
+  }
+  else
+    OCR4A = pwm_percent(aux_map_mean);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    wheel_edges = edges;
+    map_active = pulsate;
+    last_edge = 0xFFFF;
+    if (aux_knock_width && (aux_knock_cycles == 0 || knock_left)) {
+      uint16_t width = (uint32_t)aux_knock_width * edges / degrees;
+      knock_start = ((uint32_t)aux_knock_angle * edges / degrees) % edges;
+      knock_edges = width ? width : 1;
+      knock_armed = true;
+    }
+    else
+      knock_armed = false;
+    update_tick();
+  }
+}
+
+
+//! Steps the speed output towards its target, every ms
+void aux_service() {
+  uint32_t target = (uint32_t)aux_speed_hz << 8;
+  uint32_t now = millis();
+  uint32_t elapsed = now - speed_last_ms;
+  uint32_t step;
+
+  if (speed_now == target) {
+    speed_last_ms = now;
+    return;
+  }
+  if (!elapsed)
+    return;
+  speed_last_ms = now;
+  if (elapsed > 100)
+    elapsed = 100;
+  step = aux_speed_ramp ? (uint32_t)aux_speed_ramp * 256 * elapsed / 1000 : 0xFFFFFFFF;
+  if (!step)
+    step = 1;
+  if (speed_now < target)
+    speed_now = (target - speed_now > step) ? speed_now + step : target;
+  else
+    speed_now = (speed_now - target > step) ? speed_now - step : target;
+  load_speed(speed_now);
+}
+
+
+/* Every PWM period while MAP pulsates or knock is armed, picks engine 1's
+ * crank position up from edge_counter. Runs with interrupts enabled so
+ * the edge ISR's never wait on it.
+ */
+ISR(TIMER4_OVF_vect, ISR_NOBLOCK) {
+  uint16_t edge;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    edge = engines[ENGINE_1].edge_counter;
+  }
+  if ((edge == last_edge) || (edge >= wheel_edges))
+    return;
+  last_edge = edge;
+  if (map_active)
+    OCR4A = (uint16_t)map_levels[edge] << AUX_LEVEL_SHIFT;
+  if (knock_armed) {
+    uint16_t from_start = (edge >= knock_start) ? edge - knock_start : edge + wheel_edges - knock_start;
+    bool in = from_start < knock_edges;
+
+    if (in != knock_on) {
+      knock_on = in;
+      if (in)
+        TCCR4A |= (1 << COM4C1);
+      else {
+        TCCR4A &= ~(1 << COM4C1);
+        if (knock_left && !--knock_left) {
+          knock_armed = false;
+          update_tick();
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ * 
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+#ifndef __AUXILIARY_H__
+#define __AUXILIARY_H__
+
+#include "defines.h"
+
+/* Auxiliary signals (ATmega1280/2560 only), on Timer4 and Timer5
+ *
+ *   D46 (OC5A)  shaft/vehicle speed, square wave with its own ramp
+ *   D6  (OC4A)  MAP, PWM pulsating with the crank angle of engine 1
+ *   D7  (OC4B)  TPS, PWM at a fixed duty
+ *   D8  (OC4C)  knock, bursts of the PWM carrier over a crank angle window
+ * PWM channels run at AUX_PWM_HZ, an RC filter (e.g. 10k/1uF) turns them
+ * into a voltage. D46 is on PORTL, so the speed output can't run with
+ * twin engine or wide output mode.
+ *
+ * None of this costs the Timer1 edge ISR anything. Speed is stepped
+ * towards its target every ms from aux_service(). MAP levels are
+ * precomputed per edge of the wheel, and the Timer4 overflow ISR (every
+ * PWM period, only enabled while MAP pulsates or knock is armed) picks
+ * them and the knock window up from edge_counter. It runs with interrupts
+ * enabled like the sweeper so the edge ISR's can always get in. Angles are
+ * as good as the edge the window falls on, plus up to one PWM period.
+ */
+#if CONFIG_AUX && (defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__))
+#define AUX_SUPPORTED
+
+#define AUX_PWM_TOP 2047        /* 11 bit PWM at /1, 7812.5 Hz */
+#define AUX_PWM_HZ 7812
+#define AUX_LEVEL_SHIFT 3       /* MAP levels are 8 bit */
+#define AUX_MAX_SPEED_HZ 20000
+
+extern uint16_t aux_speed_hz;        /* Target */
+extern uint16_t aux_speed_ramp;      /* Hz/sec, 0 jumps straight to it */
+extern uint8_t aux_map_mean;         /* Percent of the PWM range */
+extern uint8_t aux_map_depth;        /* Percent, peak to peak */
+extern uint8_t aux_map_pulses;       /* Per 720 degrees */
+extern uint8_t aux_tps;              /* Percent */
+extern uint16_t aux_knock_angle;     /* Degrees from edge 0 */
+extern uint16_t aux_knock_width;     /* Degrees, 0 off */
+extern uint16_t aux_knock_cycles;    /* Bursts left, 0 every cycle */
+
+bool set_aux_speed(uint16_t, uint16_t);
+uint16_t aux_speed_now(void);
+bool aux_speed_active(void);
+void set_aux_map(uint8_t, uint8_t, uint8_t);
+void set_aux_tps(uint8_t);
+bool set_aux_knock(uint16_t, uint16_t, uint16_t);
+void refresh_aux(void);
+void aux_service(void);
+#else
+static inline bool aux_speed_active(void) { return false; }
+static inline void refresh_aux(void) {}
+static inline void aux_service(void) {}
+#endif
+
+#endif
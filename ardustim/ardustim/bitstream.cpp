@@ -0,0 +1,175 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "bitstream.h"
+#include "calibration.h"
+#include "defines.h"
+#include "enums.h"
+#include "structures.h"
+#include "wide_output.h"
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#ifdef BITSTREAM_SUPPORTED
+
+/* MSPIM reuses the UCSZ bits, UDORD = LSB first */
+#ifndef UDORD3
+#define UDORD3 UCSZ31
+#endif
+
+extern wheels Wheels[];
+extern engine engines[];
+
+volatile bool bitstream_output = false;
+volatile uint16_t bitstream_underruns = 0;
+/* Whole wheel revolutions packed LSB first, enough of them to end on a byte */
+static uint8_t bitstream[MAX_WHEEL_EDGES];
+static uint8_t bitstream_len;
+static volatile uint8_t bitstream_index;
+
+
+//! Works out the USART3 baud register for the engine 1 RPM
+/*!
+ * \returns UBRR3 value or 0 when the RPM can't be shifted out
+ */
+static uint16_t get_bitstream_ubrr() {
+  engine *e = &engines[ENGINE_1];
+  float half_period = (float)(half_clock >> 1) / (e->wanted_rpm * Wheels[e->selected_wheel].rpm_scaler);
+
+  if ((half_period < (BITSTREAM_MIN_UBRR + 1)) || (half_period > (BITSTREAM_MAX_UBRR + 1)))
+    return 0;
+  return (uint16_t)(half_period + 0.5) - 1;
+}
+
+
+//! Packs the crank1 track of the selected wheel into the bit buffer
+/*!
+ * Wheels with an edge count that isn't a multiple of 8 are repeated until
+ * they are, which never takes more bytes than the wheel has edges. The
+ * invert mask and direction are applied here
+ */
+static void build_bitstream() {
+  engine *e = &engines[ENGINE_1];
+  uint16_t edges = Wheels[e->selected_wheel].wheel_max_edges;
+  uint16_t bits;
+  uint8_t byte = 0;
+
+  if (edges > MAX_WHEEL_EDGES)
+    edges = MAX_WHEEL_EDGES;
+  bits = edges;
+  while (bits & 0x07)
+    bits += edges;
+  for (uint16_t i = 0; i < bits; i++) {
+    uint16_t edge = i % edges;
+    if (!e->normal)
+      edge = edges - 1 - edge;
+    if ((e->crank_invert_mask ^ pgm_read_byte(&Wheels[e->selected_wheel].edge_crank_ptr[edge])) & 0x01)
+      byte |= (1 << (i & 0x07));
+    if ((i & 0x07) == 0x07) {
+      bitstream[i >> 3] = byte;
+      byte = 0;
+    }
+  }
+  bitstream_len = bits >> 3;
+}
+
+
+//! Refills the USART3 data register, 8 edges at a time
+/*!
+ * TXC3 only sets once the shift register ran dry with nothing waiting in
+ * UDR3, i.e. this refill came too late and the line held
+ */
+ISR(USART3_UDRE_vect) {
+  uint8_t index = bitstream_index;
+
+  UDR3 = bitstream[index];
+  if (UCSR3A & (1 << TXC3)) {
+    UCSR3A |= (1 << TXC3);
+    bitstream_underruns++;
+  }
+  if (++index >= bitstream_len)
+    index = 0;
+  bitstream_index = index;
+}
+
+
+//! Enables or disables bitstream output
+/*!
+ * Only at a fixed RPM inside the USART range, and not in wide output mode
+ * (it needs the Timer1 edge ISR). The buffer is filled with the refill ISR
+ * off, then the Timer1 edge ISR is stopped and the USART started
+ * \param enable true to shift the crank track out of TX3
+ * \returns the new state
+ */
+bool set_bitstream(bool enable) {
+  uint16_t ubrr = get_bitstream_ubrr();
+
+  if (enable && (wide_output || (engines[ENGINE_1].mode != FIXED_RPM) || !ubrr))
+    enable = false;
+  UCSR3B = 0;
+  if (enable) {
+    build_bitstream();
+    bitstream_index = 0;
+    bitstream_underruns = 0;
+    TIMSK1 &= ~(1 << OCIE1A);
+    UBRR3 = 0;
+    DDRJ |= (1 << PJ2);  /* XCK3 as output selects master mode */
+    UCSR3C = (1 << UMSEL31) | (1 << UMSEL30) | (1 << UDORD3);
+    UCSR3A |= (1 << TXC3); /* Left over from before, not an underrun */
+    UCSR3B = (1 << TXEN3) | (1 << UDRIE3);
+    UBRR3 = ubrr;        /* Set after enabling the transmitter, see datasheet */
+    bitstream_output = true;
+  } else {
+    if (bitstream_output)
+      TIMSK1 |= (1 << OCIE1A);
+    bitstream_output = false;
+  }
+  return bitstream_output;
+}
+
+
+//! Follows engine 1 wheel, RPM, direction and invert changes
+/*!
+ * Rebuilds the buffer and baud rate, leaving fixed RPM mode or an RPM out
+ * of range turns bitstream output off
+ */
+void refresh_bitstream() {
+  uint16_t ubrr;
+
+  if (!bitstream_output)
+    return;
+  ubrr = get_bitstream_ubrr();
+  if ((engines[ENGINE_1].mode != FIXED_RPM) || !ubrr) {
+    set_bitstream(false);
+    return;
+  }
+  /* Refill ISR off while rebuilding, the line idles for a moment */
+  UCSR3B &= ~(1 << UDRIE3);
+  build_bitstream();
+  bitstream_index = 0;
+  UBRR3 = ubrr;
+  UCSR3A |= (1 << TXC3); /* The pause above isn't an underrun */
+  UCSR3B |= (1 << UDRIE3);
+}
+
+#endif
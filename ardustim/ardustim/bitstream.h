@@ -0,0 +1,67 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __BITSTREAM_H__
+#define __BITSTREAM_H__
+
+#include <inttypes.h>
+#include "defines.h"
+
+/* Bitstream output mode (ATmega1280/2560 only)
+ *
+ * The crank1 track of engine 1 is packed into a RAM bit buffer, one bit per
+ * edge, and shifted out of USART3 in master SPI mode (MSPIM) on TX3 (D14).
+ * The USART clock runs at one bit per edge so the hardware emits the edges,
+ * the UDRE ISR only refills the data register, once per 8 edges instead of
+ * once per edge on Timer1.
+ *
+ * Bit rate: F_CPU / (2 * (UBRR3 + 1)) = 2 * RPM * rpm_scaler, so
+ *   UBRR3 + 1 = 4000000 / (RPM * rpm_scaler)
+ * UBRR3 is 12 bits (lowest RPM * rpm_scaler about 977) and is kept at
+ * BITSTREAM_MIN_UBRR or above. The refill is due within 8 bit times
+ * (16 * (UBRR3 + 1) cycles), at the top end that's shorter than the serial
+ * RX and aux/VR ISRs can hold it off for. When the shift register runs
+ * dry the line holds for the rest of that byte's time, the refill ISR
+ * counts these in bitstream_underruns and the menu reports them when the
+ * output is turned off. Fixed RPM only, the Timer1 edge ISR is stopped
+ * while active so the cam track, sync and routed pins hold.
+ *
+ * USART0 carries the serial UI and the SPI clock only has 7 power of 2
+ * dividers, so this isn't available on the ATmega328P.
+ */
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#define BITSTREAM_SUPPORTED
+
+#define BITSTREAM_MIN_UBRR 3     /* 64 cycles per byte at the top end */
+#define BITSTREAM_MAX_UBRR 4095
+
+extern volatile bool bitstream_output;
+extern volatile uint16_t bitstream_underruns;
+
+bool set_bitstream(bool);
+void refresh_bitstream(void);
+#else
+static inline void refresh_bitstream(void) {}
+#endif
+
+#endif
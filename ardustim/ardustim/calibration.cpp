@@ -0,0 +1,136 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ * 
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+
+#include "auxiliary.h"
+#include "bitstream.h"
+#include "calibration.h"
+#include "defines.h"
+#include "enums.h"
+#include "serialmenu.h"
+#include "structures.h"
+#include "sweep.h"
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+
+extern engine engines[];
+
+int16_t clock_ppm = 0;
+
+
+//! Sets half_clock for a correction, nothing else
+static void load_clock_ppm(int16_t ppm) {
+  clock_ppm = ppm;
+  half_clock = NOMINAL_HALF_CLOCK + 8L * ppm;
+}
+
+
+//! Redoes the timer values of everything running for the new half_clock
+static void retime_outputs() {
+  for (uint8_t i = 0; i < NUM_ENGINES; i++)
+  {
+    engine *e = &engines[i];
+
+#if CONFIG_SWEEP
+    if (e->mode == LINEAR_SWEPT_RPM)
+    {
+      e->mode = FIXED_RPM; /* Stops the sweeper touching this engine */
+      reset_new_OCR1A(e, e->sweep_low_rpm);
+      compute_sweep_stages(e, &e->sweep_low_rpm, &e->sweep_high_rpm);
+      continue;
+    }
+#endif
+    if (e->staging && e->staged.rpm)
+    {
+      /* wanted_rpm is the staged RPM, it goes live with the commit (commit.h) */
+      engine_config c;
+
+      get_fixed_period(e->staged.selected_wheel, e->wanted_rpm, &c);
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        e->staged.new_OCR1A = c.new_OCR1A;
+        e->staged.ocr_fraction = c.ocr_fraction;
+        e->staged.prescaler_bits = c.prescaler_bits;
+        e->staged.ext_chunks = c.ext_chunks;
+        e->staged.ext_final = c.ext_final;
+      }
+    }
+    /* Fixed RPM, or tach follow which keeps wanted_rpm up to date */
+    else if (e->wanted_rpm)
+      reset_new_OCR1A(e, e->wanted_rpm);
+  }
+  refresh_bitstream();
+  refresh_aux();
+}
+
+
+//! Loads the stored clock correction, before any period is worked out
+void calibration_setup() {
+  clock_cal cal;
+
+  eeprom_read_block(&cal, (const void *)CLOCK_CAL_EEPROM, sizeof(clock_cal));
+  if ((cal.magic == CLOCK_CAL_MAGIC) && (cal.ppm >= -CLOCK_PPM_MAX) && (cal.ppm <= CLOCK_PPM_MAX))
+    load_clock_ppm(cal.ppm);
+}
+
+
+//! Applies and stores a clock correction
+/*!
+ * Anything running is retimed straight away. EEPROM is only written if
+ * the value changed.
+ * \param ppm how fast the board's clock runs, parts per million
+ * \returns false if out of range (+-CLOCK_PPM_MAX)
+ */
+bool set_clock_ppm(int16_t ppm) {
+  clock_cal cal;
+
+  if ((ppm < -CLOCK_PPM_MAX) || (ppm > CLOCK_PPM_MAX))
+    return false;
+  cal.magic = CLOCK_CAL_MAGIC;
+  cal.ppm = ppm;
+  eeprom_update_block(&cal, (void *)CLOCK_CAL_EEPROM, sizeof(clock_cal));
+  load_clock_ppm(ppm);
+  retime_outputs();
+  return true;
+}
+
+
+//! Works out the correction from a measured output
+/*!
+ * The output comes out at target * (1 + actual) / (1 + clock_ppm), in
+ * ppm, so the actual clock error follows from the ratio. Any unit will do
+ * as long as both are the same, the more digits the better (e.g. mHz).
+ * \param target what the output was set to
+ * \param measured what it was measured at
+ * \returns the new correction, rounded to the nearest ppm (not range
+ * checked, set_clock_ppm() does that)
+ */
+int16_t trimmed_clock_ppm(uint32_t target, uint32_t measured) {
+  float ppm = (1000000.0 + clock_ppm) * ((float)measured / (float)target) - 1000000.0;
+
+  if (ppm > 32767.0)
+    return 32767;
+  if (ppm < -32768.0)
+    return -32768;
+  return (int16_t)(ppm < 0 ? ppm - 0.5 : ppm + 0.5);
+}
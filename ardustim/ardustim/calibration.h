@@ -0,0 +1,56 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ * 
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __CALIBRATION_H__
+#define __CALIBRATION_H__
+
+#include <inttypes.h>
+
+/* Clock calibration
+ *
+ * Every RPM to timer tick conversion starts from half_clock, the timer
+ * ticks at /1 in half a second (F_CPU / 2 on a perfect 16 MHz crystal).
+ * Resonator based boards are off by up to 0.5%, so half_clock is trimmed
+ * by clock_ppm (positive when the board's clock runs fast). At 8 ticks
+ * per ppm the correction is exact in integer ticks, and as half_clock
+ * stays below 2^24 the float period maths loses nothing to it either.
+ *
+ * The correction is worked out off the board: run a fixed RPM, measure
+ * what comes out against a good timebase (frequency counter, logic
+ * analyzer or the host timestamping a known number of edges) and hand
+ * the target and measured values to clocktrim, or a ppm figure to clock
+ * or the host 'K' request. It's kept in EEPROM from then on.
+ */
+#define NOMINAL_HALF_CLOCK 8000000UL
+#define CLOCK_PPM_MAX 10000        /* +-1%, well past any resonator */
+#define CLOCK_CAL_EEPROM 0         /* EEPROM address of the clock_cal record */
+#define CLOCK_CAL_MAGIC 0x4B43     /* "CK" */
+
+extern int16_t clock_ppm;
+extern uint32_t half_clock;        /* Timer ticks at /1 per half second */
+
+void calibration_setup(void);
+bool set_clock_ppm(int16_t);
+int16_t trimmed_clock_ppm(uint32_t, uint32_t);
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "defines.h"
+#include "enums.h"
+#include "hal.h"
+#include "structures.h"
+#include "capture.h"
+#include "sweep.h"
+#include <Arduino.h>
+#include <util/atomic.h>
+
+extern wheels Wheels[];
+extern engine engines[];
+
+volatile bool capture_enabled = false;
+volatile uint16_t capture_overruns = 0;
+
+static capture_event capture_buffer[CAPTURE_BUFFER_SIZE];
+static volatile uint8_t capture_head = 0; /* Written by the ISR's */
+static volatile uint8_t capture_tail = 0; /* Written by capture_service() */
+static volatile bool capture_lost = false;
+static uint8_t capture_seq = 0;
+#if defined(__AVR_ATmega328P__)
+static uint8_t capture_last_pins = 0;
+#endif
+
+
+//! Starts/stops capturing ECU outputs
+void set_capture(bool enable) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    capture_head = 0;
+    capture_tail = 0;
+    capture_lost = false;
+    capture_enabled = enable;
+#if defined(__AVR_ATmega328P__)
+    DDRC &= ~((1 << PC2) | (1 << PC3));
+    capture_last_pins = PINC;
+    if (enable) {
+      PCMSK1 |= (1 << PCINT10) | (1 << PCINT11);
+      PCICR |= (1 << PCIE1);
+    } else {
+      PCMSK1 &= ~((1 << PCINT10) | (1 << PCINT11));
+    }
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+    DDRD &= ~B00001111;
+    EICRA = (1 << ISC30) | (1 << ISC20) | (1 << ISC10) | (1 << ISC00); /* Any change */
+    if (enable)
+      EIMSK |= B00001111;
+    else
+      EIMSK &= ~B00001111;
+#endif
+  }
+  capture_seq = 0;
+}
+
+
+/* Queues one edge, called from the capture ISR's with interrupts off */
+static inline void capture_push(uint8_t flags)
+{
+  uint8_t next = (capture_head + 1) & (CAPTURE_BUFFER_SIZE - 1);
+  capture_event *ev;
+
+  if (next == capture_tail) {
+    capture_lost = true;
+    capture_overruns++;
+    return;
+  }
+  ev = &capture_buffer[capture_head];
+  ev->tcnt = TCNT1;
+  ev->edge_counter = engines[ENGINE_1].edge_counter;
+  ev->ocr = OCR1A;
+  if (TIFR1 & (1 << OCF1A))
+    flags |= CAPTURE_PENDING;
+  if (capture_lost) {
+    flags |= CAPTURE_OVERRUN;
+    capture_lost = false;
+  }
+  ev->flags = flags;
+  capture_head = next;
+}
+
+
+//! Streams queued captures as binary records
+/*!
+ * Called from loop(), converts each snapshot to 1/16 degree of crank angle
+ * and only writes as many records as fit in the serial TX buffer so it
+ * never blocks
+ */
+void capture_service() {
+  engine *e = &engines[ENGINE_1];
+  uint8_t record[CAPTURE_RECORD_LEN];
+
+  while ((capture_tail != capture_head) && (Serial.availableForWrite() >= CAPTURE_RECORD_LEN)) {
+    capture_event *ev = &capture_buffer[capture_tail];
+    uint16_t max_edges = Wheels[e->selected_wheel].wheel_max_edges;
+    float edge_pos;
+    uint16_t angle;
+
+    /* edge_counter points at the NEXT edge, so TCNT1 counts from the one
+     * before it, unless the compare had already fired (one more emitted)
+     */
+    float fraction = (float)ev->tcnt / ((float)ev->ocr + 1.0);
+    uint8_t emitted = (ev->flags & CAPTURE_PENDING) ? 0 : 1;
+    if (e->normal)
+      edge_pos = (float)ev->edge_counter - emitted + fraction;
+    else
+      edge_pos = (float)ev->edge_counter + emitted - fraction;
+    if (edge_pos < 0)
+      edge_pos += max_edges;
+    if (edge_pos >= max_edges)
+      edge_pos -= max_edges;
+    angle = (uint16_t)(edge_pos * 16.0 * get_wheel_degrees(e->selected_wheel) / max_edges);
+
+    record[0] = CAPTURE_RECORD_SYNC;
+    record[1] = ev->flags & ~CAPTURE_PENDING;
+    record[2] = capture_seq++;
+    record[3] = angle & 0xFF;
+    record[4] = angle >> 8;
+    record[5] = record[1] ^ record[2] ^ record[3] ^ record[4];
+    Serial.write(record, CAPTURE_RECORD_LEN);
+    capture_tail = (capture_tail + 1) & (CAPTURE_BUFFER_SIZE - 1);
+  }
+}
+
+
+/* ECU output edges */
+#if defined(__AVR_ATmega328P__)
+ISR(PCINT1_vect)
+{
+  uint8_t pins = hal_pin_read(&PINC);
+  uint8_t changed = (pins ^ capture_last_pins) & ((1 << PC2) | (1 << PC3));
+
+  capture_last_pins = pins;
+  if (changed & (1 << PC2))
+    capture_push(0 | ((pins & (1 << PC2)) ? CAPTURE_LEVEL : 0));
+  if (changed & (1 << PC3))
+    capture_push(1 | ((pins & (1 << PC3)) ? CAPTURE_LEVEL : 0));
+}
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+ISR(INT0_vect)
+{
+  capture_push(0 | ((hal_pin_read(&PIND) & (1 << PD0)) ? CAPTURE_LEVEL : 0));
+}
+
+ISR(INT1_vect)
+{
+  capture_push(1 | ((hal_pin_read(&PIND) & (1 << PD1)) ? CAPTURE_LEVEL : 0));
+}
+
+ISR(INT2_vect)
+{
+  capture_push(2 | ((hal_pin_read(&PIND) & (1 << PD2)) ? CAPTURE_LEVEL : 0));
+}
+
+ISR(INT3_vect)
+{
+  capture_push(3 | ((hal_pin_read(&PIND) & (1 << PD3)) ? CAPTURE_LEVEL : 0));
+}
+#endif
@@ -0,0 +1,61 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <inttypes.h>
+
+/* ECU output capture
+ *
+ * Timestamps both edges of ECU outputs (ignition, injectors) against the
+ * simulated crank angle of engine 1:
+ *   328P: A2, A3 (pin change interrupt)
+ *   Mega: D21, D20, D19, D18 (INT0-INT3)
+ * The ISR only snapshots edge_counter, TCNT1 and OCR1A into a ring buffer,
+ * capture_service() converts them to an angle and streams 6 byte records:
+ *   0xA5, flags, sequence, angle low, angle high, xor of bytes 1-4
+ * flags: bits 0-2 channel, bit 6 records were lost before this one,
+ * bit 7 pin level after the edge. Angle is in 1/16 degree from wheel edge 0.
+ */
+#define CAPTURE_BUFFER_SIZE 16 /* Power of 2 */
+#define CAPTURE_RECORD_SYNC 0xA5
+#define CAPTURE_RECORD_LEN 6
+#define CAPTURE_CHANNEL_MASK 0x07
+#define CAPTURE_PENDING 0x08   /* Timer1 compare matched but its ISR hadn't run */
+#define CAPTURE_OVERRUN 0x40
+#define CAPTURE_LEVEL 0x80
+
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#define CAPTURE_CHANNELS 4
+#else
+#define CAPTURE_CHANNELS 2
+#endif
+
+extern volatile bool capture_enabled;
+extern volatile uint16_t capture_overruns;
+
+void set_capture(bool);
+void capture_service(void);
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "catalog.h"
+#include "defines.h"
+#include "frame.h"
+#include "structures.h"
+#include "wheel_defs.h"
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#if CONFIG_CATALOG
+#include "wheel_catalog.h"
+
+extern wheels Wheels[];
+
+//! Hash of the catalog records and names, from wheel_catalog.h
+uint32_t catalog_hash() {
+  return WHEEL_CATALOG_HASH;
+}
+
+
+//! Sends the 'H' frame, number of wheels, page size and catalog hash
+void send_catalog_hash() {
+  uint32_t hash = catalog_hash();
+
+  frame_start('H', 9);
+  frame_u16(MAX_WHEELS);
+  frame_byte(CATALOG_PAGE_SIZE);
+  frame_u16(WHEEL_CATALOG_NAMES_LEN);
+  frame_u16(hash & 0xFFFF);
+  frame_u16(hash >> 16);
+  frame_end();
+}
+
+
+//! Sends a 'P' frame with the records and names of up to count wheels
+/*!
+ * \param first wheel id (0 based) of the first record
+ * \param count records wanted, cut short at the end of the catalog
+ * \returns false if first is past the last wheel
+ */
+bool send_catalog_page(uint16_t first, uint8_t count) {
+  uint16_t length = 3;
+
+  if (first >= MAX_WHEELS)
+    return false;
+  if (count > MAX_WHEELS - first)
+    count = MAX_WHEELS - first;
+  for (uint8_t i = 0; i < count; i++)
+    length += sizeof(wheel_record) + strlen_P(Wheels[first + i].decoder_name) + 1;
+
+  frame_start('P', length);
+  frame_u16(first);
+  frame_byte(count);
+  for (uint8_t i = 0; i < count; i++) {
+    const uint8_t *record = (const uint8_t *)&wheel_catalog[first + i];
+    for (uint8_t j = 0; j < sizeof(wheel_record); j++)
+      frame_byte(pgm_read_byte(&record[j]));
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    const char *name = Wheels[first + i].decoder_name;
+    uint8_t c;
+    do {
+      c = pgm_read_byte(name++);
+      frame_byte(c);
+    } while (c);
+  }
+  frame_end();
+  return true;
+}
+#endif
@@ -0,0 +1,51 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __CATALOG_H__
+#define __CATALOG_H__
+
+#include <inttypes.h>
+
+/* Wheel catalog, lets the GUI list the wheels without one line per name
+ *
+ * Binary frames (frame.h):
+ * 'H' (cathash): wheels u16, page size u8, names length u16,
+ *     hash u32. The hash only changes with the wheel tables, a host that
+ *     has a copy with the same hash can skip the rest.
+ * 'P' (catpage n / catwheel id): first id u16, count u8,
+ *     count 8 byte records (wheel_record, structures.h), then the names of
+ *     those wheels, NUL terminated
+ * Records are generated into wheel_catalog.h by tools/gen_catalog.py,
+ * only built with every wheel in (CONFIG_CATALOG, config.h).
+ */
+#define CATALOG_PAGE_SIZE 8
+#define CATALOG_CRANK 0x01     /* Crank track has edges */
+#define CATALOG_CAM 0x02       /* Cam track has edges */
+#define CATALOG_AUX 0x04       /* Aux track (Mega wide output) */
+#define CATALOG_COMBINED 0x08  /* Crank and cam are one array */
+
+uint32_t catalog_hash(void);
+void send_catalog_hash(void);
+bool send_catalog_page(uint16_t, uint8_t);
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "auxiliary.h"
+#include "bitstream.h"
+#include "commit.h"
+#include "defines.h"
+#include "enums.h"
+#include "routing.h"
+#include "serialmenu.h"
+#include "structures.h"
+#include "sweep.h"
+#include "tach.h"
+#include "twin_engine.h"
+#include "vr_output.h"
+#include "wide_output.h"
+#include <Arduino.h>
+#include <stdlib.h>
+#include <util/atomic.h>
+#include <util/delay.h>
+
+extern wheels Wheels[];
+extern engine engines[];
+
+uint16_t commit_angle = 0;   /* Degrees, staged changes go live here */
+bool commit_hold = false;    /* Batch changes until commit_arm() */
+
+
+/* False when the engine has no staged tables for its edge ISR to swap in
+ * (bitstream output) or no edge ISR running at all (engine 2 off)
+ */
+static bool commit_at_angle(engine *e)
+{
+  if (e == &engines[ENGINE_1])
+  {
+#ifdef BITSTREAM_SUPPORTED
+    if (bitstream_output)
+      return false;
+#endif
+    return true;
+  }
+  return twin_engine;
+}
+
+
+/* RPM a sweep or tach follow is at, 0 at a fixed RPM or when unknown */
+static uint16_t ramp_rpm(engine *e)
+{
+  uint16_t ocr;
+  uint8_t prescaler_bits;
+
+  if (e->mode == TACH_FOLLOW_RPM)
+    return tach_rpm;
+  if (e->mode != LINEAR_SWEPT_RPM)
+    return 0;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    ocr = e->new_OCR1A;
+    prescaler_bits = e->prescaler_bits;
+  }
+  return ocr ? get_rpm_from_tcnt(e, &ocr, &prescaler_bits) : 0;
+}
+
+
+//! Opens (or takes back) an engine's staged batch for changes
+/*!
+ * An armed commit is disarmed first so the ISR can't apply half a change,
+ * if it already went live the batch starts again from the live settings
+ * \param e engine to change
+ * \returns the staged settings to change, then call stage_end()
+ */
+engine_config *stage_begin(engine *e)
+{
+  engine_config *c = &e->staged;
+
+  commit_disarm(e);
+  if (!e->staging)
+  {
+    c->selected_wheel = e->selected_wheel;
+    c->crank_invert_mask = e->crank_invert_mask;
+    c->cam_invert_mask = e->cam_invert_mask;
+    c->camSignalBitShift = e->camSignalBitShift;
+    c->normal = e->normal;
+    c->rpm = false;
+    e->staging = true;
+  }
+  return c;
+}
+
+
+//! Closes a change to the staged batch, arming it unless commit_hold is set
+void stage_end(engine *e)
+{
+  if (!commit_hold)
+    commit_arm(e);
+}
+
+
+//! Arms an engine's staged batch to go live at commit_angle
+/*!
+ * The commit edge is the current wheel's edge nearest commit_angle, the new
+ * wheel starts from its own edge nearest that same angle. A new wheel under
+ * a sweep or tach follow gets the ramp's current RPM staged as its period. Engine 1 gets its
+ * routing and wide output tables built for the staged settings. Applied
+ * right away (and followed up) if the engine can't commit at an angle.
+ * \param e engine to arm
+ * \returns false if there was nothing staged
+ */
+bool commit_arm(engine *e)
+{
+  engine_config *c = &e->staged;
+  uint16_t edges = Wheels[e->selected_wheel].wheel_max_edges;
+  uint16_t degrees = get_wheel_degrees(e->selected_wheel);
+  uint16_t new_edges = Wheels[c->selected_wheel].wheel_max_edges;
+  uint16_t new_degrees = get_wheel_degrees(c->selected_wheel);
+  uint16_t edge;
+  uint16_t rpm;
+
+  if (!e->staging)
+    return false;
+  edge = (uint16_t)((((uint32_t)(commit_angle % degrees) * edges) + (degrees / 2)) / degrees % edges);
+  c->new_wheel = (c->selected_wheel != e->selected_wheel);
+  c->ramp = false;
+  if (c->new_wheel)
+  {
+    /* Edge nearest the same angle, wrapped if the new wheel covers less */
+    uint32_t span = (uint32_t)edges * new_degrees;
+    c->edge_counter = (uint16_t)((((uint32_t)edge * degrees * new_edges) + (span / 2)) / span % new_edges);
+    /* A sweep or tach follow carries on at its RPM, in the new wheel's ticks */
+    rpm = ramp_rpm(e);
+    if (!c->rpm && rpm)
+    {
+      get_fixed_period(c->selected_wheel, rpm, c);
+      c->ramp = true;
+    }
+  }
+  else
+    c->edge_counter = edge;
+  if (e == &engines[ENGINE_1])
+  {
+    wide_stage(c);
+    route_stage(c);
+  }
+  if (!commit_at_angle(e))
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      apply_commit(e);
+      if (e == &engines[ENGINE_1])
+      {
+        route_swap();
+        wide_swap();
+      }
+    }
+    commit_service();
+    return true;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    e->commit_edge = edge;
+    e->commit_armed = true;
+  }
+  return true;
+}
+
+
+//! Takes an armed commit back, the batch stays staged
+/*!
+ * \param e engine to disarm
+ * \returns true if a commit was armed
+ */
+bool commit_disarm(engine *e)
+{
+  bool armed;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    armed = e->commit_armed;
+    e->commit_armed = false;
+  }
+  return armed;
+}
+
+
+//! Drops an engine's staged batch, armed or not
+void commit_discard(engine *e)
+{
+  commit_disarm(e);
+  e->staging = false;
+}
+
+
+//! Follows up commits that went live, from loop()
+/*!
+ * A sweep is rebuilt for a new wheel (its stages are in the old wheel's
+ * ticks, it held at the staged period meanwhile), sweep tables are dropped once a fixed RPM took over, and the
+ * bitstream, aux and VR tables are refreshed
+ */
+void commit_service()
+{
+  for (uint8_t i = 0; i < NUM_ENGINES; i++)
+  {
+    engine *e = &engines[i];
+    bool applied;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      applied = e->commit_applied;
+      e->commit_applied = false;
+    }
+    if (!applied)
+      continue;
+#if CONFIG_SWEEP
+    /* A sweep that was held at the new wheel's period (apply_commit()) is
+     * the only way to fixed RPM with sweep tables and a ramp staged */
+    if (e->staged.new_wheel && ((e->mode == LINEAR_SWEPT_RPM) ||
+        ((e->mode == FIXED_RPM) && e->staged.ramp && e->SweepSteps)))
+      compute_sweep_stages(e, &e->sweep_low_rpm, &e->sweep_high_rpm);
+#endif
+    if ((e->mode == FIXED_RPM) && e->SweepSteps)
+    {
+      while (e->sweep_lock)
+        _delay_us(1);
+      e->sweep_lock = true;
+      free(e->SweepSteps);
+      e->SweepSteps = NULL;
+      e->sweep_lock = false;
+    }
+    if (i == ENGINE_1)
+    {
+      refresh_bitstream();
+      refresh_aux();
+      refresh_vr();
+    }
+  }
+}
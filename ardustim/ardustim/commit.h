@@ -0,0 +1,93 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __COMMIT_H__
+#define __COMMIT_H__
+
+#include <inttypes.h>
+#include "enums.h"
+#include "structures.h"
+
+/* Crank angle aligned configuration commits
+ *
+ * Wheel, invert, cam shift, direction and fixed RPM changes from the console
+ * don't touch the running engine. They are staged in engine.staged and go
+ * live together in the edge ISR when the wheel reaches commit_angle (edge
+ * 0 by default), with the routing and wide output tables swapped in at
+ * the same edge (routing.h, wide_output.h). A new wheel carries on from
+ * the edge nearest the same crank angle (modulo its own 360/720 degrees)
+ * instead of restarting at edge 0, so the ECU sees at most one deliberate
+ * discontinuity.
+ *
+ * With commit_hold set, changes pile up in the staged batch until
+ * commit_arm() arms them. Bitstream output and a stopped engine 2 have
+ * no staged tables to swap, changes apply right away there as before.
+ * Sweeps and tach follow are ramps and apply right away too. A new wheel
+ * under one of them brings the ramp's RPM (at arming time) along as its
+ * own period, so it doesn't run at the old wheel's scale until loop()
+ * catches up.
+ */
+extern uint16_t commit_angle;
+extern bool commit_hold;
+
+engine_config *stage_begin(engine *);
+void stage_end(engine *);
+bool commit_arm(engine *);
+bool commit_disarm(engine *);
+void commit_discard(engine *);
+void commit_service(void);
+
+//! Puts a staged configuration live, called by the edge ISR at commit_edge
+/*!
+ * The caller swaps the routing tables in for engine 1
+ * \param e engine whose commit is due
+ */
+static inline void apply_commit(engine *e)
+{
+  engine_config *c = &e->staged;
+
+  e->selected_wheel = c->selected_wheel;
+  e->edge_counter = c->edge_counter;
+  e->crank_invert_mask = c->crank_invert_mask;
+  e->cam_invert_mask = c->cam_invert_mask;
+  e->camSignalBitShift = c->camSignalBitShift;
+  e->normal = c->normal;
+  if (c->rpm || c->ramp)
+  {
+    /* A sweep holds at the new wheel's period until commit_service()
+     * rebuilds it, its stages are in the old wheel's ticks */
+    if (c->rpm || (e->mode == LINEAR_SWEPT_RPM))
+      e->mode = FIXED_RPM;
+    e->new_OCR1A = c->new_OCR1A;
+    e->ocr_fraction = c->ocr_fraction;
+    e->prescaler_bits = c->prescaler_bits;
+    e->ext_chunks = c->ext_chunks;
+    e->ext_final = c->ext_final;
+    e->reset_prescaler = true;
+  }
+  e->commit_armed = false;
+  e->staging = false;
+  e->commit_applied = true;
+}
+
+#endif
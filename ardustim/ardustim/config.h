@@ -0,0 +1,95 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ * 
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+/* Build profile, what goes into the firmware image
+ *
+ * Anything switched off is compiled out along with its interrupt handler,
+ * its commands and the checks for it in the ISR's that are left. Pick a
+ * profile here or with build_flags = -DPROFILE=PROFILE_MINIMAL in
+ * platformio.ini, single switches can be overridden the same way:
+ *   PROFILE_FULL     everything (default)
+ *   PROFILE_MINIMAL  fixed RPM from the console, no sweeper, no pot, no
+ *                    aux or VR outputs and no GUI protocol
+ * Code only reachable from a command that is left out goes at link time
+ * (Arduino and PlatformIO link with --gc-sections).
+ */
+#define PROFILE_FULL 0
+#define PROFILE_MINIMAL 1
+
+#ifndef PROFILE
+#define PROFILE PROFILE_FULL
+#endif
+
+/* RPM sweep, the Timer2 sweeper and edge sweep (pattern.h) */
+#ifndef CONFIG_SWEEP
+#define CONFIG_SWEEP (PROFILE != PROFILE_MINIMAL)
+#endif
+
+/* Pot on ADC0, free running conversions and the ADC ISR */
+#ifndef CONFIG_ADC
+#define CONFIG_ADC (PROFILE != PROFILE_MINIMAL)
+#endif
+
+/* Auxiliary speed, PWM sensor and knock outputs (auxiliary.h, Mega only) */
+#ifndef CONFIG_AUX
+#define CONFIG_AUX (PROFILE != PROFILE_MINIMAL)
+#endif
+
+/* Sine-like VR crank output on Timer3 (vr_output.h, Mega only) */
+#ifndef CONFIG_VR
+#define CONFIG_VR (PROFILE != PROFILE_MINIMAL)
+#endif
+
+/* User interface, the text console (console.h) and/or the GUI's framed
+ * requests (host.h)
+ */
+#ifndef CONFIG_CONSOLE
+#define CONFIG_CONSOLE 1
+#endif
+#ifndef CONFIG_HOST
+#define CONFIG_HOST (PROFILE != PROFILE_MINIMAL)
+#endif
+
+/* Wheels built in (wheel_defs.h), DEFAULT_WHEEL (user_defaults.h) has to
+ * be one of them. Wheel numbers close up over the ones left out, and the
+ * wheel catalog (catalog.h) is only there with all of them.
+ */
+#ifndef WHEEL_EIGHT_CAM_ONE_CRANK
+#define WHEEL_EIGHT_CAM_ONE_CRANK 1
+#endif
+#ifndef WHEEL_INVERTED_EIGHT_CAM_ONE_CRANK
+#define WHEEL_INVERTED_EIGHT_CAM_ONE_CRANK 1
+#endif
+#ifndef WHEEL_SIXTY_MINUS_TWO_WITH_4X_CRANK
+#define WHEEL_SIXTY_MINUS_TWO_WITH_4X_CRANK 1
+#endif
+#ifndef WHEEL_SIXTY_MINUS_THREE_WITH_4X_CRANK
+#define WHEEL_SIXTY_MINUS_THREE_WITH_4X_CRANK 1
+#endif
+
+#define CONFIG_CATALOG (WHEEL_EIGHT_CAM_ONE_CRANK && WHEEL_INVERTED_EIGHT_CAM_ONE_CRANK && \
+                        WHEEL_SIXTY_MINUS_TWO_WITH_4X_CRANK && WHEEL_SIXTY_MINUS_THREE_WITH_4X_CRANK)
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+
+#include "console.h"
+#include "structures.h"
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const console_command *commands;
+static uint8_t command_count;
+static char line[CONSOLE_LINE + 1];
+static uint8_t line_len = 0;
+static bool overflow = false;
+static char *args = line;
+
+
+//! Sets the command table the console runs lines against
+/*!
+ * \param table PROGMEM array of commands
+ * \param count entries in table
+ */
+void console_setup(const console_command *table, uint8_t count) {
+  commands = table;
+  command_count = count;
+}
+
+
+//! Checks no line is half typed, binary frames are only looked for then
+bool console_idle() {
+  return !line_len && !overflow;
+}
+
+
+/* Splits the command word off the line and runs its handler */
+static void run_line()
+{
+  char *name = line;
+  console_command c;
+  uint8_t i;
+
+  while (*name == ' ')
+    name++;
+  if (!*name)
+    return;
+  for (args = name; *args && (*args != ' '); args++)
+    *args = tolower(*args);
+  if (*args)
+    *args++ = '\0';
+  while (*args == ' ')
+    args++;
+  for (i = 0; i < command_count; i++)
+  {
+    memcpy_P(&c, &commands[i], sizeof(console_command));
+    if (!strcmp_P(name, c.name))
+      break;
+  }
+  if (i < command_count)
+    c.handler();
+  else
+    console_error(F("Unknown command, enter help for the list"));
+  Serial.print(F("> "));
+}
+
+
+//! Collects whatever serial input is waiting, running complete lines
+void console_service() {
+  while (Serial.available())
+  {
+    char c = Serial.read();
+
+    if ((c == '\r') || (c == '\n'))
+    {
+      if (overflow)
+      {
+        console_error(F("Line too long"));
+        Serial.print(F("> "));
+      }
+      else if (line_len)
+      {
+        line[line_len] = '\0';
+        run_line();
+      }
+      line_len = 0;
+      overflow = false;
+    }
+    else if ((c == '\b') || (c == 0x7F))
+    {
+      if (line_len)
+        line_len--;
+    }
+    else if (line_len < CONSOLE_LINE)
+      line[line_len++] = c;
+    else
+      overflow = true;
+  }
+}
+
+
+//! Lists every command with its help text
+void console_help() {
+  console_command c;
+
+  for (uint8_t i = 0; i < command_count; i++)
+  {
+    memcpy_P(&c, &commands[i], sizeof(console_command));
+    Serial.print((const __FlashStringHelper *)c.name);
+    for (uint8_t n = strlen_P(c.name); n < 12; n++)
+      Serial.print(' ');
+    Serial.println((const __FlashStringHelper *)c.help);
+  }
+}
+
+
+//! Arguments of the command being run, "" if none
+char *console_args() {
+  return args;
+}
+
+
+//! First argument of the command being run as a number, 0 if none
+uint32_t console_ulong() {
+  return strtoul(args, NULL, 10);
+}
+
+
+//! Reports a command that couldn't be carried out
+void console_error(const __FlashStringHelper *message) {
+  Serial.print(F("Error: "));
+  Serial.println(message);
+}
@@ -0,0 +1,50 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+
+#ifndef __CONSOLE_H__
+#define __CONSOLE_H__
+
+#include <inttypes.h>
+#include <Arduino.h>
+#include "structures.h"
+
+/* Human readable command line on the serial port, one command per line:
+ *   command [arguments]
+ * The commands come from a PROGMEM table (serialmenu.cpp), "help" lists
+ * them. Lines are collected from loop() without ever waiting for input, so
+ * the GUI's binary frames (host.h) and the background work carry on in
+ * between keystrokes. Commands are matched whatever the case, backspace
+ * works, a line ends at CR or LF.
+ */
+#define CONSOLE_LINE 40 /* Longest line, arguments included */
+
+void console_setup(const console_command *, uint8_t);
+bool console_idle(void);
+void console_service(void);
+void console_help(void);
+char *console_args(void);
+uint32_t console_ulong(void);
+void console_error(const __FlashStringHelper *);
+
+#endif
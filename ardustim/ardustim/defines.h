@@ -22,13 +22,25 @@
 
 #ifndef __DEFINES_H__
 #define __DEFINES_H__
+
+#include "config.h"
  
 /* defines */
 #define SWEEP_ISR_RATE 1000
+#define SWEEP_TICKS_PER_MS 16000.0 /* Timer ticks at /1 per sweeper tick */
+#define EDGE_SWEEP_UPDATES 16 /* Edge sweep RPM updates per wheel revolution */
 #define TMP_RPM_SHIFT 4 /* x16, 0-16384 RPM via pot */
 #define TMP_RPM_CAP 16384 /* MAX RPM via pot control */
 #define FACTOR_THRESHOLD 1000000
-//#define SUI_NO_INCLUDE_EXTRA_SAFETYCHECKS
+#define SERIAL_BAUD 115200 /* Console, GUI protocol and capture */
 #define LOG_2 0.30102999566
+#define MAX_WHEEL_EDGES 240 /* Longest edge array in wheel_defs.h */
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#define NUM_ENGINES 2 /* Engine 2 on Timer3, see twin_engine.h */
+#else
+#define NUM_ENGINES 1
+#endif
+#define EXT_CHUNK_TICKS 32768UL /* Idle compare length in extended timer mode */
+#define WIDE_OUTPUT_PORTS 3 /* PORTA (crank), PORTC (cam), PORTL (aux track) */
 
 #endif
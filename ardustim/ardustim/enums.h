@@ -38,9 +38,21 @@ enum {
   ASCENDING
 };
 
+enum {
+  ENGINE_1,
+  ENGINE_2
+};
+
+enum {
+  SYNC_OFF,
+  SYNC_MASTER,
+  SYNC_SLAVE
+};
+
 enum {
   FIXED_RPM,
   LINEAR_SWEPT_RPM,
+  TACH_FOLLOW_RPM,
 };
 
 #endif
@@ -0,0 +1,56 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "frame.h"
+#include <Arduino.h>
+
+static uint8_t frame_xor;
+
+
+//! Starts a frame of type with length bytes of payload to follow
+void frame_start(uint8_t type, uint16_t length) {
+  Serial.write(FRAME_SYNC);
+  frame_xor = 0;
+  frame_byte(type);
+  frame_u16(length);
+}
+
+
+//! Sends one payload byte
+void frame_byte(uint8_t b) {
+  Serial.write(b);
+  frame_xor ^= b;
+}
+
+
+//! Sends a 16 bit payload value, low byte first
+void frame_u16(uint16_t v) {
+  frame_byte(v & 0xFF);
+  frame_byte(v >> 8);
+}
+
+
+//! Closes the frame with its checksum
+void frame_end() {
+  Serial.write(frame_xor);
+}
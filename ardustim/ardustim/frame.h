@@ -0,0 +1,41 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __FRAME_H__
+#define __FRAME_H__
+
+#include <inttypes.h>
+
+/* Binary frames to the host (catalog.h, stream.h):
+ *   0x5A, type, length low, length high, payload, xor
+ * the xor covers type, length and payload, multi byte values are little
+ * endian
+ */
+#define FRAME_SYNC 0x5A
+
+void frame_start(uint8_t, uint16_t);
+void frame_byte(uint8_t);
+void frame_u16(uint16_t);
+void frame_end(void);
+
+#endif
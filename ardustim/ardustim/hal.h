@@ -0,0 +1,57 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __HAL_H__
+#define __HAL_H__
+
+/* Hardware abstraction for the pattern engine
+ *
+ * The engine (pattern.h, sweep.cpp) works in 16 MHz timer ticks with the
+ * AVR prescaler enumeration, every backend maps those onto its hardware:
+ *   hal_timer                       one engine's pattern timer
+ *   hal_timer_prescale(t, bits)     clock select, PRESCALE_* bits
+ *   hal_timer_compare(t, ocr)       compare value, period is ocr + 1 ticks
+ *   hal_port_write(port, value)     output port write, also _set/_clear bits
+ *   hal_pin_read(pin)               input pins
+ *   hal_adc_read()                  last pot (RPM) conversion
+ *   hal_setup_timers()              pattern timer(s) and the 1 kHz sweeper
+ *   hal_sweeper(enable)             starts/stops the 1 kHz sweeper
+ *   hal_setup_ports()               output pin directions
+ *   hal_setup_adc()/hal_start_adc() free running pot (RPM) conversions
+ *
+ * The edge, capture and ADC ISRs and the master sync output only go
+ * through these. Pin directions and interrupt setup in the drivers, and
+ * the wide output's fixed skew writes (wide_output.h), still use the AVR
+ * registers.
+ *
+ * Backends:
+ *   hal_avr.h        ATmega328P/1280/2560, Timer1/3 CTC ISR per edge
+ *   tools/host/      host simulation, registers are plain variables
+ */
+#if defined(__AVR__)
+#include "hal_avr.h"
+#else
+#include "hal_host.h"
+#endif
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "defines.h"
+#include "hal.h"
+#include <Arduino.h>
+
+#if defined(__AVR__)
+
+//! Sets up the pattern timer(s) and the sweeper timer
+/*!
+ * Timer1 (engine 1) and Timer3 (engine 2, Mega) in CTC mode at /1, Timer2
+ * as the 1 kHz sweeper (CONFIG_SWEEP), called with interrupts off
+ */
+void hal_setup_timers() {
+  /* Configuring TIMER1 (pattern generator) */
+  // Set timer1 to generate pulses
+  TCCR1A = 0;
+  TCCR1B = 0;
+  TCNT1 = 0;
+
+  // Set compare register to sane default
+  OCR1A = 1000;  /* 8000 RPM (60-2) */
+
+  // Turn on CTC mode
+  TCCR1B |= (1 << WGM12); // Normal mode (not PWM)
+  // Set prescaler to 1
+  TCCR1B |= (1 << CS10); /* Prescaler of 1 */
+  // Enable output compare interrupt for timer channel 1 (16 bit)
+  TIMSK1 |= (1 << OCIE1A);
+
+#if NUM_ENGINES > 1
+  /* Configuring TIMER3 (engine 2 pattern generator), identical to TIMER1
+   * but the interrupt is only enabled in twin engine mode
+   */
+  TCCR3A = 0;
+  TCCR3B = 0;
+  TCNT3 = 0;
+  OCR3A = 1000;
+  TCCR3B |= (1 << WGM32); // CTC mode
+  TCCR3B |= (1 << CS30); /* Prescaler of 1 */
+#endif
+
+#if CONFIG_SWEEP
+  // Set timer2 to run sweeper routine
+  TCCR2A = 0;
+  TCCR2B = 0;
+  TCNT2 = 0;
+
+  // Set compare register to sane default
+  OCR2A = 249;  /* With prescale of x64 gives 1ms tick */
+
+  // Turn on CTC mode
+  TCCR2A |= (1 << WGM21); // Normal mode (not PWM)
+  // Set prescaler to x64
+  TCCR2B |= (1 << CS22); /* Prescaler of 64 */
+  // Enable output compare interrupt for timer channel 2
+  TIMSK2 |= (1 << OCIE2A);
+#endif
+}
+
+
+//! Starts or stops the Timer2 sweeper
+/*!
+ * Stopped when every engine sweeps from its own edge ISR (edge sweep,
+ * pattern.h), which leaves Timer2 and its interrupt free
+ * \param enable true to run the 1 kHz sweeper
+ */
+void hal_sweeper(bool enable) {
+  if (enable) {
+    TCNT2 = 0;
+    TCCR2B |= (1 << CS22); /* Prescaler of 64 */
+    TIMSK2 |= (1 << OCIE2A);
+  } else {
+    TIMSK2 &= ~(1 << OCIE2A);
+    TCCR2B &= ~((1 << CS22) | (1 << CS21) | (1 << CS20));
+  }
+}
+
+
+//! Sets up the ADC for free running, interrupt driven conversions
+void hal_setup_adc() {
+  /* Configure ADC as per http://www.glennsweeney.com/tutorials/interrupt-driven-analog-conversion-with-an-atmega328p */
+  // clear ADLAR in ADMUX (0x7C) to right-adjust the result
+  // ADCL will contain lower 8 bits, ADCH upper 2 (in last two bits)
+  ADMUX &= B11011111;
+  
+  // Set REFS1..0 in ADMUX (0x7C) to change reference voltage to the
+  // proper source (01)
+  ADMUX |= B01000000;
+  
+  // Clear MUX3..0 in ADMUX (0x7C) in preparation for setting the analog
+  // input
+  ADMUX &= B11110000;
+  
+  // Set MUX3..0 in ADMUX (0x7C) to read from AD8 (Internal temp)
+  // Do not set above 15! You will overrun other parts of ADMUX. A full
+  // list of possible inputs is available in Table 24-4 of the ATMega328
+  // datasheet
+  // ADMUX |= 8;
+  // ADMUX |= B00001000; // Binary equivalent
+  
+  // Set ADEN in ADCSRA (0x7A) to enable the ADC.
+  // Note, this instruction takes 12 ADC clocks to execute
+  ADCSRA |= B10000000;
+  
+  // Set ADATE in ADCSRA (0x7A) to enable auto-triggering.
+  ADCSRA |= B00100000;
+  
+  // Clear ADTS2..0 in ADCSRB (0x7B) to set trigger mode to free running.
+  // This means that as soon as an ADC has finished, the next will be
+  // immediately started.
+  ADCSRB &= B11111000;
+  
+  // Set the Prescaler to 128 (16000KHz/128 = 125KHz)
+  // Above 200KHz 10-bit results are not reliable.
+  ADCSRA |= B00000111;
+  
+  // Set ADIE in ADCSRA (0x7A) to enable the ADC interrupt.
+  // Without this, the internal interrupt will not trigger.
+  ADCSRA |= B00001000;
+}
+
+
+//! Starts the first ADC conversion, called once interrupts are on
+void hal_start_adc() {
+  // Set ADSC in ADCSRA (0x7A) to start the ADC conversion
+  ADCSRA |= B01000000;
+}
+
+
+//! Sets the output pin directions of the standard layout
+void hal_setup_ports() {
+//  pinMode(7, OUTPUT); /* Debug pin for Saleae to track sweep ISR execution speed */
+#if defined(__AVR_ATmega328P__)
+  DDRB = B00111111;
+  DDRD = B11110000; /* PD2 (sync in), PD3 are inputs */
+  DDRC = B00110000;
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+  // pinMode(53, OUTPUT);
+  // pinMode(52, OUTPUT);
+  DDRB = B00011111;
+  DDRC = B11110000;
+  DDRA = B00000001;
+  // pinMode(22, OUTPUT);
+#endif
+}
+
+#endif
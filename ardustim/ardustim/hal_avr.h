@@ -0,0 +1,88 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __HAL_AVR_H__
+#define __HAL_AVR_H__
+
+#include <inttypes.h>
+#include <avr/io.h>
+
+/* Timer1 (engine 1) or Timer3 (engine 2, Mega), declared static const in
+ * the ISR so the register addresses fold into plain out/sts instructions
+ */
+typedef struct _hal_timer hal_timer;
+struct _hal_timer {
+  volatile uint8_t *tccrb;
+  volatile uint16_t *ocr;
+};
+#define HAL_TIMER(n) { &TCCR##n##B, &OCR##n##A }
+
+/* CS_0, CS_1 and CS_2 are the same bits on every timer */
+static inline void hal_timer_prescale(const hal_timer *t, uint8_t prescaler_bits)
+{
+  *t->tccrb = (*t->tccrb & ~((1 << CS10) | (1 << CS11) | (1 << CS12))) | prescaler_bits;
+}
+
+static inline void hal_timer_compare(const hal_timer *t, uint16_t ocr)
+{
+  *t->ocr = ocr;
+}
+
+/* Port registers are passed as &PORTx/&PINx, constant addresses, so these
+ * still come out as single in/out/sts (or sbi/cbi) instructions
+ */
+static inline void hal_port_write(volatile uint8_t *port, uint8_t value)
+{
+  *port = value;
+}
+
+static inline void hal_port_set(volatile uint8_t *port, uint8_t bits)
+{
+  *port |= bits;
+}
+
+static inline void hal_port_clear(volatile uint8_t *port, uint8_t bits)
+{
+  *port &= ~bits;
+}
+
+static inline uint8_t hal_pin_read(volatile uint8_t *pin)
+{
+  return *pin;
+}
+
+/* Last conversion, ADCL has to be read before ADCH */
+static inline uint16_t hal_adc_read(void)
+{
+  uint8_t low = ADCL;
+
+  return low | (ADCH << 8);
+}
+
+void hal_setup_timers(void);
+void hal_sweeper(bool);
+void hal_setup_ports(void);
+void hal_setup_adc(void);
+void hal_start_adc(void);
+
+#endif
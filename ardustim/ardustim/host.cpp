@@ -0,0 +1,318 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "calibration.h"
+#include "commit.h"
+#include "defines.h"
+#include "enums.h"
+#include "frame.h"
+#include "host.h"
+#include "serialmenu.h"
+#include "structures.h"
+#include "sweep.h"
+#include "tach.h"
+#include "wheel_defs.h"
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+extern wheels Wheels[];
+extern engine engines[];
+
+/* Request parser states */
+enum {
+  WAIT_SYNC,
+  WAIT_TYPE,
+  WAIT_LEN_LOW,
+  WAIT_LEN_HIGH,
+  WAIT_PAYLOAD,
+  WAIT_XOR,
+};
+
+static uint8_t state = WAIT_SYNC;
+static uint8_t type;
+static uint16_t length;
+static uint8_t pos;
+static uint8_t sum;
+static uint8_t payload[HOST_MAX_PAYLOAD];
+
+
+static uint16_t get_u16(uint8_t offset)
+{
+  return payload[offset] | (payload[offset + 1] << 8);
+}
+
+
+static void send_error(uint8_t code)
+{
+  frame_start('!', 3);
+  frame_byte(payload[0]);
+  frame_byte(type);
+  frame_byte(code);
+  frame_end();
+}
+
+
+/* RPM engine 1 is putting out, read back from the swept compare value */
+static uint16_t output_rpm(engine *e)
+{
+  uint16_t ocr;
+  uint8_t prescaler_bits;
+
+  if (e->mode == TACH_FOLLOW_RPM)
+    return tach_rpm;
+  if (e->mode != LINEAR_SWEPT_RPM)
+    return e->wanted_rpm;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    ocr = e->new_OCR1A;
+    prescaler_bits = e->prescaler_bits;
+  }
+  if (!ocr)
+    return 0;
+  return get_rpm_from_tcnt(e, &ocr, &prescaler_bits);
+}
+
+
+static void send_edges(uint8_t wheel, uint16_t first, uint8_t count)
+{
+  const unsigned char *crank = Wheels[wheel].edge_crank_ptr;
+  const unsigned char *cam = Wheels[wheel].edge_states_ptr;
+
+  frame_start('E', 8 + count);
+  frame_byte(payload[0]);
+  frame_u16(get_wheel_degrees(wheel));
+  frame_u16(Wheels[wheel].wheel_max_edges);
+  frame_u16(first);
+  frame_byte(count);
+  for (uint16_t i = first; i < first + count; i++)
+    frame_byte((pgm_read_byte(&crank[i]) & 1) | ((pgm_read_byte(&cam[i]) & 1) << 1));
+  frame_end();
+}
+
+
+/* Carries out a complete request, argument checks as per the console.
+ * Returns 0 once replied to, HOST_ERR_* otherwise
+ */
+static uint8_t handle_request()
+{
+  engine *e = &engines[ENGINE_1];
+  uint8_t id = payload[0];
+  uint8_t args = length - 1;
+
+  switch (type)
+  {
+    case 'I':
+      frame_start('I', 13);
+      frame_byte(id);
+      frame_u16(MAX_WHEELS);
+      frame_byte(e->selected_wheel);
+      frame_byte(e->mode);
+      frame_u16(e->wanted_rpm);
+      frame_u16(e->sweep_low_rpm);
+      frame_u16(e->sweep_high_rpm);
+      frame_u16(e->sweep_rate);
+      frame_end();
+      break;
+    case 'L':
+      if (args != 1)
+        return HOST_ERR_LENGTH;
+      if (payload[1] >= MAX_WHEELS)
+        return HOST_ERR_RANGE;
+      {
+        const char *name = Wheels[payload[1]].decoder_name;
+        uint8_t c;
+
+        frame_start('L', 3 + strlen_P(name));
+        frame_byte(id);
+        frame_byte(payload[1]);
+        do {
+          c = pgm_read_byte(name++);
+          frame_byte(c);
+        } while (c);
+        frame_end();
+      }
+      break;
+    case 'E':
+      if (args != 4)
+        return HOST_ERR_LENGTH;
+      if ((payload[1] >= MAX_WHEELS) || (payload[4] > HOST_EDGE_PAGE))
+        return HOST_ERR_RANGE;
+      {
+        uint16_t edges = Wheels[payload[1]].wheel_max_edges;
+        uint16_t first = get_u16(2);
+        uint8_t count = payload[4];
+
+        if (first > edges)
+          return HOST_ERR_RANGE;
+        if (count > edges - first)
+          count = edges - first;
+        send_edges(payload[1], first, count);
+      }
+      break;
+    case 'S':
+      if (args != 1)
+        return HOST_ERR_LENGTH;
+      if (payload[1] >= MAX_WHEELS)
+        return HOST_ERR_RANGE;
+      {
+        engine_config *c = stage_begin(e);
+
+        c->selected_wheel = payload[1];
+        if (e->mode == FIXED_RPM) {
+          get_fixed_period(c->selected_wheel, e->wanted_rpm, c);
+          c->rpm = true;
+        }
+        stage_end(e);
+      }
+      frame_start('S', 2);
+      frame_byte(id);
+      frame_byte(payload[1]);
+      frame_end();
+      break;
+    case 'F':
+      if (args != 2)
+        return HOST_ERR_LENGTH;
+      if (get_u16(1) < 10)
+        return HOST_ERR_RANGE;
+      {
+        engine_config *c = stage_begin(e);
+
+        get_fixed_period(c->selected_wheel, get_u16(1), c);
+        c->rpm = true;
+        e->wanted_rpm = get_u16(1);
+        stage_end(e);
+      }
+      frame_start('F', 3);
+      frame_byte(id);
+      frame_u16(e->wanted_rpm);
+      frame_end();
+      break;
+#if CONFIG_SWEEP
+    case 'W':
+      if (args != 6)
+        return HOST_ERR_LENGTH;
+      {
+        uint16_t low = get_u16(1);
+        uint16_t high = get_u16(3);
+        uint16_t rate = get_u16(5);
+
+        if ((low < 10) || (high >= 51200) || (low >= high) || (rate < 1) || (rate >= 51200))
+          return HOST_ERR_RANGE;
+        e->sweep_rate = rate;
+        compute_sweep_stages(e, &low, &high);
+      }
+      frame_start('W', 7);
+      frame_byte(id);
+      frame_u16(e->sweep_low_rpm);
+      frame_u16(e->sweep_high_rpm);
+      frame_u16(e->sweep_rate);
+      frame_end();
+      break;
+#endif
+    case 'R':
+      frame_start('R', 3);
+      frame_byte(id);
+      frame_u16(output_rpm(e));
+      frame_end();
+      break;
+    case 'K':
+      if (args == 2) {
+        if (!set_clock_ppm((int16_t)get_u16(1)))
+          return HOST_ERR_RANGE;
+      }
+      else if (args)
+        return HOST_ERR_LENGTH;
+      frame_start('K', 3);
+      frame_byte(id);
+      frame_u16(clock_ppm);
+      frame_end();
+      break;
+    default:
+      return HOST_ERR_TYPE;
+  }
+  return 0;
+}
+
+
+//! Feeds pending serial input through the host request parser
+/*!
+ * Never waits for input, a request is carried out as soon as its last
+ * byte is in. Input that doesn't start with FRAME_SYNC is left alone for
+ * the console, loop() drops it when the console is compiled out.
+ * \returns true if the input belongs to the host protocol
+ */
+bool host_service() {
+  while (Serial.available())
+  {
+    if ((state == WAIT_SYNC) && (Serial.peek() != FRAME_SYNC))
+      return false;
+    uint8_t b = Serial.read();
+
+    switch (state)
+    {
+      case WAIT_SYNC:
+        state = WAIT_TYPE;
+        break;
+      case WAIT_TYPE:
+        type = b;
+        sum = b;
+        state = WAIT_LEN_LOW;
+        break;
+      case WAIT_LEN_LOW:
+        length = b;
+        sum ^= b;
+        state = WAIT_LEN_HIGH;
+        break;
+      case WAIT_LEN_HIGH:
+        length |= b << 8;
+        sum ^= b;
+        pos = 0;
+        payload[0] = 0;
+        state = WAIT_PAYLOAD;
+        if (!length || (length > HOST_MAX_PAYLOAD))
+        {
+          /* No room (or no id), look for the next sync */
+          state = WAIT_SYNC;
+          send_error(HOST_ERR_LENGTH);
+        }
+        break;
+      case WAIT_PAYLOAD:
+        payload[pos++] = b;
+        sum ^= b;
+        if (pos == length)
+          state = WAIT_XOR;
+        break;
+      case WAIT_XOR:
+        state = WAIT_SYNC;
+        if (b != sum)
+          b = HOST_ERR_CHECKSUM;
+        else
+          b = handle_request();
+        if (b)
+          send_error(b);
+        break;
+    }
+  }
+  return state != WAIT_SYNC;
+}
@@ -0,0 +1,64 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __HOST_H__
+#define __HOST_H__
+
+#include <inttypes.h>
+
+/* Framed request/reply protocol for the GUI (UI/serial_client.js)
+ *
+ * Requests use the frame.h layout in the other direction:
+ *   0x5A, type, length low, length high, payload, xor
+ * The first payload byte is a request id which the reply (a frame of the
+ * same type) echoes back first, so the host can keep several requests in
+ * flight on the one connection and match the replies up as they come.
+ * Requests are answered in order, engine 1 only:
+ * 'I' (Info): wheels u16, wheel u8, mode u8, fixed rpm u16,
+ *     sweep low u16, sweep high u16, sweep rate u16
+ * 'L' (Label) wheel u8: wheel u8, name NUL terminated
+ * 'E' (Edges) wheel u8, first u16, count u8 (up to HOST_EDGE_PAGE):
+ *     degrees u16, edges u16, first u16, count u8, then count edge
+ *     states, bit 0 crank and bit 1 cam (track bit 0 of each)
+ * 'S' (Select) wheel u8: wheel u8, staged like the console (commit.h)
+ * 'F' (Fixed) rpm u16: rpm u16
+ * 'W' (sWeep) low u16, high u16, rate u16: low u16, high u16, rate u16,
+ *     HOST_ERR_TYPE without CONFIG_SWEEP (config.h)
+ * 'R' (RPM): rpm u16 going out right now
+ * 'K' (clocK) [ppm i16]: ppm i16, the clock correction (calibration.h),
+ *     set and stored first when given
+ * A request that can't be done gets an '!' frame instead:
+ *   id u8, request type u8, HOST_ERR_*
+ * Frames are only looked for at the start of a console line (console.h),
+ * input that isn't a frame goes to the console.
+ */
+#define HOST_MAX_PAYLOAD 8
+#define HOST_EDGE_PAGE 64
+#define HOST_ERR_TYPE 1      /* Unknown request */
+#define HOST_ERR_LENGTH 2    /* Wrong payload length for the type */
+#define HOST_ERR_RANGE 3     /* Argument out of range */
+#define HOST_ERR_CHECKSUM 4  /* Bad xor, id may be wrong too */
+
+bool host_service(void);
+
+#endif
@@ -20,30 +20,53 @@
  *
  */
 
-#include <SerialUI.h>
+#include "auxiliary.h"
+#include "capture.h"
+#include "commit.h"
+#include "console.h"
 #include "defines.h"
+#include "host.h"
 #include "loop.h"
 #include "sweep.h"
+#include "sync.h"
+#include "tach.h"
+#include "vr_output.h"
+
+//! Non time critical work split off from the ISR's
+void service_background() {
+  sync_service();
+  commit_service();
+  tach_service();
+  capture_service();
+  aux_service();
+  vr_service();
+}
 
-extern SUI::SerialUI mySUI;
 
 void loop() {
   //uint16_t tmp_rpm = 0;
   //extern volatile bool adc0_read_complete;
   //extern volatile uint16_t adc0;
-  /* Just handle the Serial UI, everything else is in 
-   * interrupt handlers or callbacks from SerialUI.
+  /* Handle the serial console, everything else is in interrupt handlers
+   * or console commands, apart from the background work in
+   * service_background(). Neither the console nor the GUI protocol
+   * blocks, so this goes round all the time. Framed requests from the
+   * GUI (host.h) are only looked for at the start of a console line.
    */
 
-  if (mySUI.checkForUserOnce())
-  {
-    // Someone connected!
-    mySUI.enter();
-    while (mySUI.userPresent()) 
-    {
-      mySUI.handleRequests();
-    }
-  }
+  service_background();
+#if CONFIG_CONSOLE && CONFIG_HOST
+  if (console_idle() && host_service())
+    return;
+#elif CONFIG_HOST
+  /* Nothing else reads the port, drop whatever doesn't start a frame or
+   * a stray byte would block the protocol for good */
+  while (!host_service() && Serial.available())
+    Serial.read();
+#endif
+#if CONFIG_CONSOLE
+  console_service();
+#endif
 /*  if (adc0_read_complete == true)
   {
     adc0_read_complete = false;
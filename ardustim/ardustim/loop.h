@@ -26,5 +26,6 @@
 #include "structures.h"
 
 void loop(void);
+void service_background(void);
 
 #endif
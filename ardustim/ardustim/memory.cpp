@@ -0,0 +1,191 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "defines.h"
+#include "memory.h"
+#include "structures.h"
+#include "wheel_defs.h"
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include <stdlib.h>
+
+#if defined(__AVR__)
+
+extern wheels Wheels[];
+extern engine engines[];
+
+/* Linker script and avr-libc malloc symbols */
+extern uint8_t __heap_start;
+extern char *__brkval;
+extern uint8_t __data_start;
+struct __freelist {
+  size_t sz;
+  struct __freelist *nx;
+};
+extern struct __freelist *__flp;
+
+
+//! Paints everything above .bss with STACK_CANARY
+/*!
+ * Runs from .init1, before the stack pointer and r1 are set up, so it's
+ * plain asm that only touches Z and r24/r25
+ */
+void paint_stack(void) __attribute__((naked, used, section(".init1")));
+void paint_stack(void) {
+  asm volatile(
+    "    ldi r30, lo8(_end)"         "\n\t"
+    "    ldi r31, hi8(_end)"         "\n\t"
+    "    ldi r24, %[canary]"         "\n\t"
+    "    ldi r25, hi8(__stack)"      "\n\t"
+    "    rjmp 2f"                    "\n\t"
+    "1:  st Z+, r24"                 "\n\t"
+    "2:  cpi r30, lo8(__stack)"      "\n\t"
+    "    cpc r31, r25"               "\n\t"
+    "    brlo 1b"                    "\n\t"
+    "    breq 1b"                    "\n\t"
+    :
+    : [canary] "M" (STACK_CANARY)
+  );
+}
+
+
+/* Lowest address the heap may still grow into */
+static uint8_t *heap_top() {
+  return __brkval ? (uint8_t *)__brkval : &__heap_start;
+}
+
+
+/* Length of the run of untouched canary bytes above the heap */
+static uint16_t untouched() {
+  uint8_t *p = heap_top();
+  uint16_t n = 0;
+
+  while ((p + n < (uint8_t *)SP) && (p[n] == STACK_CANARY))
+    n++;
+  return n;
+}
+
+
+/* Helper function to spit out amount of ram remainig */
+//! Returns the amount of freeRAM
+/*!
+ * Figures out the amount of free RAM remaining nad returns it to the caller
+ * \return amount of free memory
+ */
+uint16_t freeRam() {
+  uint8_t v;
+  return (uint16_t)&v - (uint16_t)heap_top();
+}
+
+
+//! Deepest the stack has been since boot
+/*!
+ * \returns bytes from RAMEND down to the lowest touched byte
+ */
+uint16_t stack_peak() {
+  return (uint16_t)(RAMEND + 1 - (uint16_t)(heap_top() + untouched()));
+}
+
+
+//! Bytes between heap and stack that have never been used since boot
+/*!
+ * The real margin before the stack runs into the heap, freeRam() only
+ * knows about right now. Conservative once the heap shrank, as the bytes
+ * it gave back aren't painted any more
+ */
+uint16_t stack_never_used() {
+  return untouched();
+}
+
+
+//! Heap in use, i.e. from __heap_start to the break
+uint16_t heap_used() {
+  return __brkval ? (uint16_t)(__brkval - (char *)&__heap_start) : 0;
+}
+
+
+//! Bytes of freed chunks below the break, waiting to be reused
+uint16_t heap_free_listed() {
+  uint16_t bytes = 0;
+
+  for (struct __freelist *f = __flp; f; f = f->nx)
+    bytes += f->sz + sizeof(size_t);
+  return bytes;
+}
+
+
+//! Heap held by the sweep tables of every engine, incl. malloc's size word
+uint16_t sweep_table_bytes() {
+  uint16_t bytes = 0;
+
+  for (uint8_t i = 0; i < NUM_ENGINES; i++)
+    if (engines[i].SweepSteps)
+      bytes += engines[i].total_sweep_stages * sizeof(sweep_step) + sizeof(size_t);
+  return bytes;
+}
+
+
+//! .data plus .bss
+uint16_t static_ram_bytes() {
+  return (uint16_t)(&__heap_start - &__data_start);
+}
+
+
+//! Flash used by one wheel's name and tracks
+/*!
+ * \param wheel index into Wheels[]
+ * \returns bytes, tracks shared with another wheel included
+ */
+uint16_t wheel_table_bytes(uint8_t wheel) {
+  uint16_t edges = Wheels[wheel].wheel_max_edges;
+  uint16_t bytes = strlen_P(Wheels[wheel].decoder_name) + 1 + edges;
+
+  if (Wheels[wheel].edge_crank_ptr != Wheels[wheel].edge_states_ptr)
+    bytes += edges;
+  if (Wheels[wheel].edge_aux_ptr)
+    bytes += edges;
+  return bytes;
+}
+
+
+//! Flash used by all the wheels, tracks shared between wheels counted once
+uint32_t wheel_tables_bytes() {
+  uint32_t bytes = 0;
+
+  for (uint8_t i = 0; i < MAX_WHEELS; i++) {
+    uint16_t edges = Wheels[i].wheel_max_edges;
+    const unsigned char *tracks[3] = { Wheels[i].edge_states_ptr, Wheels[i].edge_crank_ptr, Wheels[i].edge_aux_ptr };
+
+    bytes += strlen_P(Wheels[i].decoder_name) + 1;
+    for (uint8_t t = 0; t < 3; t++) {
+      bool seen = !tracks[t] || ((t == 1) && (tracks[1] == tracks[0]));
+      for (uint8_t j = 0; (j < i) && !seen; j++)
+        seen = (tracks[t] == Wheels[j].edge_states_ptr) || (tracks[t] == Wheels[j].edge_crank_ptr) || (tracks[t] == Wheels[j].edge_aux_ptr);
+      if (!seen)
+        bytes += edges;
+    }
+  }
+  return bytes;
+}
+
+#endif
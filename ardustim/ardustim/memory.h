@@ -0,0 +1,48 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __MEMORY_H__
+#define __MEMORY_H__
+
+#include <inttypes.h>
+
+/* RAM and flash accounting, shown by the info command
+ *
+ * RAM from the end of .bss up to RAMEND is painted with STACK_CANARY
+ * before main() runs, the lowest byte that no longer holds it is as deep
+ * as the stack (or the heap) ever got since boot. Build time numbers per
+ * wheel table and per subsystem come from tools/mem_report.py.
+ */
+#define STACK_CANARY 0xC5
+
+uint16_t freeRam(void);
+uint16_t stack_peak(void);
+uint16_t stack_never_used(void);
+uint16_t heap_used(void);
+uint16_t heap_free_listed(void);
+uint16_t sweep_table_bytes(void);
+uint16_t static_ram_bytes(void);
+uint16_t wheel_table_bytes(uint8_t);
+uint32_t wheel_tables_bytes(void);
+
+#endif
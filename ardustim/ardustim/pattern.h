@@ -0,0 +1,385 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ * 
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+#ifndef __PATTERN_H__
+#define __PATTERN_H__
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include "defines.h"
+#include "enums.h"
+#include "hal.h"
+#include "structures.h"
+#include "sweep.h"
+
+/* The per edge and per sweep tick engine logic, kept in here (instead of
+ * ISRs.cpp) so the host tools in ../tools run exactly the same code. Timers
+ * are reached through the HAL (hal.h), on the host those are plain
+ * variables.
+ */
+
+extern wheels Wheels[];
+
+
+/* Hands a sweep stage's prescaler to the edge ISR, which reloads it with
+ * the next period
+ */
+static inline void sweep_prescaler(engine *e)
+{
+  e->sweep_reset_prescaler = false;
+  e->prescaler_bits = e->SweepSteps[e->sweep_stage].prescaler_bits;
+  e->last_prescaler_bits = e->prescaler_bits;
+  e->reset_prescaler = true;
+}
+
+
+/* Sweeps one engine, called by the TIMER2 ISR 1000x/second. new_OCR1A is
+ * worked on in a local copy and written back atomically as the edge ISR's
+ * can interrupt the sweeper half way through a 16 bit store. Engines in
+ * edge sweep mode are left to sweep_update().
+ */
+static inline void sweep_engine(engine *e)
+{
+  uint16_t ocr;
+
+  if ((e->mode != LINEAR_SWEPT_RPM) || e->edge_sweep)
+    return;
+  /* IF the sweep parameters are being changed, abort the ISR so we
+   * don't use half-set values and get things really screwed up
+   */
+  if (e->sweep_lock)
+    return;
+  e->sweep_lock = true; /* Set semaphore */
+  ocr = e->new_OCR1A;
+  /* Check flag to see if we need to reset the prescaler for the timer.
+   * if so, clear that flag, set another for the high speed ISR to check for
+   * and reprogram the timer when it next runs. Store the last prescaler bits
+   * for comparison against during sweep stage changes
+   */
+  if (e->sweep_reset_prescaler)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      if (e->mode == LINEAR_SWEPT_RPM) /* See below */
+        sweep_prescaler(e);
+    }
+  }
+  /* Sweep code */
+  if (e->sweep_direction == ASCENDING)
+  {
+    /* So we don't have to work in floating point (super expensive and slow)
+     * we work in a larger scale and keep the remainder per ISR around as 
+     * an integer, when that overcomes the threshold we increment the 
+     * fractional component and decrement the remainder by that same threshold
+     */
+    e->oc_remainder += e->SweepSteps[e->sweep_stage].remainder_per_isr;
+    while (e->oc_remainder > FACTOR_THRESHOLD)
+    {
+      e->fraction++;
+      e->oc_remainder -= FACTOR_THRESHOLD;
+    }
+    /* new_OCR1A is the new Output Compare Register (1a) value, it
+     * determines how long it is between each tooth interrupt. The longer
+     * it is the LOWER the RPM of hte signal will be.  NOTE: this value
+     * goes hand in hand with the prescaler, as that determines the divisor
+     * for the clock, so you need to take both of them into account
+     * tcnt_per_isr is the tooth count CHANGE per ISR (accelerating or 
+     * decelerating depending on sweep direction). Since we're in the 
+     * ascending side (RPM going up, OCR1A going down) we will be reducing
+     * new_OCR1A by tcnt_per_isr + whatever fractional amount until it's 
+     * below the ending_ocr value, at that point this stage is completed
+     * and we increment the stage.
+     */
+    if (ocr > e->SweepSteps[e->sweep_stage].ending_ocr)
+    {
+      ocr -= (e->SweepSteps[e->sweep_stage].tcnt_per_isr + e->fraction);
+      e->fraction = 0;
+    }
+
+    /* Stage endd, increament stage counter, reset remainder to 0 */
+    else /* END of the stage, find out where we are */
+    {
+      e->sweep_stage++;
+      e->oc_remainder = 0;
+    /* Check if there's a next stage by making sure we're not over the end,
+     * if so, then reset new_OCR1A to the beginning value from the 
+     * structure, check if hte prescaler bits need to change, if they do 
+     * we set a flag to do so on the next ISR iteration (1ms later)
+     */
+      if (e->sweep_stage < e->total_sweep_stages)
+      {
+        ocr = e->SweepSteps[e->sweep_stage].beginning_ocr;
+        if (e->SweepSteps[e->sweep_stage].prescaler_bits != e->last_prescaler_bits)
+          e->sweep_reset_prescaler = true;
+      }
+      /* End of sweep stages, reverse direction, decrement sweep_stage by one
+       * Set the direction flag to descending, Reset new_OCR1A to the end
+       * value (remember opposite direction!), Check prescaler bits and 
+       * set flag to reset if necessary
+       */
+      else /* END of line, time to reverse direction */
+      {
+        e->sweep_stage--; /*Bring back within limits */
+        e->sweep_direction = DESCENDING;
+        ocr = e->SweepSteps[e->sweep_stage].ending_ocr;
+        if (e->SweepSteps[e->sweep_stage].prescaler_bits != e->last_prescaler_bits)
+          e->sweep_reset_prescaler = true;
+      }
+      /* Reset fractionals or next round */
+    }
+  }
+  /* Descending RPM, which means new_OCR1A should be CLIMBING,
+   * increment the oc_remainder, check if it's over the threshold, if 
+   * so increment the fraction and decrement the remainder by the fraction.
+   */
+  else /* Descending */
+  {
+    e->oc_remainder += e->SweepSteps[e->sweep_stage].remainder_per_isr;
+    while (e->oc_remainder > FACTOR_THRESHOLD)
+    {
+      e->fraction++;
+      e->oc_remainder -= FACTOR_THRESHOLD;
+    }
+    /* Check if new_OCR1A is less than the sweep stage threshold, if it
+     * still is, increase new_OCR1A by the tooth count change per ISR and the
+     * fractional component
+     */
+    if (ocr < e->SweepSteps[e->sweep_stage].beginning_ocr)
+    {
+      ocr += (e->SweepSteps[e->sweep_stage].tcnt_per_isr + e->fraction);
+      e->fraction = 0;
+    }
+    /* new_OCR1A has exceeded the OCR threshold, decrement the sweep stage,
+     * reset the remainder to 0 an check to make sure sweep_stage hasn't gone
+     * below zero
+     */
+    else /* End of stage */
+    {
+      e->sweep_stage--;
+      e->oc_remainder = 0;
+      /* Check that sweep_stage hasn't gone negative, if not, reset 
+       * new_OCR1a to the starting value for this stage, check prescaler
+       * bits against last ones and set flag if needed
+       */
+      if (e->sweep_stage >= 0)
+      {
+        ocr = e->SweepSteps[e->sweep_stage].ending_ocr;
+        if (e->SweepSteps[e->sweep_stage].prescaler_bits != e->last_prescaler_bits)
+          e->sweep_reset_prescaler = true;
+      }
+      /* Sweep stage went negative, bring it back to zero, flip the direction
+       * back to ASCENDING, reset new_OCR1A to starting value for this stage
+       * and check prescaler bits and set flag to update if needed
+       */
+      else /*End of the line */
+      {
+        e->sweep_stage++; /*Bring back within limits */
+        e->sweep_direction = ASCENDING;
+        ocr = e->SweepSteps[e->sweep_stage].beginning_ocr;
+        if (e->SweepSteps[e->sweep_stage].prescaler_bits != e->last_prescaler_bits)
+          e->sweep_reset_prescaler = true;
+      }
+    }
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    /* Unless a commit (commit.h) put a fixed RPM live meanwhile */
+    if (e->mode == LINEAR_SWEPT_RPM)
+    {
+      e->new_OCR1A = ocr;
+      /* Extended timer mode, prescaler_bits is this stage's software bitshift */
+      if (e->extended)
+        set_extended_period(e, (uint32_t)ocr << e->SweepSteps[e->sweep_stage].prescaler_bits);
+    }
+  }
+  e->sweep_lock = false;
+}
+
+
+/* Edge sweep, run from the edge ISR every sweep_edges edges in place of
+ * the Timer2 sweeper. new_OCR1A doesn't change in between, so those edges
+ * lasted exactly sweep_edges * (OC + 1) (prescaled) ticks and the
+ * sweeper's per ms OC change over them is (OC + 1) * update_factor
+ * (precomputed per stage by setup_sweep()). The 8.24 product is split so
+ * it stays in 32 bit maths and its fraction carries over in oc_remainder,
+ * so the ramp rate is the same as the sweeper's. Also picks up a pending
+ * prescaler change at the next edge. Runs in the edge ISR, so no locking
+ * needed past the UI's sweep_lock.
+ */
+static inline void sweep_update(engine *e)
+{
+  uint16_t ocr = e->new_OCR1A;
+  uint32_t factor;
+  uint32_t hi;
+  uint32_t lo;
+  uint32_t rem;
+  uint32_t delta;
+
+  if ((e->mode != LINEAR_SWEPT_RPM) || e->sweep_lock)
+    return;
+  if (e->sweep_reset_prescaler)
+    sweep_prescaler(e);
+  if (e->sweep_edges_left)
+    return;
+  e->sweep_edges_left = e->sweep_edges;
+  factor = e->SweepSteps[e->sweep_stage].update_factor;
+  hi = (uint32_t)(ocr + 1) * (uint16_t)(factor >> 16);
+  lo = (uint32_t)(ocr + 1) * (uint16_t)factor;
+  rem = ((hi & 0xFF) << 16) + (lo & 0xFFFFFF) + e->oc_remainder;
+  delta = (hi >> 8) + (lo >> 24) + (rem >> 24);
+  e->oc_remainder = rem & 0xFFFFFF;
+
+  if (e->sweep_direction == ASCENDING)
+  {
+    if ((ocr > e->SweepSteps[e->sweep_stage].ending_ocr) && ((uint16_t)(ocr - e->SweepSteps[e->sweep_stage].ending_ocr) > delta))
+      ocr -= delta;
+    else /* End of the stage, on to the next or turn around */
+    {
+      e->oc_remainder = 0;
+      if (e->sweep_stage + 1 < e->total_sweep_stages)
+      {
+        e->sweep_stage++;
+        ocr = e->SweepSteps[e->sweep_stage].beginning_ocr;
+      }
+      else
+      {
+        e->sweep_direction = DESCENDING;
+        ocr = e->SweepSteps[e->sweep_stage].ending_ocr;
+      }
+      if (e->SweepSteps[e->sweep_stage].prescaler_bits != e->last_prescaler_bits)
+        sweep_prescaler(e);
+    }
+  }
+  else /* Descending, OC climbing */
+  {
+    if ((ocr < e->SweepSteps[e->sweep_stage].beginning_ocr) && ((uint16_t)(e->SweepSteps[e->sweep_stage].beginning_ocr - ocr) > delta))
+      ocr += delta;
+    else
+    {
+      e->oc_remainder = 0;
+      if (e->sweep_stage > 0)
+      {
+        e->sweep_stage--;
+        ocr = e->SweepSteps[e->sweep_stage].ending_ocr;
+      }
+      else
+      {
+        e->sweep_direction = ASCENDING;
+        ocr = e->SweepSteps[e->sweep_stage].beginning_ocr;
+      }
+      if (e->SweepSteps[e->sweep_stage].prescaler_bits != e->last_prescaler_bits)
+        sweep_prescaler(e);
+    }
+  }
+  e->new_OCR1A = ocr;
+  if (e->extended)
+    set_extended_period(e, (uint32_t)ocr << e->SweepSteps[e->sweep_stage].prescaler_bits);
+}
+
+
+/* Writes an engine's current edge to its crank and cam ports with the
+ * invert masks and cam shift applied, i.e. without pin routing (engine 2,
+ * and the host simulation)
+ */
+static inline void output_edge(const engine *e, volatile uint8_t *crank_port, volatile uint8_t *cam_port)
+{
+  hal_port_write(crank_port, e->crank_invert_mask ^ pgm_read_byte(&Wheels[e->selected_wheel].edge_crank_ptr[e->edge_counter]));
+  hal_port_write(cam_port, e->cam_invert_mask ^ (uint8_t)(pgm_read_byte(&Wheels[e->selected_wheel].edge_states_ptr[e->edge_counter]) << e->camSignalBitShift));
+}
+
+
+/* Steps an engine's wheel index one edge forwards (or backwards when
+ * running in reverse), wrapping at the end of the wheel, and runs the edge
+ * sweep when due
+ */
+static inline void advance_edge(engine *e)
+{
+  if (e->normal)
+  {
+    e->edge_counter++;
+    if (e->edge_counter == Wheels[e->selected_wheel].wheel_max_edges) {
+      e->edge_counter = 0;
+    }
+  }
+  else /* Reverse Rotation: overflow handling */
+  {
+    if (e->edge_counter == 0)
+      e->edge_counter = Wheels[e->selected_wheel].wheel_max_edges;
+    e->edge_counter--;
+  }
+#if CONFIG_SWEEP
+  if (e->edge_sweep && (!--e->sweep_edges_left || e->sweep_reset_prescaler))
+    sweep_update(e);
+#endif
+}
+
+
+/* Extended timer mode, counts off an idle chunk in the middle of a long
+ * period and loads the final compare when the last one starts. Returns
+ * true when no edge is due yet. Left running when extended mode is turned
+ * off so a period already started still ends where it should.
+ */
+static inline bool extended_idle(engine *e, const hal_timer *t)
+{
+  if (!e->ext_chunks_left)
+    return false;
+  if (--e->ext_chunks_left == 0)
+    hal_timer_compare(t, e->ext_final_latched);
+  return true;
+}
+
+
+/* Loads the prescaler (if flagged) and compare value for the period that
+ * starts at this edge, for either timer. Extended mode always runs at /1
+ * and splits the period up as per set_extended_period(). The fractional
+ * tick is accumulated every edge and its carry stretches this period by
+ * one tick, so the average period is exact. Long extended periods skip
+ * this, a tick is < 15ppm of those.
+ */
+static inline void load_next_period(engine *e, const hal_timer *t, int16_t trim)
+{
+  uint16_t fraction = e->ocr_fraction;
+  uint16_t acc = e->ocr_fraction_acc + fraction;
+  uint8_t carry = (acc < fraction) ? 1 : 0;
+
+  e->ocr_fraction_acc = acc;
+  /* Reset Prescaler only if flag is set */
+  if (e->reset_prescaler)
+  {
+    hal_timer_prescale(t, e->extended ? (uint8_t)PRESCALE_1 : e->prescaler_bits);
+    e->reset_prescaler = false;
+  }
+  if (!e->extended)
+    hal_timer_compare(t, e->new_OCR1A + carry + trim);
+  else if (e->ext_chunks)
+  {
+    e->ext_chunks_left = e->ext_chunks;
+    e->ext_final_latched = e->ext_final + trim;
+    hal_timer_compare(t, EXT_CHUNK_TICKS - 1);
+  }
+  else
+    hal_timer_compare(t, e->ext_final + carry + trim);
+}
+
+
+#endif
@@ -0,0 +1,230 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "defines.h"
+#include "enums.h"
+#include "commit.h"
+#include "routing.h"
+#include "structures.h"
+#include "wide_output.h"
+#include <Arduino.h>
+#include <string.h>
+#include <util/atomic.h>
+
+extern engine engines[];
+
+uint8_t routes[ROUTE_PORTS][8];                       /* Per pin: track | ROUTE_INVERT or ROUTE_NONE */
+static uint8_t route_banks[2][ROUTE_PORTS][ROUTE_LUTS][16]; /* Compiled from routes[] */
+uint8_t (*route_lut)[ROUTE_LUTS][16] = route_banks[0];      /* Bank the Timer1 ISR uses */
+uint8_t (*route_staged)[ROUTE_LUTS][16] = route_banks[1];   /* Bank a commit swaps in */
+
+#if defined(__AVR_ATmega328P__)
+static const uint8_t route_port_ids[ROUTE_PORTS] = { PB, PC, PD };
+static volatile uint8_t * const route_ddr[ROUTE_PORTS] = { &DDRB, &DDRC, &DDRD };
+/* PC0 pot, PC1 sync out, PC2/PC3 capture, PC6 reset; PD0/PD1 serial, PD2 sync in, PD3 tach in */
+static const uint8_t route_reserved[ROUTE_PORTS] = { B00000000, B01001111, B00001111 };
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+static const uint8_t route_port_ids[ROUTE_PORTS] = { PA, PB, PC };
+static volatile uint8_t * const route_ddr[ROUTE_PORTS] = { &DDRA, &DDRB, &DDRC };
+static const uint8_t route_reserved[ROUTE_PORTS] = { B00000000, B00000000, B00000000 };
+#endif
+
+
+//! Sets the routes matching the original hard-wired output layout
+/*!
+ * 328P: cam1-4 on D4-D7, cam5-8 on D8-D11, crank1-2 on A4-A5
+ * Mega: crank1 on D22, cam1-5 on D53-D50/D10, cam5-8 on D33-D30
+ */
+void route_defaults() {
+  memset(routes, ROUTE_NONE, sizeof(routes));
+  for (uint8_t i = 0; i < 4; i++) {
+#if defined(__AVR_ATmega328P__)
+    routes[2][4 + i] = ROUTE_CAM_TRACK + i;       /* PORTD */
+    routes[0][i] = ROUTE_CAM_TRACK + 4 + i;       /* PORTB */
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+    routes[1][i] = ROUTE_CAM_TRACK + i;           /* PORTB */
+    routes[2][4 + i] = ROUTE_CAM_TRACK + 4 + i;   /* PORTC */
+#endif
+  }
+#if defined(__AVR_ATmega328P__)
+  routes[1][4] = 0;                               /* PORTC */
+  routes[1][5] = 1;
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+  routes[1][4] = ROUTE_CAM_TRACK + 4;
+  routes[0][0] = 0;                               /* PORTA */
+#endif
+}
+
+
+//! Compiles routes[] into the nibble tables the ISR uses
+/*!
+ * Each routed pin lands in exactly one of the port's four tables (the
+ * nibble holding its source bit) so the ISR can just OR them together.
+ * Cam tracks take data bit (track - cam shift), pins whose source is
+ * shifted out sit at a constant level. A pin is inverted by its route and
+ * by its track's bit of the crank or cam invert mask. Routed pins are made
+ * outputs, pins that lost their route go back to inputs.
+ * \param lut bank to fill, never the one the ISR is using
+ * \param crank_invert crank invert mask to fold in
+ * \param cam_invert cam invert mask to fold in
+ * \param cam_shift cam shift to fold in, negative is a right shift
+ */
+static void route_build(uint8_t (*lut)[ROUTE_LUTS][16], uint8_t crank_invert, uint8_t cam_invert, int8_t cam_shift) {
+  memset(lut, 0, sizeof(route_banks[0]));
+  for (uint8_t p = 0; p < ROUTE_PORTS; p++) {
+    uint8_t routed = 0;
+
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      uint8_t route = routes[p][bit];
+      uint8_t pin = 1 << bit;
+      uint8_t track;
+      uint8_t invert;
+      int8_t data_bit;
+
+      if (route == ROUTE_NONE)
+        continue;
+      routed |= pin;
+      track = route & ROUTE_TRACK_MASK;
+      invert = (route & ROUTE_INVERT) ? 1 : 0;
+      if (track < ROUTE_CAM_TRACK) {
+        data_bit = track;
+        invert ^= (crank_invert >> track) & 1;
+      } else {
+        data_bit = track - ROUTE_CAM_TRACK - cam_shift;
+        invert ^= (cam_invert >> (track - ROUTE_CAM_TRACK)) & 1;
+      }
+      if ((data_bit < 0) || (data_bit > 7)) {
+        for (uint8_t v = 0; v < 16; v++)
+          lut[p][0][v] |= invert ? pin : 0;
+        continue;
+      }
+      /* Crank tables are 0/1, cam 2/3, low nibble first */
+      uint8_t table = ((track < ROUTE_CAM_TRACK) ? 0 : 2) + (data_bit >> 2);
+      for (uint8_t v = 0; v < 16; v++)
+        if (((v >> (data_bit & 3)) & 1) != invert)
+          lut[p][table][v] |= pin;
+    }
+#ifdef WIDE_OUTPUT_SUPPORTED
+    if (wide_output)
+      continue;  /* Wide output owns the pin directions */
+#endif
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      *route_ddr[p] = (*route_ddr[p] & route_reserved[p]) | routed;
+    }
+  }
+}
+
+
+//! Compiles the routes for an engine's current settings and puts them live
+/*!
+ * Built in the bank the ISR isn't using, then swapped in with the pointer
+ * so no edge ever sees half a table. Only while no commit is armed, as
+ * that owns the other bank.
+ * \param e engine whose invert mask and cam shift to fold in
+ */
+void route_compile(engine *e) {
+  route_build(route_staged, e->crank_invert_mask, e->cam_invert_mask, (int8_t)e->camSignalBitShift);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    route_swap();
+  }
+}
+
+
+//! Compiles the routes for a staged configuration, for its commit to swap in
+/*!
+ * \param c staged invert mask and cam shift to fold in
+ */
+void route_stage(const engine_config *c) {
+  route_build(route_staged, c->crank_invert_mask, c->cam_invert_mask, (int8_t)c->camSignalBitShift);
+}
+
+
+//! Recompiles the routes after a routing change on engine 1
+/*!
+ * An armed commit is taken back while the live bank is rebuilt, then
+ * armed again with its tables rebuilt from the new routes as well
+ */
+void refresh_routing() {
+  engine *e = &engines[ENGINE_1];
+  bool armed = commit_disarm(e);
+
+  route_compile(e);
+  if (armed)
+    commit_arm(e);
+}
+
+
+/* Finds the routes[] slot of an Arduino pin, false if it can't be routed */
+static bool route_slot(uint8_t pin, uint8_t *port, uint8_t *bit) {
+  uint8_t id;
+  uint8_t mask;
+
+  if (pin >= NUM_DIGITAL_PINS)
+    return false;
+  id = digitalPinToPort(pin);
+  mask = digitalPinToBitMask(pin);
+  for (uint8_t p = 0; p < ROUTE_PORTS; p++) {
+    if ((id != route_port_ids[p]) || (mask & route_reserved[p]))
+      continue;
+    *port = p;
+    *bit = 0;
+    while (!(mask & (1 << *bit)))
+      (*bit)++;
+    return true;
+  }
+  return false;
+}
+
+
+//! Routes a track onto an Arduino pin, route_compile() puts it live
+/*!
+ * \param pin Arduino pin number
+ * \param track 0-15 (see routing.h), anything else unroutes the pin
+ * \param invert true to drive the pin inverted
+ * \returns false if the pin can't be routed
+ */
+bool route_pin(uint8_t pin, uint8_t track, bool invert) {
+  uint8_t port;
+  uint8_t bit;
+
+  if (!route_slot(pin, &port, &bit))
+    return false;
+  if (track >= ROUTE_TRACKS)
+    routes[port][bit] = ROUTE_NONE;
+  else
+    routes[port][bit] = track | (invert ? ROUTE_INVERT : 0);
+  return true;
+}
+
+
+//! Gets the route of an Arduino pin, ROUTE_NONE if unrouted or not routable
+uint8_t get_route(uint8_t pin) {
+  uint8_t port;
+  uint8_t bit;
+
+  if (!route_slot(pin, &port, &bit))
+    return ROUTE_NONE;
+  return routes[port][bit];
+}
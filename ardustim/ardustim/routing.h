@@ -0,0 +1,85 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __ROUTING_H__
+#define __ROUTING_H__
+
+#include <inttypes.h>
+#include "structures.h"
+
+/* Channel routing (engine 1, standard output layout)
+ *
+ * Every pin on the pattern ports takes its level from one logical track,
+ * optionally inverted:
+ *   tracks 0-7  : crank1-8, bits of the wheel's crank array
+ *   tracks 8-15 : cam1-8, bits of the wheel's edge states array
+ * Routes are compiled (route_compile()) into four 16 entry nibble tables
+ * per port with the crank/cam invert masks, cam shift and per pin invert all
+ * folded in, so the Timer1 ISR still does one write per port:
+ *   port = lut[0][crank & 0x0F] | lut[1][crank >> 4] | lut[2][cam & 0x0F] | lut[3][cam >> 4]
+ *
+ * Ports are PORTB/PORTC/PORTD on the 328P and PORTA/PORTB/PORTC on the
+ * Mega, pins used by the serial port, pot, sync, tach and capture inputs
+ * can't be routed. The defaults match the original hard-wired layout.
+ *
+ * There are two banks of tables, the ISR uses the one route_lut points
+ * at. Tables are compiled into the other bank and swapped in with one
+ * pointer store, either right away (route_compile()) or by a configuration
+ * commit at its crank angle (route_stage(), commit.h).
+ */
+#define ROUTE_PORTS 3
+#define ROUTE_LUTS 4
+#define ROUTE_TRACKS 16
+#define ROUTE_CAM_TRACK 8     /* First cam track */
+#define ROUTE_TRACK_MASK 0x0F
+#define ROUTE_INVERT 0x80     /* Set in a route to invert the pin */
+#define ROUTE_NONE 0xFF       /* Pin not driven by the pattern */
+
+extern uint8_t routes[ROUTE_PORTS][8];
+extern uint8_t (*route_lut)[ROUTE_LUTS][16];
+extern uint8_t (*route_staged)[ROUTE_LUTS][16];
+
+void route_defaults(void);
+void route_compile(engine *);
+void route_stage(const engine_config *);
+void refresh_routing(void);
+bool route_pin(uint8_t, uint8_t, bool);
+uint8_t get_route(uint8_t);
+
+//! Puts the staged bank live, the live one becomes the staging bank
+static inline void route_swap(void)
+{
+  uint8_t (*live)[ROUTE_LUTS][16] = route_lut;
+
+  route_lut = route_staged;
+  route_staged = live;
+}
+
+//! Gets the value of one routed port for an edge, see above
+static inline uint8_t route_port(uint8_t port, uint8_t crank, uint8_t cam)
+{
+  return route_lut[port][0][crank & 0x0F] | route_lut[port][1][crank >> 4] |
+         route_lut[port][2][cam & 0x0F] | route_lut[port][3][cam >> 4];
+}
+
+#endif
@@ -26,192 +26,360 @@
 #include <avr/pgmspace.h>
 #include <math.h>
 #include <util/delay.h>
-#include <SerialUI.h>
 #include "serialmenu.h"
+#include "auxiliary.h"
+#include "bitstream.h"
+#include "calibration.h"
 #include "structures.h"
 #include "sweep.h"
 #include "user_defaults.h"
+#include "capture.h"
+#include "catalog.h"
+#include "commit.h"
+#include "console.h"
+#include "hal.h"
+#include "memory.h"
+#include "routing.h"
+#include "stream.h"
+#include "sync.h"
+#include "tach.h"
+#include "twin_engine.h"
+#include "vr_output.h"
+#include "wide_output.h"
 
 /* External Global Variables */
-unsigned long wanted_rpm = DEFAULT_RPM;
-extern SUI::SerialUI mySUI;
-extern sweep_step *SweepSteps; /* Global pointer for the sweep steps */
 extern wheels Wheels[];        /* Array of wheel structures */
-extern uint8_t mode;           /* Sweep or fixed */
-extern uint8_t total_sweep_stages;
-extern uint16_t sweep_low_rpm;
-extern uint16_t sweep_high_rpm;
-extern uint16_t sweep_rate;
-
-/* Volatile variables (USED in ISR's) */
-extern volatile uint8_t selected_wheel;
-extern volatile uint8_t camSignalBitShift;
-extern volatile uint8_t sweep_direction;
-extern volatile int8_t sweep_stage;
-extern volatile bool normal;
-extern volatile bool sweep_lock;
-extern volatile bool sweep_reset_prescaler;
-extern volatile uint16_t edge_counter;
-extern volatile uint16_t new_OCR1A;
-extern volatile uint32_t oc_remainder;
-
-/* Local globals for serialUI state tracking */
-bool fixed = true;
-bool swept = false;
-//! Initializes the serial port and sets up the Menu
+extern engine engines[];       /* Per engine pattern, RPM and sweep state */
+extern uint8_t active_engine;  /* Engine the serial UI is configuring */
+
+#if CONFIG_CONSOLE
+/* Command names and help, in flash */
+static const char help_cmd[] PROGMEM = "help";
+static const char help_help[] PROGMEM = "List the commands";
+static const char info_cmd[] PROGMEM = "info";
+static const char info_help[] PROGMEM = "Show data and current settings";
+static const char rpm_cmd[] PROGMEM = "rpm";
+static const char rpm_help[] PROGMEM = "Set fixed RPM (rpm)";
+#if CONFIG_SWEEP
+static const char sweep_cmd[] PROGMEM = "sweep";
+static const char sweep_help[] PROGMEM = "Sweep the RPM (min,max,rate(rpm/sec))";
+#endif
+static const char tach_cmd[] PROGMEM = "tach";
+static const char tach_help[] PROGMEM = "Follow a tach signal on D3 (pulses/rev,slew(rpm/sec))";
+static const char clock_cmd[] PROGMEM = "clock";
+static const char clock_help[] PROGMEM = "Show or set the clock correction (ppm, + when the clock runs fast)";
+static const char clocktrim_cmd[] PROGMEM = "clocktrim";
+static const char clocktrim_help[] PROGMEM = "Correct the clock from a measured output (target,measured, same units)";
+static const char camleft_cmd[] PROGMEM = "camleft";
+static const char camleft_help[] PROGMEM = "Shift the CAM bits to the left (bits)";
+static const char camright_cmd[] PROGMEM = "camright";
+static const char camright_help[] PROGMEM = "Shift the CAM bits to the right (bits)";
+static const char next_cmd[] PROGMEM = "next";
+static const char next_help[] PROGMEM = "Pick the next wheel pattern";
+static const char prev_cmd[] PROGMEM = "prev";
+static const char prev_help[] PROGMEM = "Pick the previous wheel pattern";
+static const char wheels_cmd[] PROGMEM = "wheels";
+static const char wheels_help[] PROGMEM = "List all wheel patterns";
+static const char wheel_cmd[] PROGMEM = "wheel";
+static const char wheel_help[] PROGMEM = "Choose a wheel pattern by number (wheel)";
+#if CONFIG_CATALOG
+static const char cathash_cmd[] PROGMEM = "cathash";
+static const char cathash_help[] PROGMEM = "Send wheel count, page size and catalog hash";
+static const char catpage_cmd[] PROGMEM = "catpage";
+static const char catpage_help[] PROGMEM = "Send one page of wheel records (page from 0)";
+static const char catwheel_cmd[] PROGMEM = "catwheel";
+static const char catwheel_help[] PROGMEM = "Send the record of one wheel (wheel)";
+#endif
+static const char reverse_cmd[] PROGMEM = "reverse";
+static const char reverse_help[] PROGMEM = "Reverse the wheel's direction of rotation";
+static const char invcrank_cmd[] PROGMEM = "invcrank";
+static const char invcrank_help[] PROGMEM = "Invert primary (crank) signal polarity";
+static const char invcam_cmd[] PROGMEM = "invcam";
+static const char invcam_help[] PROGMEM = "Invert secondary (cam) signal polarity";
+#if NUM_ENGINES > 1
+static const char twin_cmd[] PROGMEM = "twin";
+static const char twin_help[] PROGMEM = "Toggle engine 2 on Timer3 (PORTK crank, PORTL cam)";
+static const char engine_cmd[] PROGMEM = "engine";
+static const char engine_help[] PROGMEM = "Choose the engine the commands configure (1-2)";
+#endif
+static const char extended_cmd[] PROGMEM = "extended";
+static const char extended_help[] PROGMEM = "Toggle 32 bit compare at /1 instead of prescaler switching";
+#if CONFIG_SWEEP
+static const char edgesweep_cmd[] PROGMEM = "edgesweep";
+static const char edgesweep_help[] PROGMEM = "Toggle sweeping from the edge ISR instead of Timer2";
+#endif
+static const char capture_cmd[] PROGMEM = "capture";
+static const char capture_help[] PROGMEM = "Toggle streaming of ECU output edges as binary records";
+#ifdef WIDE_OUTPUT_SUPPORTED
+static const char wide_cmd[] PROGMEM = "wide";
+static const char wide_help[] PROGMEM = "Toggle 24 channel output on PORTA/PORTC/PORTL";
+#endif
+#ifdef BITSTREAM_SUPPORTED
+static const char bitstream_cmd[] PROGMEM = "bitstream";
+static const char bitstream_help[] PROGMEM = "Toggle crank1 shifted out of USART3 on D14 (fixed RPM)";
+#endif
+#ifdef AUX_SUPPORTED
+static const char speed_cmd[] PROGMEM = "speed";
+static const char speed_help[] PROGMEM = "Shaft/vehicle speed on D46 (hz(0 off),ramp(hz/sec, 0 jump))";
+static const char map_cmd[] PROGMEM = "map";
+static const char map_help[] PROGMEM = "PWM MAP on D6 (mean %,pulsation %,pulses/720 degrees)";
+static const char tps_cmd[] PROGMEM = "tps";
+static const char tps_help[] PROGMEM = "PWM TPS on D7 (% (0 off))";
+static const char knock_cmd[] PROGMEM = "knock";
+static const char knock_help[] PROGMEM = "Knock bursts on D8 (angle,width(degrees, 0 off),bursts(0 every cycle))";
+#endif
+#ifdef VR_SUPPORTED
+static const char vr_cmd[] PROGMEM = "vr";
+static const char vr_help[] PROGMEM = "VR crank signal on D5 (full amplitude rpm, 0 off)";
+#endif
+static const char stream_cmd[] PROGMEM = "stream";
+static const char stream_help[] PROGMEM = "Play host streamed edges on engine 1 (durations(0-1)), see stream.h";
+static const char route_cmd[] PROGMEM = "route";
+static const char route_help[] PROGMEM = "Drive a pin from a track (pin,track(0 off,1-8 crank,9-16 cam),invert(0-1))";
+static const char routes_cmd[] PROGMEM = "routes";
+static const char routes_help[] PROGMEM = "List the routed pins";
+static const char defroutes_cmd[] PROGMEM = "defroutes";
+static const char defroutes_help[] PROGMEM = "Back to the standard pin layout";
+static const char syncoff_cmd[] PROGMEM = "syncoff";
+static const char syncoff_help[] PROGMEM = "Free running, no sync pulse in or out";
+static const char syncmaster_cmd[] PROGMEM = "syncmaster";
+static const char syncmaster_help[] PROGMEM = "Emit a sync pulse at edge 0";
+static const char syncslave_cmd[] PROGMEM = "syncslave";
+static const char syncslave_help[] PROGMEM = "Phase-lock to a master's sync pulse on D2";
+static const char syncoffset_cmd[] PROGMEM = "syncoffset";
+static const char syncoffset_help[] PROGMEM = "Edge lined up with the master's edge 0 (edge)";
+static const char angle_cmd[] PROGMEM = "angle";
+static const char angle_help[] PROGMEM = "Crank angle staged changes go live at (0-719 degrees)";
+static const char hold_cmd[] PROGMEM = "hold";
+static const char hold_help[] PROGMEM = "Toggle batching changes until apply";
+static const char apply_cmd[] PROGMEM = "apply";
+static const char apply_help[] PROGMEM = "Arm the held changes for the commit angle";
+static const char discard_cmd[] PROGMEM = "discard";
+static const char discard_help[] PROGMEM = "Drop the staged changes";
+static const char status_cmd[] PROGMEM = "status";
+static const char status_help[] PROGMEM = "Show the commit angle and staged changes";
+
+/* Console commands, see console.h */
+static const console_command commands[] PROGMEM = {
+  { help_cmd, console_help, help_help },
+  { info_cmd, show_info_cb, info_help },
+  { rpm_cmd, set_rpm_cb, rpm_help },
+#if CONFIG_SWEEP
+  { sweep_cmd, sweep_rpm_cb, sweep_help },
+#endif
+  { tach_cmd, tach_follow_cb, tach_help },
+  { clock_cmd, clock_ppm_cb, clock_help },
+  { clocktrim_cmd, clock_trim_cb, clocktrim_help },
+  { camleft_cmd, shift_cam_left, camleft_help },
+  { camright_cmd, shift_cam_right, camright_help },
+  { next_cmd, select_next_wheel_cb, next_help },
+  { prev_cmd, select_previous_wheel_cb, prev_help },
+  { wheels_cmd, list_wheels_cb, wheels_help },
+  { wheel_cmd, select_wheel_cb, wheel_help },
+#if CONFIG_CATALOG
+  { cathash_cmd, catalog_hash_cb, cathash_help },
+  { catpage_cmd, catalog_page_cb, catpage_help },
+  { catwheel_cmd, catalog_wheel_cb, catwheel_help },
+#endif
+  { reverse_cmd, reverse_wheel_direction_cb, reverse_help },
+  { invcrank_cmd, toggle_invert_primary_cb, invcrank_help },
+  { invcam_cmd, toggle_invert_secondary_cb, invcam_help },
+#if NUM_ENGINES > 1
+  { twin_cmd, toggle_twin_engine_cb, twin_help },
+  { engine_cmd, select_engine_cb, engine_help },
+#endif
+  { extended_cmd, toggle_extended_timer_cb, extended_help },
+#if CONFIG_SWEEP
+  { edgesweep_cmd, toggle_edge_sweep_cb, edgesweep_help },
+#endif
+  { capture_cmd, toggle_capture_cb, capture_help },
+#ifdef WIDE_OUTPUT_SUPPORTED
+  { wide_cmd, toggle_wide_output_cb, wide_help },
+#endif
+#ifdef BITSTREAM_SUPPORTED
+  { bitstream_cmd, toggle_bitstream_cb, bitstream_help },
+#endif
+#ifdef AUX_SUPPORTED
+  { speed_cmd, aux_speed_cb, speed_help },
+  { map_cmd, aux_map_cb, map_help },
+  { tps_cmd, aux_tps_cb, tps_help },
+  { knock_cmd, aux_knock_cb, knock_help },
+#endif
+#ifdef VR_SUPPORTED
+  { vr_cmd, vr_output_cb, vr_help },
+#endif
+  { stream_cmd, stream_pattern_cb, stream_help },
+  { route_cmd, route_pin_cb, route_help },
+  { routes_cmd, list_routes_cb, routes_help },
+  { defroutes_cmd, default_routes_cb, defroutes_help },
+  { syncoff_cmd, sync_off_cb, syncoff_help },
+  { syncmaster_cmd, sync_master_cb, syncmaster_help },
+  { syncslave_cmd, sync_slave_cb, syncslave_help },
+  { syncoffset_cmd, sync_offset_cb, syncoffset_help },
+  { angle_cmd, commit_angle_cb, angle_help },
+  { hold_cmd, toggle_commit_hold_cb, hold_help },
+  { apply_cmd, commit_apply_cb, apply_help },
+  { discard_cmd, commit_discard_cb, discard_help },
+  { status_cmd, commit_status_cb, status_help },
+};
+#endif
+
+
+//! Initializes the serial port and the console
 /*!
- * Sets up the serial port and menu for the serial user interface
- * Sets user input timeout to 20 seconds and overall interactivity timeout at 30
- * at which point it'll disconnect the user
+ * Sets up the serial port and the command table for the serial user
+ * interface, the console takes input from loop() from then on
  */
 void serial_setup() {
-  mySUI.begin(9600);
-  mySUI.setTimeout(20000);   /* Tiem to wait for input from druid4arduino */
-  mySUI.setMaxIdleMs(30000); /* disconnect if no response from host in 30 sec */
-  SUI::Menu *mainMenu = mySUI.topLevelMenu();
-  SUI::Menu *wheelMenu;
-  SUI::Menu *shiftCAMenu;
-  SUI::Menu *advMenu;
-  /* Simple all on one menu... */
-  /* Menu strungs are in the header file */
-  mainMenu->setName(F("ArduStim Main Menu"));
-  mainMenu->addCommand(F("Information"), show_info_cb, F("Retrieve data and current settings"));
-  mainMenu->addCommand(F("Set Fixed RPM"), set_rpm_cb, F("Set Fixed RPM"));
-  mainMenu->addCommand(F("Set Swept RPM"), sweep_rpm_cb, F("Sweep the RPM (min,max,rate(rpm/sec))"));
-  // mainMenu->addCommand(F(""), shift_cam, F("Shift CAM Bit Signals"));
-  shiftCAMenu = mainMenu->subMenu(F("Shift CAM Bit"), F("Shift CAM Bit Signals (L,R)"));
-  shiftCAMenu->addCommand(F("Left"), shift_cam_left, F("Shift CAM Bits to the Left"));
-  shiftCAMenu->addCommand(F("Right"), shift_cam_right, F("Shift CAM Bits to the Left"));
-  wheelMenu = mainMenu->subMenu(F("Wheel Options"), F("Wheel Options, (list,choose,select)"));
-  wheelMenu->addCommand(F("Next wheel"), select_next_wheel_cb, F("Pick the next wheel pattern"));
-  wheelMenu->addCommand(F("Previous wheel"), select_previous_wheel_cb, F("Pick the previous wheel pattern"));
-  wheelMenu->addCommand(F("List wheels"), list_wheels_cb, F("List all wheel patterns"));
-  wheelMenu->addCommand(F("Choose wheel"), select_wheel_cb, F("Choose a specific wheel pattern by number"));
-  advMenu = mainMenu->subMenu(F("Advanced Options"), F("Advanced Options (polarity,glitch)"));
-  advMenu->addCommand(F("Reverse Wheel Dir"), reverse_wheel_direction_cb, F("Reverse the wheel's direction of rotation"));
-  advMenu->addCommand(F("Invert Primary"), toggle_invert_primary_cb, F("Invert Primary (crank) signal polarity"));
-  advMenu->addCommand(F("Invert Secondary"), toggle_invert_secondary_cb, F("Invert Secondary (cam) signal polarity"));
-  mainMenu->addCommand(F("Exit"), do_exit, F("Exit (and terminate Druid)"));
-  /* Not implemented yet */
-  //advMenu->addCommand(pri_glitch_key,primary_glitch_cb,pri_glitch_help);
-  //advMenu->addCommand(sec_glitch_key,secondary_glitch_cb,sec_glitch_help);
-  //These use way more memory than I would have hoped for... :(
-  //mySUI.trackState(F("RPM"), &wanted_rpm);
-  //mySUI.trackState(F("Fixed RPM"), &fixed);
-  //mySUI.trackState(F("Swept RPM"), &swept);
-}
-
-/* Helper function to spit out amount of ram remainig */
-//! Returns the amount of freeRAM
-/*!
- * Figures out the amount of free RAM remaining nad returns it to the caller
- * \return amount of free memory
- */
-uint16_t freeRam() {
-  extern int __heap_start, *__brkval;
-  int v;
-  return (int)&v - (__brkval == 0 ? (int)&__heap_start : (int)__brkval);
+  Serial.begin(SERIAL_BAUD);
+#if CONFIG_CONSOLE
+  console_setup(commands, sizeof(commands) / sizeof(console_command));
+  Serial.println(F("+++ Welcome to the ArduStim +++"));
+  Serial.print(F("Enter help for the commands\r\n> "));
+#endif
 }
 
-/* SerialUI Callbacks */
+/* Console command handlers */
 //! Inverts the polarity of the primary output signal
 void toggle_invert_primary_cb() {
-  extern uint8_t output_invert_mask;
-  output_invert_mask ^= 0x01; /* Flip crank invert mask bit */
-  mySUI.print(F("Primary Signal: "));
-  if (output_invert_mask & 0x01) {
+  engine *e = &engines[active_engine];
+  engine_config *c = stage_begin(e);
+  c->crank_invert_mask ^= 0x01; /* Flip crank1 invert mask bit */
+  stage_end(e);
+  Serial.print(F("Primary Signal: "));
+  if (c->crank_invert_mask & 0x01) {
     print_inverted();
   } else {
     print_normal();
   }
+  print_commit(e);
 }
 
 void print_normal() {
-  mySUI.println(F("Normal"));
+  Serial.println(F("Normal"));
 }
 void print_inverted() {
-  mySUI.println(F("Inverted"));
+  Serial.println(F("Inverted"));
 }
 
 //! Inverts the polarity of the secondary output signal
 void toggle_invert_secondary_cb() {
-  extern uint8_t output_invert_mask;
-  output_invert_mask ^= 0x02; /* Flip cam invert mask bit */
-  mySUI.print(F("Secondary Signal: "));
-  if (output_invert_mask & 0x02)
+  engine *e = &engines[active_engine];
+  engine_config *c = stage_begin(e);
+  c->cam_invert_mask ^= 0x01; /* Flip cam1 invert mask bit */
+  stage_end(e);
+  Serial.print(F("Secondary Signal: "));
+  if (c->cam_invert_mask & 0x01)
     print_inverted();
   else
     print_normal();
+  print_commit(e);
 }
 
 
-//! Returns info about status, mode and free RAM
+//! Returns info about status, mode and memory use
 void show_info_cb() {
-  mySUI.println(F("Welcome to ArduStim, written by David J. Andruczyk"));
-  mySUI.print(F("Free RAM: "));
-  mySUI.print(freeRam());
-  mySUI.println(F("bytes."));
-  mySUI.println(F("Currently selected Wheel pattern: "));
-  mySUI.print(selected_wheel + 1);
-  mySUI.print(F(":"));
-  mySUI.println((const __FlashStringHelper *)Wheels[selected_wheel].decoder_name);
+  engine *e = &engines[active_engine];
+  Serial.println(F("Welcome to ArduStim, written by David J. Andruczyk"));
+  Serial.print(F("Free RAM: "));
+  Serial.print(freeRam());
+  Serial.println(F("bytes."));
+  Serial.print(F("Stack peak: "));
+  Serial.print(stack_peak());
+  Serial.print(F(" bytes, never used: "));
+  Serial.print(stack_never_used());
+  Serial.println(F(" bytes"));
+  Serial.print(F("Heap: "));
+  Serial.print(heap_used());
+  Serial.print(F(" bytes, sweep tables: "));
+  Serial.print(sweep_table_bytes());
+  Serial.print(F(", freed: "));
+  Serial.println(heap_free_listed());
+  Serial.print(F("Static RAM: "));
+  Serial.print(static_ram_bytes());
+  Serial.print(F(" bytes, wheel tables: "));
+  Serial.print(wheel_tables_bytes());
+  Serial.print(F(" bytes flash (this wheel "));
+  Serial.print(wheel_table_bytes(e->selected_wheel));
+  Serial.println(F(")"));
+#if NUM_ENGINES > 1
+  Serial.print(F("Configuring engine: "));
+  Serial.println(active_engine + 1);
+#endif
+  Serial.println(F("Currently selected Wheel pattern: "));
+  Serial.print(e->selected_wheel + 1);
+  Serial.print(F(":"));
+  Serial.println((const __FlashStringHelper *)Wheels[e->selected_wheel].decoder_name);
   display_rpm_info();
+  print_clock_ppm();
 }
 
 
 //! Displays RPM output depending on mode
 void display_rpm_info() {
-  if (mode == FIXED_RPM) {
-    mySUI.print(F("Fixed RPM mode, Currently: "));
-    mySUI.print(wanted_rpm);
-    mySUI.println(F(" RPM"));
+  engine *e = &engines[active_engine];
+  if (e->mode == FIXED_RPM) {
+    Serial.print(F("Fixed RPM mode, Currently: "));
+    Serial.print(e->wanted_rpm);
+    Serial.println(F(" RPM"));
+  }
+  if (e->mode == LINEAR_SWEPT_RPM) {
+    Serial.print(F("Swept RPM mode From: "));
+    Serial.print(e->sweep_low_rpm);
+    Serial.print(F("<->"));
+    Serial.print(e->sweep_high_rpm);
+    Serial.print(F(" at: "));
+    Serial.print(e->sweep_rate);
+    Serial.println(F(" RPM/sec"));
   }
-  if (mode == LINEAR_SWEPT_RPM) {
-    mySUI.print(F("Swept RPM mode From: "));
-    mySUI.print(sweep_low_rpm);
-    mySUI.print(F("<->"));
-    mySUI.print(sweep_high_rpm);
-    mySUI.print(F(" at: "));
-    mySUI.print(sweep_rate);
-    mySUI.println(F(" RPM/sec"));
+  if (e->mode == TACH_FOLLOW_RPM) {
+    Serial.print(F("Tach follow mode, Currently: "));
+    Serial.print(tach_rpm);
+    Serial.print(F(" RPM ("));
+    Serial.print(tach_pulses_per_rev);
+    Serial.print(F(" pulses/rev, "));
+    Serial.print(tach_slew_rate);
+    Serial.println(F(" RPM/sec max)"));
   }
 }
 //! Display newly selected wheel information
 /*!
- * Resets the output compare register for the newly changed wheel, then
- * resets edge_counter (wheel array index) to 0 and displays the new
- * wheel information to the end user
+ * Stages the output compare value for the newly staged wheel (fixed RPM,
+ * a sweep is rebuilt once the wheel is live) and displays the new wheel
+ * information to the end user. The wheel goes live at the commit angle,
+ * carrying on from the same crank angle (commit.h)
  */
 void display_new_wheel() {
-  if (mode != LINEAR_SWEPT_RPM)
-    reset_new_OCR1A(wanted_rpm);
-  else
-    compute_sweep_stages(&sweep_low_rpm, &sweep_high_rpm);
-  edge_counter = 0;  // Reset to beginning of the wheel pattern */
-  mySUI.println(F("New Wheel chosen: "));
-  mySUI.print(selected_wheel + 1);
-  mySUI.print(F(": "));
-  mySUI.println((const __FlashStringHelper *)Wheels[selected_wheel].decoder_name);
+  engine *e = &engines[active_engine];
+  engine_config *c = &e->staged;
+  if (e->mode == FIXED_RPM) {
+    get_fixed_period(c->selected_wheel, e->wanted_rpm, c);
+    c->rpm = true;
+  }
+  stage_end(e);
+  Serial.println(F("New Wheel chosen: "));
+  Serial.print(c->selected_wheel + 1);
+  Serial.print(F(": "));
+  Serial.println((const __FlashStringHelper *)Wheels[c->selected_wheel].decoder_name);
+  print_commit(e);
   display_rpm_info();
 }
 
 
-//! Prompts user for new wheel ID
+//! Takes the new wheel ID
 /*!
- * Presents user with a numeric data prompt, waits for input, then verifies
+ * Reads the number after the command, then verifies
  * they inputted a valid choice, then changes the running wheel pattern to the
- * user selected one and reruns the RPM calc (As oit's pattern specific) and then
- * resets the wheel position to 0 to avoid starting in a position off the end of 
- * the wheel pattern array
+ * user selected one and reruns the RPM calc (As oit's pattern specific), the
+ * new wheel starts at the edge matching the crank angle of the commit
  */
 void select_wheel_cb() {
-  mySUI.showEnterNumericDataPrompt();
-  byte newWheel = mySUI.parseInt();
-  if ((newWheel < 1) || (newWheel > (MAX_WHEELS + 1))) {
-    mySUI.returnError("Wheel ID out of range");
+  uint32_t newWheel = console_ulong();
+  if ((newWheel < 1) || (newWheel > MAX_WHEELS)) {
+    console_error(F("Wheel ID out of range"));
     return;
   }
-  selected_wheel = newWheel - 1; /* use 1-MAX_WHEELS range */
+  stage_begin(&engines[active_engine])->selected_wheel = newWheel - 1; /* use 1-MAX_WHEELS range */
   display_new_wheel();
 }
 
@@ -223,10 +391,11 @@ void select_wheel_cb() {
  * selected wheel and current RPM
  */
 void select_next_wheel_cb() {
-  if (selected_wheel == (MAX_WHEELS - 1))
-    selected_wheel = 0;
+  engine_config *c = stage_begin(&engines[active_engine]);
+  if (c->selected_wheel == (MAX_WHEELS - 1))
+    c->selected_wheel = 0;
   else
-    selected_wheel++;
+    c->selected_wheel++;
 
   display_new_wheel();
 }
@@ -239,10 +408,11 @@ void select_next_wheel_cb() {
  * selected wheel and current RPM
  */
 void select_previous_wheel_cb() {
-  if (selected_wheel == 0)
-    selected_wheel = MAX_WHEELS - 1;
+  engine_config *c = stage_begin(&engines[active_engine]);
+  if (c->selected_wheel == 0)
+    c->selected_wheel = MAX_WHEELS - 1;
   else
-    selected_wheel--;
+    c->selected_wheel--;
 
   display_new_wheel();
 }
@@ -250,33 +420,27 @@ void select_previous_wheel_cb() {
 
 //! Changes the RPM based on user input
 /*!
- * Prompts user for new RPM, reads it, validates it's within range, sets lock to
- * prevent a race condition with the sweeper, free's memory of SweepSteps 
- * structure IF allocated, sets the mode to fixed RPM, recalculates the new OCR1A 
- * value based on the user specificaed RPM and sets it and then removes the lock
+ * Reads the new RPM after the command, validates it's within range and
+ * stages the new OCR1A value for the (staged) wheel. The commit switches to
+ * fixed RPM mode when it goes live, the SweepSteps structure (IF allocated)
+ * is freed after that by commit_service()
  */
 void set_rpm_cb() {
-  mySUI.showEnterNumericDataPrompt();
-  uint32_t newRPM = mySUI.parseULong();
+  engine *e = &engines[active_engine];
+  uint32_t newRPM = console_ulong();
   if (newRPM < 10) {
-    mySUI.returnError("Invalid RPM, RPM too low");
+    console_error(F("Invalid RPM, RPM too low"));
     return;
   }
-  /* Spinlock */
-  while (sweep_lock)
-    _delay_us(1);
-  sweep_lock = true;
-  if (SweepSteps)
-    free(SweepSteps);
-  mode = FIXED_RPM;
-  fixed = true;
-  swept = false;
-  reset_new_OCR1A(newRPM);
-  wanted_rpm = newRPM;
+  engine_config *c = stage_begin(e);
+  get_fixed_period(c->selected_wheel, newRPM, c);
+  c->rpm = true;
+  e->wanted_rpm = newRPM;
+  stage_end(e);
 
-  mySUI.print(F("New RPM chosen: "));
-  mySUI.println(wanted_rpm);
-  sweep_lock = false;
+  Serial.print(F("New RPM chosen: "));
+  Serial.println(e->wanted_rpm);
+  print_commit(e);
 }
 
 
@@ -287,34 +451,60 @@ void set_rpm_cb() {
 void list_wheels_cb() {
   byte i = 0;
   for (i = 0; i < MAX_WHEELS; i++) {
-    mySUI.print(i + 1);
-    mySUI.print(F(": "));
-    mySUI.println((const __FlashStringHelper *)Wheels[i].decoder_name);
+    Serial.print(i + 1);
+    Serial.print(F(": "));
+    Serial.println((const __FlashStringHelper *)Wheels[i].decoder_name);
   }
 }
 
 
+#if CONFIG_CATALOG
+//! Sends the catalog hash frame (catalog.h)
+void catalog_hash_cb() {
+  send_catalog_hash();
+}
+
+
+//! Takes a page number and sends that page of the catalog
+void catalog_page_cb() {
+  uint32_t page = console_ulong();
+  if ((page >= MAX_WHEELS) || !send_catalog_page(page * CATALOG_PAGE_SIZE, CATALOG_PAGE_SIZE))
+    console_error(F("Page out of range"));
+}
+
+
+//! Takes a wheel number (as listed) and sends its catalog record
+void catalog_wheel_cb() {
+  uint32_t wheel = console_ulong();
+  if ((wheel < 1) || !send_catalog_page(wheel - 1, 1))
+    console_error(F("Wheel ID out of range"));
+}
+#endif
+
+
 //! Toggle the wheel direction, useful for debugging
 /*!
  * Reverses the emitting wheel pattern direction.  Used mainly as a debugging aid
  * in case the wheel pattern was coded incorrectly in reverse.
  */
 void reverse_wheel_direction_cb() {
-  mySUI.print(F("Wheel Direction: "));
-  if (normal) {
-    normal = false;
-    mySUI.println(F("Reversed"));
-  } else {
-    normal = true;
+  engine *e = &engines[active_engine];
+  engine_config *c = stage_begin(e);
+  c->normal = !c->normal;
+  stage_end(e);
+  Serial.print(F("Wheel Direction: "));
+  if (c->normal)
     print_normal();
-  }
+  else
+    Serial.println(F("Reversed"));
+  print_commit(e);
 }
 
 
+#if CONFIG_SWEEP
 //! Parses input from user and setups up RPM sweep
 /*!
- * Provides the user with a prompt and request input then parses a 3 param 
- * comma separate list from the user, validates the input
+ * Parses the 3 param comma separated list after the command, validates the input
  * and determins the appropriate Ouput Compare threshold values and
  * prescaler settings as well as the amount to increment with each sweep
  * ISR iteration.  It breaks up the sweep range into octaves and linearily
@@ -324,201 +514,680 @@ void reverse_wheel_direction_cb() {
  * a smoother sweep rate, that doesn't accelerate as it approaches the higher
  * RPM threshold.   Since the arduino canot do floating point FAST in an ISR
  * we use this to keep things as quick as possible. This function takes
- * no parameters (it cannot due to SerialUI) and returns void
+ * no parameters (it cannot due to the console) and returns void
  */
 void sweep_rpm_cb() {
+  engine *e = &engines[active_engine];
   uint16_t tmp_low_rpm;
   uint16_t tmp_high_rpm;
   uint8_t j;
-  //uint8_t y;
-  char sweep_buffer[20] = { 0 };
+  char *args = console_args();
 
-  mySUI.showEnterDataPrompt();
-  //y = mySUI.readBytesToEOL(sweep_buffer,20);
-  mySUI.readBytesToEOL(sweep_buffer, 20);
   /* Debugging 
-  mySUI.print(F("Read: "));
-  mySUI.print(y);
-  mySUI.println(F(" charactors from the user")); 
-  mySUI.print(F("Fed: "));
-  mySUI.println(sweep_buffer);
+  Serial.print(F("Fed: "));
+  Serial.println(args);
   */
-  j = sscanf(sweep_buffer, "%i,%i,%i", &tmp_low_rpm, &tmp_high_rpm, &sweep_rate);
+  j = sscanf(args, "%i,%i,%i", &tmp_low_rpm, &tmp_high_rpm, &e->sweep_rate);
   /* Debugging
-  mySUI.print(F("Fields: "));
-  mySUI.println(j);
-  mySUI.print(F("Low: "));
-  mySUI.println(tmp_low_rpm);
-  mySUI.print(F("High: "));
-  mySUI.println(tmp_high_rpm);
-  mySUI.print(F("Sweep Rate: "));
-  mySUI.println(sweep_rate);
+  Serial.print(F("Fields: "));
+  Serial.println(j);
+  Serial.print(F("Low: "));
+  Serial.println(tmp_low_rpm);
+  Serial.print(F("High: "));
+  Serial.println(tmp_high_rpm);
+  Serial.print(F("Sweep Rate: "));
+  Serial.println(e->sweep_rate);
   */
   // Validate input ranges
-  if ((j == 3) && (tmp_low_rpm >= 10) && (tmp_low_rpm < 51200) && (tmp_high_rpm >= 10) && (tmp_high_rpm < 51200) && (sweep_rate >= 1) && (sweep_rate < 51200) && (tmp_low_rpm < tmp_high_rpm)) {
-    mySUI.print(F("Sweeping from: "));
-    mySUI.print(tmp_low_rpm);
-    mySUI.print(F("<->"));
-    mySUI.print(tmp_high_rpm);
-    mySUI.print(F(" at: "));
-    mySUI.print(sweep_rate);
-    mySUI.println(F(" RPM/sec"));
-
-    compute_sweep_stages(&tmp_low_rpm, &tmp_high_rpm);
+  if ((j == 3) && (tmp_low_rpm >= 10) && (tmp_low_rpm < 51200) && (tmp_high_rpm >= 10) && (tmp_high_rpm < 51200) && (e->sweep_rate >= 1) && (e->sweep_rate < 51200) && (tmp_low_rpm < tmp_high_rpm)) {
+    Serial.print(F("Sweeping from: "));
+    Serial.print(tmp_low_rpm);
+    Serial.print(F("<->"));
+    Serial.print(tmp_high_rpm);
+    Serial.print(F(" at: "));
+    Serial.print(e->sweep_rate);
+    Serial.println(F(" RPM/sec"));
+
+    compute_sweep_stages(e, &tmp_low_rpm, &tmp_high_rpm);
   } else {
-    mySUI.returnError(F("Range error !(10-50000,10-50000,1-50000)!"));
+    console_error(F("Range error !(10-50000,10-50000,1-50000)!"));
   }
 }
+#endif
 
 
-void compute_sweep_stages(uint16_t *tmp_low_rpm, uint16_t *tmp_high_rpm) {
-  uint8_t total_stages;
-  uint32_t low_rpm_tcnt;
-  uint32_t high_rpm_tcnt;
+//! Parses input from user and switches to tach-follow mode
+/*!
+ * Takes "pulses per rev,slew rate(rpm/sec)" and regenerates the selected
+ * wheel at the RPM measured on the tach input (D3)
+ */
+void tach_follow_cb() {
+  engine *e = &engines[active_engine];
+  uint16_t ppr;
+  uint16_t slew;
+  uint8_t j;
 
-  /* Spin until unlocked, then lock */
-  while (sweep_lock)
+  j = sscanf(console_args(), "%i,%i", &ppr, &slew);
+  if ((j != 2) || (ppr < 1) || (ppr > 255) || (slew < 1)) {
+    console_error(F("Range error !(1-255,1-65535)!"));
+    return;
+  }
+  /* Spinlock */
+  while (e->sweep_lock)
     _delay_us(1);
-  sweep_lock = true;
+  e->sweep_lock = true;
+  e->staged.rpm = false; /* A staged fixed RPM would stop tach follow */
+  start_tach_follow(e, ppr, slew);
+  e->sweep_lock = false;
+  refresh_bitstream();
+  display_rpm_info();
+}
 
-  // Get OC Register values for begin/end points
-  low_rpm_tcnt = (uint32_t)(8000000.0 / (((float)(*tmp_low_rpm)) * Wheels[selected_wheel].rpm_scaler));
-  high_rpm_tcnt = (uint32_t)(8000000.0 / (((float)(*tmp_high_rpm)) * Wheels[selected_wheel].rpm_scaler));
 
-  // Get number of frequency doublings, rounding
-  total_stages = (uint8_t)ceil(log((float)(*tmp_high_rpm) / (float)(*tmp_low_rpm)) / (2 * LOG_2));
-  if (SweepSteps)
-    free(SweepSteps);
-  /* Debugging 
-  mySUI.print(F("low TCNT: "));
-  mySUI.println(low_rpm_tcnt);
-  mySUI.print(F("high rpm raw TCNT: "));
-  mySUI.println(high_rpm_tcnt);
-  */
-  SweepSteps = build_sweep_steps(&low_rpm_tcnt, &high_rpm_tcnt, &total_stages);
+//! Shows the clock correction in use
+void print_clock_ppm() {
+  Serial.print(F("Clock correction: "));
+  Serial.print(clock_ppm);
+  Serial.print(F(" ppm ("));
+  Serial.print(half_clock);
+  Serial.println(F(" ticks per half second)"));
+}
 
-  /* VERY BROKEN CODE 
-    SweepSteps[i+1].prescaler_bits = SweepSteps[i].prescaler_bits;
-    SweepSteps[i+1].ending_ocr = SweepSteps[i].ending_ocr;
-    SweepSteps[i].ending_ocr =  (0.38 * (float)(SweepSteps[i].beginning_ocr - SweepSteps[i].ending_ocr)) + SweepSteps[i].ending_ocr;
-    SweepSteps[i+1].beginning_ocr = SweepSteps[i].ending_ocr;
-  }
-  */
 
-  for (uint8_t i = 0; i < total_stages; i++) {
-    uint16_t this_step_low_rpm = get_rpm_from_tcnt(&SweepSteps[i].beginning_ocr, &SweepSteps[i].prescaler_bits);
-    uint16_t this_step_high_rpm = get_rpm_from_tcnt(&SweepSteps[i].ending_ocr, &SweepSteps[i].prescaler_bits);
-    /* How much RPM changes this stage */
-    uint16_t rpm_span_this_stage = this_step_high_rpm - this_step_low_rpm;
-    /* How much TCNT changes this stage */
-    uint16_t steps = (uint16_t)(1000 * (float)rpm_span_this_stage / (float)sweep_rate);
-    float per_isr_tcnt_change = (float)(SweepSteps[i].beginning_ocr - SweepSteps[i].ending_ocr) / steps;
-    uint32_t scaled_remainder = (uint32_t)(FACTOR_THRESHOLD * (per_isr_tcnt_change - (uint16_t)per_isr_tcnt_change));
-    SweepSteps[i].tcnt_per_isr = (uint16_t)per_isr_tcnt_change;
-    SweepSteps[i].remainder_per_isr = scaled_remainder;
-
-    /* Debugging
-    mySUI.print(F("sweep step: "));
-    mySUI.println(i);
-    mySUI.print(F("steps: "));
-    mySUI.println(steps);
-    mySUI.print(F("Beginning tcnt: "));
-    mySUI.print(SweepSteps[i].beginning_ocr);
-    mySUI.print(F(" for RPM: "));
-    mySUI.println(this_step_low_rpm);
-    mySUI.print(F("ending tcnt: "));
-    mySUI.print(SweepSteps[i].ending_ocr);
-    mySUI.print(F(" for RPM: "));
-    mySUI.println(this_step_high_rpm);
-    mySUI.print(F("prescaler bits: "));
-    mySUI.println(SweepSteps[i].prescaler_bits);
-    mySUI.print(F("tcnt_per_isr: "));
-    mySUI.println(SweepSteps[i].tcnt_per_isr);
-    mySUI.print(F("scaled remainder_per_isr: "));
-    mySUI.println(SweepSteps[i].remainder_per_isr);
-    mySUI.print(F("FP TCNT per ISR: "));
-    mySUI.println(per_isr_tcnt_change,6);
-    mySUI.print(F("End of step: "));
-    mySUI.println(i);
-    */
-  }
-  total_sweep_stages = total_stages;
-  /*
-  mySUI.print(F("Total sweep stages: "));
-  mySUI.println(total_sweep_stages);
-  */
-  /* Reset params for Timer2 ISR */
-  sweep_stage = 0;
-  sweep_direction = ASCENDING;
-  sweep_reset_prescaler = true;
-  new_OCR1A = SweepSteps[sweep_stage].beginning_ocr;
-  oc_remainder = 0;
-  mode = LINEAR_SWEPT_RPM;
-  fixed = false;
-  swept = true;
-  sweep_high_rpm = *tmp_high_rpm;
-  sweep_low_rpm = *tmp_low_rpm;
-  sweep_lock = false;
-}
-
-
-//! Gets RPM from the TCNT value
+//! Shows or sets the clock correction
 /*!
- * Gets the RPM value based on the passed TCNT and prescaler
- * \param tcnt pointer to Output Compare register value
- * \param prescaler_bits point to prescaler bits enum
+ * Takes the correction in ppm, positive when the board's clock runs fast.
+ * It is stored in EEPROM and anything running is retimed, see
+ * calibration.h. Without an argument it just shows the one in use.
  */
-uint16_t get_rpm_from_tcnt(uint16_t *tcnt, uint8_t *prescaler_bits) {
-  //extern wheels Wheels[];
-  uint8_t bitshift;
-  bitshift = get_bitshift_from_prescaler(prescaler_bits);
-  return (uint16_t)((float)(8000000 >> bitshift) / (Wheels[selected_wheel].rpm_scaler * (*tcnt)));
+void clock_ppm_cb() {
+  int ppm;
+
+  if (*console_args() && ((sscanf(console_args(), "%i", &ppm) != 1) || !set_clock_ppm(ppm))) {
+    console_error(F("Range error !(-10000-10000)!"));
+    return;
+  }
+  print_clock_ppm();
 }
 
 
-//! Gets bitshift value from prescaler enumeration
+//! Corrects the clock from a measured output
 /*!
- * Gets the bit shift value based on the prescaler enumeration passed
- * \param prescaler_bits the enumeration to analyze
- * \returns the necessary bitshift associated with the prescale value
+ * Takes what a fixed RPM output should be and what it was measured at,
+ * in any unit as long as both are the same (e.g. mHz of the crank signal
+ * off a frequency counter, or edges counted by the host over a timed
+ * interval). 10 ppm needs the measurement good to 5 or 6 digits.
  */
-uint8_t get_bitshift_from_prescaler(uint8_t *prescaler_bits) {
-  switch (*prescaler_bits) {
-    case PRESCALE_1024:
-      return 10;
-    case PRESCALE_256:
-      return 8;
-    case PRESCALE_64:
-      return 6;
-    case PRESCALE_8:
-      return 3;
-    case PRESCALE_1:
-      return 0;
-  }
-  return 0;
+void clock_trim_cb() {
+  uint32_t target;
+  uint32_t measured;
+
+  if ((sscanf(console_args(), "%lu,%lu", &target, &measured) != 2) || !target || !measured) {
+    console_error(F("Range error !(target,measured)!"));
+    return;
+  }
+  if (!set_clock_ppm(trimmed_clock_ppm(target, measured))) {
+    console_error(F("Correction over 10000 ppm, check the measurement"));
+    return;
+  }
+  print_clock_ppm();
+}
+
+
+#if CONFIG_SWEEP
+void compute_sweep_stages(engine *e, uint16_t *tmp_low_rpm, uint16_t *tmp_high_rpm) {
+  e->staged.rpm = false; /* A staged fixed RPM would stop the sweep */
+  /* Spin until unlocked, then lock */
+  while (e->sweep_lock)
+    _delay_us(1);
+  e->sweep_lock = true;
+  setup_sweep(e, *tmp_low_rpm, *tmp_high_rpm);
+  e->sweep_lock = false;
+  refresh_bitstream();
 }
+#endif
+
 
 //! Shift Signal on the CAM Signal (8 Bits)
 /*!
- * Prompts user for direction to shift bits on the CAM Signal Bits
+ * Takes the number of bits to shift the CAM Signal Bits by
  */
 void shift_cam_left() {
-  mySUI.showEnterNumericDataPrompt();
-  uint32_t newBitShift = mySUI.parseULong();
-  camSignalBitShift = newBitShift;
+  uint32_t newBitShift = console_ulong();
+  stage_begin(&engines[active_engine])->camSignalBitShift = newBitShift;
+  stage_end(&engines[active_engine]);
+  print_commit(&engines[active_engine]);
 }
 void shift_cam_right() {
-  mySUI.showEnterNumericDataPrompt();
-  uint32_t newBitShift = mySUI.parseULong();
-  camSignalBitShift = -newBitShift;
+  uint32_t newBitShift = console_ulong();
+  stage_begin(&engines[active_engine])->camSignalBitShift = -newBitShift;
+  stage_end(&engines[active_engine]);
+  print_commit(&engines[active_engine]);
+}
+
+
+//! Parses "pin,track,invert" and reroutes that pin
+/*!
+ * Tracks are 1-8 for crank1-8, 9-16 for cam1-8 and 0 to stop driving the
+ * pin, takes effect on the next edge
+ */
+void route_pin_cb() {
+  uint16_t pin;
+  uint16_t track;
+  uint16_t invert;
+  uint8_t j;
+
+  j = sscanf(console_args(), "%i,%i,%i", &pin, &track, &invert);
+  if ((j != 3) || (pin >= NUM_DIGITAL_PINS) || (track > ROUTE_TRACKS) || (invert > 1)) {
+    console_error(F("Range error !(pin,0-16,0-1)!"));
+    return;
+  }
+  if (!route_pin(pin, track ? track - 1 : ROUTE_NONE, invert)) {
+    console_error(F("Pin can't be routed"));
+    return;
+  }
+  refresh_routing();
+  list_routes_cb();
+}
+
+
+//! Lists every routed pin and the track driving it
+void list_routes_cb() {
+  for (uint8_t pin = 0; pin < NUM_DIGITAL_PINS; pin++) {
+    uint8_t route = get_route(pin);
+    uint8_t track;
+
+    if (route == ROUTE_NONE)
+      continue;
+    track = route & ROUTE_TRACK_MASK;
+    Serial.print(F("Pin "));
+    Serial.print(pin);
+    Serial.print((track < ROUTE_CAM_TRACK) ? F(": crank") : F(": cam"));
+    Serial.print((track % ROUTE_CAM_TRACK) + 1);
+    if (route & ROUTE_INVERT)
+      Serial.print(F(" inverted"));
+    Serial.println(F(""));
+  }
+}
+
+
+//! Restores the standard pin layout
+void default_routes_cb() {
+  route_defaults();
+  refresh_routing();
+  list_routes_cb();
+}
+
+
+//! Toggles ECU output capture
+/*!
+ * While enabled every edge on the capture inputs is streamed as a binary
+ * record (see capture.h) in between any console output
+ */
+void toggle_capture_cb() {
+  Serial.print(F("ECU Capture: "));
+  if (capture_enabled) {
+    set_capture(false);
+    Serial.print(F("Disabled, records lost: "));
+    Serial.println(capture_overruns);
+  } else {
+    capture_overruns = 0;
+    Serial.println(F("Enabled"));
+    set_capture(true);
+  }
+}
+
+
+//! Toggles the extended (32 bit virtual compare) timer mode
+/*!
+ * Extended mode leaves the pattern timer at /1 and counts long periods off
+ * in software instead of switching prescalers, so low RPM keeps full
+ * resolution and sweeps don't jump at octave boundaries. A running sweep
+ * is parked at its low RPM and rebuilt for the new mode. Engine 1 can't
+ * switch to it while it's a sync slave (sync.h).
+ */
+void toggle_extended_timer_cb() {
+  engine *e = &engines[active_engine];
+#if CONFIG_SWEEP
+  bool was_swept = (e->mode == LINEAR_SWEPT_RPM);
+#endif
+
+  if (!e->extended && (e == &engines[ENGINE_1]) && (sync_mode == SYNC_SLAVE)) {
+    console_error(F("Unavailable as a sync slave"));
+    return;
+  }
+#if CONFIG_SWEEP
+
+  if (was_swept)
+  {
+    e->mode = FIXED_RPM; /* Stops the sweeper touching this engine */
+    reset_new_OCR1A(e, e->sweep_low_rpm);
+  }
+  set_extended_timer(e, !e->extended);
+  if (was_swept)
+    compute_sweep_stages(e, &e->sweep_low_rpm, &e->sweep_high_rpm);
+#else
+  set_extended_timer(e, !e->extended);
+#endif
+  Serial.print(F("Extended Timer: "));
+  if (e->extended)
+    Serial.println(F("Enabled (timer at /1, 32 bit compare)"));
+  else
+    Serial.println(F("Disabled (prescaled)"));
+}
+
+
+#if CONFIG_SWEEP
+//! Runs Timer2 only while a running engine sweeps from it
+/*!
+ * Engine 1 always runs, engine 2 only counts in twin engine mode
+ * \returns true when Timer2 runs the sweeper
+ */
+bool update_sweeper() {
+  bool sweeper = !engines[ENGINE_1].edge_sweep;
+
+#if NUM_ENGINES > 1
+  if (twin_engine && !engines[ENGINE_2].edge_sweep)
+    sweeper = true;
+#endif
+  hal_sweeper(sweeper);
+  return sweeper;
+}
+
+
+//! Toggles sweeping the active engine from its own edge ISR
+/*!
+ * The RPM is then updated EDGE_SWEEP_UPDATES times per revolution by the
+ * edge ISR instead of 1000x/second by Timer2, see sweep_update(). Timer2
+ * stops once no engine needs it. A running sweep is rebuilt as the stages
+ * carry the per update factors.
+ */
+void toggle_edge_sweep_cb() {
+  engine *e = &engines[active_engine];
+  bool was_swept = (e->mode == LINEAR_SWEPT_RPM);
+  bool sweeper;
+
+  if (was_swept)
+  {
+    e->mode = FIXED_RPM; /* Stops both sweepers touching this engine */
+    reset_new_OCR1A(e, e->sweep_low_rpm);
+  }
+  e->edge_sweep = !e->edge_sweep;
+  if (was_swept)
+    compute_sweep_stages(e, &e->sweep_low_rpm, &e->sweep_high_rpm);
+  sweeper = update_sweeper();
+  Serial.print(F("Edge Sweep: "));
+  if (e->edge_sweep)
+    Serial.println(F("Enabled (RPM updated from the edge ISR)"));
+  else
+    Serial.println(F("Disabled (Timer2 sweeper)"));
+  Serial.print(F("Timer2: "));
+  Serial.println(sweeper ? F("sweeper") : F("free"));
 }
+#endif
 
 
-void do_exit() {
-  // though you can always just use the "quit" command from
-  // the top level menu, this demonstrates using exit(), which
-  // will automatically close the Druid4Arduino GUI, if
-  // being used.
-  mySUI.print(F("Exit requested, terminating GUI if present"));
-  mySUI.exit();
+#ifdef WIDE_OUTPUT_SUPPORTED
+//! Toggles the Mega wide (24 channel) output mode
+/*!
+ * Switches between the standard PORTA/PORTB/PORTC layout and the wide
+ * layout where every port value is precomputed per edge, see wide_output.h
+ */
+void toggle_wide_output_cb() {
+  Serial.print(F("Wide Output: "));
+  if (set_wide_output(!wide_output))
+    Serial.println(F("Enabled (PORTA crank, PORTC cam, PORTL aux)"));
+  else if (twin_engine)
+    Serial.println(F("Unavailable in twin engine mode"));
+  else if (bitstream_output)
+    Serial.println(F("Unavailable with bitstream output"));
+  else if (aux_speed_active())
+    Serial.println(F("Unavailable while the speed output runs"));
+  else
+    Serial.println(F("Disabled"));
 }
+#endif
+
+
+#ifdef BITSTREAM_SUPPORTED
+//! Toggles shifting the engine 1 crank track out of USART3
+/*!
+ * Swaps the Timer1 edge ISR for the USART3 MSPIM bitstream, see bitstream.h
+ */
+void toggle_bitstream_cb() {
+  Serial.print(F("Bitstream Output: "));
+  if (set_bitstream(!bitstream_output))
+    Serial.println(F("Enabled (crank1 on D14)"));
+  else if (wide_output)
+    Serial.println(F("Unavailable in wide output mode"));
+  else if (engines[ENGINE_1].mode != FIXED_RPM)
+    Serial.println(F("Fixed RPM only"));
+  else {
+    Serial.print(F("Disabled, underruns: "));
+    Serial.println(bitstream_underruns);
+  }
+}
+#endif
+
+
+//! Hands engine 1 over to a host streamed pattern
+/*!
+ * Takes whether every edge carries its own duration, then switches
+ * the serial port to STREAM_BAUD until the host ends the stream (or goes
+ * quiet for STREAM_TIMEOUT_MS), see stream.h
+ */
+void stream_pattern_cb() {
+  uint32_t durations = console_ulong();
+  if (durations > 1) {
+    console_error(F("Durations must be 0 or 1"));
+    return;
+  }
+  if (!stream_available()) {
+    console_error(F("Unavailable in wide, bitstream or extended mode"));
+    return;
+  }
+  Serial.print(F("Streaming at "));
+  Serial.print(STREAM_BAUD);
+  Serial.println(F(" baud"));
+  run_stream(durations);
+  Serial.print(F("Stream ended, underruns: "));
+  Serial.println(stream_underruns);
+}
+
+
+#ifdef AUX_SUPPORTED
+//! Sets the speed output, takes "hz,ramp(hz/sec)"
+void aux_speed_cb() {
+  uint16_t hz;
+  uint16_t ramp;
+
+  if ((sscanf(console_args(), "%u,%u", &hz, &ramp) != 2) || (hz > AUX_MAX_SPEED_HZ)) {
+    console_error(F("Range error !(0-20000,0-65535)!"));
+    return;
+  }
+  if (!set_aux_speed(hz, ramp)) {
+    console_error(F("Unavailable in twin engine or wide output mode"));
+    return;
+  }
+  Serial.print(F("Speed: "));
+  Serial.print(aux_speed_now());
+  Serial.print(F(" -> "));
+  Serial.print(hz);
+  Serial.print(F(" Hz at "));
+  Serial.print(ramp);
+  Serial.println(F(" Hz/sec"));
+}
+
+
+//! Sets the MAP output, takes "mean %,pulsation %,pulses/720 degrees"
+void aux_map_cb() {
+  uint16_t mean;
+  uint16_t depth;
+  uint16_t pulses;
+
+  if ((sscanf(console_args(), "%u,%u,%u", &mean, &depth, &pulses) != 3) || (mean > 100) || (depth > 100) || (pulses > 16)) {
+    console_error(F("Range error !(0-100,0-100,0-16)!"));
+    return;
+  }
+  set_aux_map(mean, depth, pulses);
+  Serial.print(F("MAP: "));
+  Serial.print(mean);
+  Serial.print(F("% +/- "));
+  Serial.print(depth / 2);
+  Serial.print(F("%, "));
+  Serial.print(pulses);
+  Serial.println(F(" pulses/720 degrees"));
+}
+
+
+//! Sets the TPS output, takes a percentage
+void aux_tps_cb() {
+  uint32_t percent = console_ulong();
+
+  if (percent > 100) {
+    console_error(F("Range error !(0-100)!"));
+    return;
+  }
+  set_aux_tps(percent);
+  Serial.print(F("TPS: "));
+  Serial.print(percent);
+  Serial.println(F("%"));
+}
+
+
+//! Arms knock bursts, takes "angle,width(degrees),bursts"
+void aux_knock_cb() {
+  uint16_t angle;
+  uint16_t width;
+  uint16_t cycles;
+
+  if ((sscanf(console_args(), "%u,%u,%u", &angle, &width, &cycles) != 3) || !set_aux_knock(angle, width, cycles)) {
+    console_error(F("Range error, angle and width within the wheel's degrees"));
+    return;
+  }
+  Serial.print(F("Knock: "));
+  if (!width) {
+    Serial.println(F("Off"));
+    return;
+  }
+  Serial.print(width);
+  Serial.print(F(" degrees from "));
+  Serial.print(angle);
+  Serial.print(F(", bursts: "));
+  if (cycles)
+    Serial.println(cycles);
+  else
+    Serial.println(F("every cycle"));
+}
+#endif
+
+
+#ifdef VR_SUPPORTED
+//! Starts the VR output, takes the rpm it reaches full amplitude at (0 off)
+void vr_output_cb() {
+  uint32_t rpm = console_ulong();
+
+  if (rpm > 65535) {
+    console_error(F("Range error !(0-65535)!"));
+    return;
+  }
+  if (!set_vr_output(rpm)) {
+    console_error(F("Unavailable in twin engine mode"));
+    return;
+  }
+  Serial.print(F("VR output: "));
+  if (!vr_output) {
+    Serial.println(F("Off"));
+    return;
+  }
+  Serial.print(F("full amplitude at "));
+  Serial.print(vr_full_rpm);
+  Serial.println(F(" RPM"));
+}
+#endif
+
+
+#if NUM_ENGINES > 1
+//! Starts/stops engine 2 on Timer3
+void toggle_twin_engine_cb() {
+  Serial.print(F("Twin Engine: "));
+  if (set_twin_engine(!twin_engine))
+    Serial.println(F("Enabled (engine 2: PORTK crank, PORTL cam)"));
+  else if (wide_output)
+    Serial.println(F("Unavailable in wide output mode"));
+  else if (aux_speed_active())
+    Serial.println(F("Unavailable while the speed output runs"));
+  else if (vr_output)
+    Serial.println(F("Unavailable while the VR output runs"));
+  else
+    Serial.println(F("Disabled"));
+#if CONFIG_SWEEP
+  update_sweeper(); /* Engine 2 may need Timer2, or no longer does */
+#endif
+}
+
+
+//! Takes the engine (1-2) the commands should act on
+/*!
+ * Every wheel, RPM, sweep, direction and invert command after this applies
+ * to the chosen engine only
+ */
+void select_engine_cb() {
+  uint32_t newEngine = console_ulong();
+  if ((newEngine < 1) || (newEngine > NUM_ENGINES)) {
+    console_error(F("Engine out of range"));
+    return;
+  }
+  active_engine = newEngine - 1;
+  Serial.print(F("Configuring engine: "));
+  Serial.println(active_engine + 1);
+  display_rpm_info();
+}
+#endif
+
+
+//! Leaves multi-board sync
+void sync_off_cb() {
+  set_sync_mode(SYNC_OFF);
+  Serial.println(F("Sync: Off"));
+}
+
+
+//! Becomes the sync master, pulse out on A1 (328P) or D4 (Mega)
+void sync_master_cb() {
+  set_sync_mode(SYNC_MASTER);
+  Serial.println(F("Sync: Master"));
+}
+
+
+//! Becomes a sync slave, pulse in on D2
+void sync_slave_cb() {
+  if (!set_sync_mode(SYNC_SLAVE)) {
+    console_error(F("Unavailable in extended timer mode"));
+    return;
+  }
+  Serial.print(F("Sync: Slave, offset "));
+  Serial.print(sync_offset);
+  Serial.println(F(" edges"));
+}
+
+
+//! Takes the slave phase offset in edges
+/*!
+ * The offset is the slave wheel edge that should line up with the
+ * master's edge 0, i.e. (degrees offset * wheel_max_edges) / wheel degrees
+ */
+void sync_offset_cb() {
+  engine *e = &engines[ENGINE_1];
+  uint32_t newOffset = console_ulong();
+  if (newOffset >= Wheels[e->selected_wheel].wheel_max_edges) {
+    console_error(F("Offset past the end of the wheel"));
+    return;
+  }
+  sync_offset = newOffset;
+  Serial.print(F("Sync offset: "));
+  Serial.print(sync_offset);
+  Serial.println(F(" edges"));
+}
+
+
+//! Tells the user when staged changes go live
+void print_commit(engine *e) {
+  if (!e->staging)
+    return;
+  if (e->commit_armed) {
+    Serial.print(F("Goes live at "));
+    Serial.print(commit_angle);
+    Serial.println(F(" degrees"));
+  } else
+    Serial.println(F("Held, apply to arm"));
+}
+
+
+//! Takes the crank angle staged changes go live at
+/*!
+ * Rounded to the nearest edge, taken modulo the wheel's
+ * degrees. A commit already armed moves to the new angle.
+ */
+void commit_angle_cb() {
+  engine *e = &engines[active_engine];
+  uint32_t newAngle = console_ulong();
+  if (newAngle >= 720) {
+    console_error(F("Angle out of range (0-719)"));
+    return;
+  }
+  commit_angle = newAngle;
+  if (commit_disarm(e))
+    commit_arm(e);
+  Serial.print(F("Commit angle: "));
+  Serial.print(commit_angle);
+  Serial.println(F(" degrees"));
+}
+
+
+//! Toggles batching changes, releasing the hold arms the batch
+void toggle_commit_hold_cb() {
+  engine *e = &engines[active_engine];
+  commit_hold = !commit_hold;
+  Serial.print(F("Commit Hold: "));
+  if (commit_hold) {
+    Serial.println(F("Enabled (changes wait for Apply)"));
+    return;
+  }
+  Serial.println(F("Disabled"));
+  if (e->staging && !e->commit_armed)
+    commit_arm(e);
+  print_commit(e);
+}
+
+
+//! Arms the held changes of the active engine
+void commit_apply_cb() {
+  engine *e = &engines[active_engine];
+  if (!commit_arm(e)) {
+    console_error(F("Nothing staged"));
+    return;
+  }
+  if (e->staging)
+    print_commit(e);
+  else
+    Serial.println(F("Applied"));
+}
+
+
+//! Drops the staged changes of the active engine
+void commit_discard_cb() {
+  commit_discard(&engines[active_engine]);
+  Serial.println(F("Staged changes discarded"));
+}
+
+
+//! Shows the commit angle and what is staged on the active engine
+void commit_status_cb() {
+  engine *e = &engines[active_engine];
+  engine_config *c = &e->staged;
+  Serial.print(F("Commit angle: "));
+  Serial.print(commit_angle);
+  Serial.print(F(" degrees, hold: "));
+  Serial.println(commit_hold ? F("on") : F("off"));
+  if (!e->staging) {
+    Serial.println(F("Nothing staged"));
+    return;
+  }
+  Serial.print(F("Staged wheel: "));
+  Serial.print(c->selected_wheel + 1);
+  Serial.print(F(", invert crank: "));
+  Serial.print(c->crank_invert_mask);
+  Serial.print(F(", cam: "));
+  Serial.print(c->cam_invert_mask);
+  Serial.print(F(", cam shift: "));
+  Serial.print((int8_t)c->camSignalBitShift);
+  Serial.print(F(", direction: "));
+  Serial.println(c->normal ? F("normal") : F("reversed"));
+  if (c->rpm) {
+    Serial.print(F("Staged fixed RPM: "));
+    Serial.println(e->wanted_rpm);
+  }
+  print_commit(e);
+}
+
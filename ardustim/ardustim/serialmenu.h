@@ -23,8 +23,8 @@
 #ifndef __SERIAL_MENU_H__
 #define __SERIAL_MENU_H__
  
-#include <SerialUI.h>
-//#include "structures.h"
+#include <Arduino.h>
+#include "structures.h"
 
 /* Structures */
 
@@ -36,23 +36,54 @@ void select_previous_wheel_cb(void);
 void toggle_invert_primary_cb(void);
 void toggle_invert_secondary_cb(void);
 void list_wheels_cb(void);
+void catalog_hash_cb(void);
+void catalog_page_cb(void);
+void catalog_wheel_cb(void);
 void select_wheel_cb(void);
 void set_rpm_cb(void);
 void sweep_rpm_cb(void);
+void tach_follow_cb(void);
+void clock_ppm_cb(void);
+void clock_trim_cb(void);
 void reverse_wheel_direction_cb(void);
 void shift_cam_left(void);
 void shift_cam_right(void);
-void do_exit(void);
+void toggle_wide_output_cb(void);
+void toggle_bitstream_cb(void);
+void stream_pattern_cb(void);
+void aux_speed_cb(void);
+void aux_map_cb(void);
+void aux_tps_cb(void);
+void aux_knock_cb(void);
+void vr_output_cb(void);
+void toggle_extended_timer_cb(void);
+void toggle_edge_sweep_cb(void);
+void toggle_capture_cb(void);
+void toggle_twin_engine_cb(void);
+void select_engine_cb(void);
+void route_pin_cb(void);
+void list_routes_cb(void);
+void default_routes_cb(void);
+void sync_off_cb(void);
+void sync_master_cb(void);
+void sync_slave_cb(void);
+void sync_offset_cb(void);
+void commit_angle_cb(void);
+void toggle_commit_hold_cb(void);
+void commit_apply_cb(void);
+void commit_discard_cb(void);
+void commit_status_cb(void);
 /* Callbacks */
 
 /* General functions */
 void display_rpm_info(void);
+void print_clock_ppm(void);
 void serial_setup(void);
 void display_new_wheel(void);
 void print_normal(void);
 void print_inverted(void);
-void compute_sweep_stages(uint16_t *, uint16_t *);
-uint16_t get_rpm_from_tcnt(uint16_t *, uint8_t *);
-uint8_t get_bitshift_from_prescaler(uint8_t *);
+void print_commit(engine *);
+void compute_sweep_stages(engine *, uint16_t *, uint16_t *);
+bool update_sweeper(void);
 
 #endif
@@ -0,0 +1,233 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "bitstream.h"
+#include "defines.h"
+#include "enums.h"
+#include "frame.h"
+#include "hal.h"
+#include "loop.h"
+#include "stream.h"
+#include "structures.h"
+#include "wide_output.h"
+#include <Arduino.h>
+#include <util/atomic.h>
+
+extern engine engines[];
+
+volatile bool stream_active = false;
+volatile bool stream_durations = false;
+volatile uint16_t stream_underruns = 0;
+uint8_t stream_windows[STREAM_WINDOWS][STREAM_WINDOW_BYTES];
+volatile uint8_t stream_window_len[STREAM_WINDOWS]; /* Bytes */
+volatile uint8_t stream_filled = 0;   /* Windows queued for the ISR */
+volatile uint8_t stream_played = 0;   /* Windows played out, wraps */
+volatile uint8_t stream_play = 0;     /* ISR side, window and byte playing */
+volatile uint8_t stream_play_pos = 0;
+volatile uint8_t stream_crank = 0;
+volatile uint8_t stream_cam = 0;
+volatile uint16_t stream_ticks = 1000;
+
+static const hal_timer timer1 = HAL_TIMER(1);
+static uint16_t stream_bad = 0;
+
+/* Window parser states */
+enum {
+  WAIT_SYNC,
+  WAIT_TYPE,
+  WAIT_COUNT,
+  WAIT_EDGES,
+  WAIT_XOR,
+};
+
+
+/* Credit (or end) frame, see stream.h */
+static void send_credits(uint8_t type, uint8_t credits)
+{
+  uint16_t underruns;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    underruns = stream_underruns;
+  }
+  frame_start(type, 5);
+  frame_byte(credits);
+  frame_u16(underruns);
+  frame_u16(stream_bad);
+  frame_end();
+}
+
+
+//! Checks engine 1 goes through the routed Timer1 path a stream can use
+/*!
+ * Not with wide output, bitstream output or the extended timer
+ * \returns true if run_stream() would start
+ */
+bool stream_available() {
+#ifdef WIDE_OUTPUT_SUPPORTED
+  if (wide_output)
+    return false;
+#endif
+#ifdef BITSTREAM_SUPPORTED
+  if (bitstream_output)
+    return false;
+#endif
+  return !engines[ENGINE_1].extended;
+}
+
+
+//! Plays a host streamed pattern on engine 1 until the host ends it
+/*!
+ * Blocks (keeping the background work going) while the host streams, see
+ * stream.h for the protocol
+ * \param durations true if every edge carries its own duration
+ * \returns false if streaming isn't possible right now
+ */
+bool run_stream(bool durations) {
+  engine *e = &engines[ENGINE_1];
+  uint8_t edge_size = durations ? 4 : 2;
+  uint8_t state = WAIT_SYNC;
+  uint8_t count = 0;
+  uint8_t pos = 0;
+  uint8_t fill = 0;
+  uint8_t sum = 0;
+  uint8_t played_seen = 0;
+  uint8_t played;
+  uint8_t credits = 0;
+  bool ending = false;
+  uint32_t last_rx;
+
+  if (!stream_available())
+    return false;
+
+  Serial.flush();
+  Serial.begin(STREAM_BAUD);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    stream_filled = 0;
+    stream_played = 0;
+    stream_play = 0;
+    stream_play_pos = 0;
+    stream_underruns = 0;
+    stream_durations = durations;
+    if (durations)
+    {
+      hal_timer_prescale(&timer1, PRESCALE_8);
+      hal_timer_compare(&timer1, stream_ticks - 1);
+    }
+    stream_active = true;
+  }
+  stream_bad = 0;
+  send_credits('C', STREAM_WINDOWS);
+  last_rx = millis();
+
+  while (1)
+  {
+    service_background();
+    /* Windows played since the last pass, on top of any retry credits */
+    played = stream_played;
+    credits += (uint8_t)(played - played_seen);
+    played_seen = played;
+    if (credits)
+    {
+      send_credits('C', credits);
+      credits = 0;
+    }
+    if (ending && !stream_filled)
+      break;
+    if (!ending && !stream_filled && (millis() - last_rx > STREAM_TIMEOUT_MS))
+      break;
+    while (Serial.available())
+    {
+      uint8_t b = Serial.read();
+
+      last_rx = millis();
+      switch (state)
+      {
+        case WAIT_SYNC:
+          if (b == STREAM_WINDOW_SYNC)
+            state = WAIT_TYPE;
+          break;
+        case WAIT_TYPE:
+          sum = b;
+          state = (b == 'W') ? WAIT_COUNT : WAIT_SYNC;
+          break;
+        case WAIT_COUNT:
+          sum ^= b;
+          count = b;
+          pos = 0;
+          ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+          {
+            /* No free window means the host ignored its credits, drop it */
+            fill = (stream_filled < STREAM_WINDOWS) ? ((stream_play + stream_filled) & (STREAM_WINDOWS - 1)) : 0xFF;
+          }
+          if ((count > STREAM_WINDOW_BYTES / edge_size) || (count && (fill == 0xFF)))
+          {
+            stream_bad++;
+            state = WAIT_SYNC;
+            if (fill != 0xFF)
+              credits++; /* Bad header, the window is still free */
+          }
+          else
+            state = count ? WAIT_EDGES : WAIT_XOR;
+          break;
+        case WAIT_EDGES:
+          sum ^= b;
+          stream_windows[fill][pos++] = b;
+          if (pos == count * edge_size)
+            state = WAIT_XOR;
+          break;
+        case WAIT_XOR:
+          state = WAIT_SYNC;
+          if (b != sum)
+          {
+            stream_bad++;
+            if (count)
+              credits++; /* Window is still free, send it again */
+            break;
+          }
+          if (!count)
+          {
+            ending = true;
+            break;
+          }
+          stream_window_len[fill] = pos;
+          ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+          {
+            stream_filled++;
+          }
+          break;
+      }
+    }
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    stream_active = false;
+    e->reset_prescaler = true; /* Back to the engine's own clock select */
+  }
+  send_credits('E', 0);
+  Serial.flush();
+  Serial.begin(SERIAL_BAUD);
+  return true;
+}
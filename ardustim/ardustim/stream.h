@@ -0,0 +1,121 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <inttypes.h>
+
+/* Host streamed patterns (engine 1)
+ *
+ * For edge sequences too long for flash, e.g. 0.25 degree wheels or
+ * recorded engine traces. The stream command takes "durations(0-1)",
+ * answers, then switches the port to STREAM_BAUD and the host sends
+ * windows of edges:
+ *   0x5A, 'W', count, count edges, xor of everything after the sync
+ * An edge is the crank and cam track bytes (like the wheel arrays, routed,
+ * inverted and cam shifted as usual) and with durations the time to the
+ * next edge in 0.5us ticks (Timer1 at /8), low byte first. Without
+ * durations the edges run at engine 1's fixed/swept RPM. A count of 0
+ * ends the stream once the queued windows have played out, so does
+ * STREAM_TIMEOUT_MS without any data.
+ *
+ * Flow control is by credits, the host may only have as many windows in
+ * flight as it got credits for. A 'C' frame (frame.h) hands out the
+ * credits for every window played out (or dropped for a bad checksum or
+ * an oversize count, to be sent again) since the last one, the first one
+ * all STREAM_WINDOWS:
+ *   credits u8, underruns u16, bad windows u16
+ * and the end with an 'E' frame with the same payload, after which the
+ * port is back at SERIAL_BAUD on the console. An empty ring when an edge is due
+ * is an underrun, the outputs hold and the edge is due again a period
+ * later.
+ *
+ * At 1 Mbaud that's ~48000 edges/sec (~24000 with durations), e.g.
+ * 2000 RPM of a 1440 edge (0.25 degree) wheel. The smaller ring on the
+ * 328P only rides out a short USB latency at those rates, watch the
+ * underrun count.
+ */
+#define STREAM_BAUD 1000000
+#define STREAM_TIMEOUT_MS 2000
+#define STREAM_WINDOW_SYNC 0x5A
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#define STREAM_WINDOWS 8        /* Power of 2 */
+#define STREAM_WINDOW_BYTES 240 /* Multiple of 4, < 256 */
+#else
+#define STREAM_WINDOWS 2        /* Power of 2 */
+#define STREAM_WINDOW_BYTES 128 /* Multiple of 4, < 256 */
+#endif
+
+extern volatile bool stream_active;
+extern volatile bool stream_durations;
+extern volatile uint16_t stream_underruns;
+extern uint8_t stream_windows[STREAM_WINDOWS][STREAM_WINDOW_BYTES];
+extern volatile uint8_t stream_window_len[STREAM_WINDOWS];
+extern volatile uint8_t stream_filled;
+extern volatile uint8_t stream_played;
+extern volatile uint8_t stream_play;
+extern volatile uint8_t stream_play_pos;
+extern volatile uint8_t stream_crank;
+extern volatile uint8_t stream_cam;
+extern volatile uint16_t stream_ticks;
+
+bool stream_available(void);
+bool run_stream(bool);
+
+
+/* Next streamed edge for the Timer1 ISR, sets stream_crank/cam (and
+ * stream_ticks) or leaves them as they were on an underrun
+ */
+static inline void stream_next_edge(void)
+{
+  uint8_t play = stream_play;
+  uint8_t pos = stream_play_pos;
+  const uint8_t *edge;
+
+  if (!stream_filled)
+  {
+    stream_underruns++;
+    return;
+  }
+  edge = &stream_windows[play][pos];
+  stream_crank = edge[0];
+  stream_cam = edge[1];
+  if (stream_durations)
+  {
+    stream_ticks = edge[2] | (edge[3] << 8);
+    pos += 4;
+  }
+  else
+    pos += 2;
+  if (pos >= stream_window_len[play])
+  {
+    pos = 0;
+    stream_play = (play + 1) & (STREAM_WINDOWS - 1);
+    stream_filled--;
+    stream_played++;
+  }
+  stream_play_pos = pos;
+}
+
+#endif
@@ -34,6 +34,89 @@ struct _sweep_step {
   uint8_t prescaler_bits;
   uint32_t remainder_per_isr;
   uint16_t tcnt_per_isr;
+  uint32_t update_factor;  /* Edge sweep, OC change per update per OC tick, 8.24 */
+};
+
+/* A batch of engine settings staged to go live together at one crank
+ * angle, see commit.h
+ */
+typedef struct _engine_config engine_config;
+struct _engine_config {
+  uint8_t selected_wheel;
+  uint8_t crank_invert_mask;
+  uint8_t cam_invert_mask;
+  uint8_t camSignalBitShift;
+  bool normal;
+  uint16_t edge_counter;   /* Edge of the new wheel at the commit angle */
+  bool new_wheel;          /* Wheel differs from the live one */
+  bool rpm;                /* Fixed RPM period below staged too */
+  bool ramp;               /* Or the sweep/tach RPM's period on the new wheel */
+  uint16_t new_OCR1A;
+  uint16_t ocr_fraction;
+  uint8_t prescaler_bits;
+  uint16_t ext_chunks;
+  uint16_t ext_final;
+};
+
+/* Everything needed to run one simulated engine off one pattern timer.
+ * Engine 1 runs on Timer1, engine 2 (Mega twin engine mode) on Timer3.
+ * Fields marked volatile are used in ISR's
+ */
+typedef struct _engine engine;
+struct _engine {
+  volatile uint8_t selected_wheel;
+  volatile uint8_t camSignalBitShift;
+  volatile uint8_t crank_invert_mask;  /* Per crank track, bit 0 crank1 */
+  volatile uint8_t cam_invert_mask;    /* Per cam track (after the cam shift), bit 0 cam1 */
+  volatile bool normal;
+  volatile uint16_t edge_counter;
+  volatile uint16_t new_OCR1A;      /* Next compare value (OCR3A for engine 2) */
+  volatile uint8_t prescaler_bits;
+  volatile uint8_t last_prescaler_bits;
+  volatile bool reset_prescaler;
+  volatile uint16_t ocr_fraction;      /* Fractional tick per edge, 1/65536 */
+  volatile uint16_t ocr_fraction_acc;  /* ISR side, dither accumulator */
+  volatile uint8_t mode;
+  /* Extended (32 bit virtual) compare, timer left at /1, see sweep.cpp */
+  volatile bool extended;
+  volatile uint16_t ext_chunks;        /* Idle EXT_CHUNK_TICKS compares per edge */
+  volatile uint16_t ext_final;         /* Compare value of the edge emitting chunk */
+  volatile uint16_t ext_chunks_left;   /* ISR side, idle chunks left this edge */
+  volatile uint16_t ext_final_latched; /* ISR side, ext_final (+trim) for this edge */
+  /* Sweeper state */
+  volatile bool edge_sweep;            /* Swept by the edge ISR instead of Timer2 */
+  volatile uint8_t sweep_edges;        /* Edge sweep, edges between updates */
+  volatile uint8_t sweep_edges_left;   /* ISR side, edges to the next update */
+  volatile bool sweep_lock;
+  volatile bool sweep_reset_prescaler; /* Force sweep to reset prescaler value */
+  volatile uint8_t sweep_direction;
+  volatile uint8_t total_sweep_stages;
+  volatile int8_t sweep_stage;
+  volatile uint8_t fraction;
+  volatile uint32_t oc_remainder;
+  sweep_step *SweepSteps;
+  /* Staged configuration commit, see commit.h */
+  volatile bool commit_armed;
+  volatile bool commit_applied;        /* ISR side, for commit_service() */
+  volatile uint16_t commit_edge;       /* Edge (current wheel) the commit goes live at */
+  volatile bool staging;               /* staged holds a batch that isn't live yet */
+  engine_config staged;
+  /* Less sensitive, UI side */
+  uint32_t wanted_rpm;
+  uint16_t sweep_low_rpm;
+  uint16_t sweep_high_rpm;
+  uint16_t sweep_rate;
+};
+
+/* Snapshot of an ECU output edge (capture.cpp), turned into a crank angle
+ * outside of the ISR
+ */
+typedef struct _capture_event capture_event;
+struct _capture_event {
+  uint8_t flags;          /* CAPTURE_* channel/level/pending bits */
+  uint16_t edge_counter;  /* Engine 1 edge_counter at the time */
+  uint16_t tcnt;          /* TCNT1 at the time */
+  uint16_t ocr;           /* OCR1A at the time */
 };
 
 /* Tie things wheel related into one nicer structure ... */
@@ -44,6 +127,34 @@ struct _wheels {
   const unsigned char *edge_crank_ptr PROGMEM;
   const float rpm_scaler;
   const uint16_t wheel_max_edges;
+  const unsigned char *edge_aux_ptr PROGMEM; /* Optional 3rd track (Mega wide output), NULL if unused */
+};
+
+/* Fixed size wheel catalog record (wheel_catalog.h, tools/gen_catalog.py),
+ * sent as is so keep it packed, little endian like the AVR
+ */
+typedef struct _wheel_record wheel_record;
+struct _wheel_record {
+  uint16_t name_offset;  /* Into the NUL terminated names in wheel order */
+  uint16_t edges;
+  uint16_t degrees;      /* 360 or 720 */
+  uint8_t channels;      /* Output bits used across all tracks */
+  uint8_t flags;         /* CATALOG_* (catalog.h) */
+};
+
+/* Clock correction as kept in EEPROM (calibration.h) */
+typedef struct _clock_cal clock_cal;
+struct _clock_cal {
+  uint16_t magic;          /* CLOCK_CAL_MAGIC once written */
+  int16_t ppm;
+};
+
+/* Serial console command (console.h), tables of these live in flash */
+typedef struct _console_command console_command;
+struct _console_command {
+  const char *name;        /* PROGMEM, lower case */
+  void (*handler)(void);   /* Gets its arguments from console_args() */
+  const char *help;        /* PROGMEM */
 };
 
 
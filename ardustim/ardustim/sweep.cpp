@@ -20,9 +20,15 @@
  *
  */
 
+#include "calibration.h"
+#include "defines.h"
 #include "enums.h"
 #include "sweep.h"
+#include <math.h>
 #include <stdlib.h>
+#include <util/atomic.h>
+
+uint32_t half_clock = NOMINAL_HALF_CLOCK; /* Trimmed by calibration.cpp */
 
 
 //! Builds the SweepSteps[] structure
@@ -37,17 +43,19 @@
  * \param low_rpm_tcnt pointer to low rpm OC value, (not prescaled!)
  * \param high_rpm_tcnt pointer to low rpm OC value, (not prescaled!)
  * \param total_stages pointer to tell the number of structs to allocate
+ * \param extended true for extended timer mode, prescaler_bits then holds
+ * a software bitshift instead of a prescaler enum
  * \returns pointer to array of structures for each sweep stage.
  */
-sweep_step *build_sweep_steps(uint32_t *low_rpm_tcnt, uint32_t *high_rpm_tcnt, uint8_t *total_stages)
+sweep_step *build_sweep_steps(uint32_t *low_rpm_tcnt, uint32_t *high_rpm_tcnt, uint8_t *total_stages, bool extended)
 {
   sweep_step *steps;
   uint8_t bitshift;
   uint32_t tmp = *low_rpm_tcnt;
   /* DEBUG
-  mySUI.print(*low_rpm_tcnt);
-  mySUI.print(F("<->"));
-  mySUI.println(*high_rpm_tcnt);
+  Serial.print(*low_rpm_tcnt);
+  Serial.print(F("<->"));
+  Serial.println(*high_rpm_tcnt);
    */
 
   steps = (sweep_step *)malloc(sizeof(sweep_step)*(*total_stages));
@@ -57,18 +65,28 @@ sweep_step *build_sweep_steps(uint32_t *low_rpm_tcnt, uint32_t *high_rpm_tcnt, u
     /* The low rpm value will ALWAYS have the higher TCNT value so use that
     to determine the prescaler value
     */
-    get_prescaler_bits(&tmp, &steps[i].prescaler_bits, &bitshift);
-    
+    if (extended)
+      get_extended_bits(&tmp, &steps[i].prescaler_bits, &bitshift);
+    else
+      get_prescaler_bits(&tmp, &steps[i].prescaler_bits, &bitshift);
+
     steps[i].beginning_ocr = (uint16_t)(tmp >> bitshift);
     if ((tmp >> 1) < (*high_rpm_tcnt))
       steps[i].ending_ocr = (uint16_t)((*high_rpm_tcnt) >> bitshift);
     else
       steps[i].ending_ocr = (uint16_t)(tmp >> (bitshift + 1)); // Half the begin value
+    /* CTC counts OCR + 1 ticks, same as get_fixed_period(). Extended steps
+     * stay whole ticks, set_extended_period() takes it from there */
+    if (!extended)
+    {
+      steps[i].beginning_ocr--;
+      steps[i].ending_ocr--;
+    }
     tmp = tmp >> 1; /* Divide by 2 */
     /* DEBUG
-    mySUI.print(steps[i].beginning_ocr);
-    mySUI.print(F("<->"));
-    mySUI.println(steps[i].ending_ocr);
+    Serial.print(steps[i].beginning_ocr);
+    Serial.print(F("<->"));
+    Serial.println(steps[i].ending_ocr);
     */
   }
   return steps;
@@ -106,28 +124,308 @@ void get_prescaler_bits(uint32_t *potential_oc_value, uint8_t *prescaler, uint8_
 }         
 
 
-void reset_new_OCR1A(uint32_t new_rpm)
+//! Gets the software bitshift for an OC value in extended timer mode
+/*!
+ * Same contract as get_prescaler_bits() but the timer stays at /1, so the
+ * smallest shift that fits 16 bits is used (not just 0/3/6/8/10) and is
+ * handed back in place of the prescaler enum too. The sweeper shifts its
+ * 16 bit value back up before splitting it with set_extended_period()
+ */
+void get_extended_bits(uint32_t *potential_oc_value, uint8_t *prescaler, uint8_t *bitshift)
+{
+  uint8_t shift = 0;
+
+  while ((*potential_oc_value >> shift) > 65535)
+    shift++;
+  *prescaler = shift;
+  *bitshift = shift;
+}
+
+
+//! Splits a 32 bit period into idle chunks and a final compare
+/*!
+ * Periods that fit 16 bits go out as one compare. Longer ones become N idle
+ * compares of EXT_CHUNK_TICKS, during which the edge ISR only counts, and a
+ * final compare of 32768-65535 ticks that emits the edge. Keeping the final
+ * one that long means the ISR always loads it well before TCNT gets there.
+ * \param ticks period in timer ticks at /1
+ * \param chunks where to put the number of idle chunks
+ * \param final where to put the final compare value
+ */
+void split_extended_period(uint32_t ticks, uint16_t *chunks, uint16_t *final)
+{
+  *chunks = 0;
+  if (ticks > 65536)
+  {
+    *chunks = (uint16_t)((ticks / EXT_CHUNK_TICKS) - 1);
+    ticks -= (uint32_t)(*chunks) * EXT_CHUNK_TICKS;
+  }
+  *final = (uint16_t)(ticks - 1);
+}
+
+
+//! Sets an engine's extended timer period, see split_extended_period()
+/*!
+ * Safe to call from the sweeper ISR.
+ * \param e engine to update
+ * \param ticks period in timer ticks at /1
+ */
+void set_extended_period(engine *e, uint32_t ticks)
+{
+  uint16_t chunks;
+  uint16_t final;
+
+  split_extended_period(ticks, &chunks, &final);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    e->ext_chunks = chunks;
+    e->ext_final = final;
+  }
+}
+
+
+//! Switches an engine between prescaled and extended (/1 only) timing
+/*!
+ * reset_new_OCR1A() keeps both representations up to date, so the switch
+ * itself is just the flag and a prescaler reload on the next edge. A sweep
+ * has to be rebuilt by the caller as its stages differ between the modes.
+ * \param e engine to switch
+ * \param enable true for extended mode
+ */
+void set_extended_timer(engine *e, bool enable)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    e->extended = enable;
+    e->reset_prescaler = true;
+  }
+}
+
+
+//! Works out the compare value and prescaler for a fixed RPM
+/*!
+ * The extended timer period is worked out as well so either mode can be
+ * switched to at any time. The period is rarely a whole number of timer
+ * ticks, so the fractional part is kept too (1/65536 tick) and the edge
+ * ISR dithers between N and N+1 ticks to make the average exact.
+ * \param wheel index into Wheels[] the period is for
+ * \param new_rpm RPM wanted, clamped to a minimum of 10
+ * \param c where to put the period (new_OCR1A, ocr_fraction,
+ * prescaler_bits, ext_chunks and ext_final)
+ */
+void get_fixed_period(uint8_t wheel, uint32_t new_rpm, engine_config *c)
 {
-  extern volatile uint8_t selected_wheel;
   extern wheels Wheels[];
-  extern volatile uint16_t new_OCR1A;
-  extern volatile uint8_t prescaler_bits;
-  extern volatile bool reset_prescaler;
 
+  float period;
   uint32_t tmp;
+  uint16_t ticks;
   uint8_t bitshift;
-  uint8_t tmp_prescaler_bits;
 
-  tmp = (uint32_t)(8000000.0/(Wheels[selected_wheel].rpm_scaler * (float)(new_rpm < 10 ? 10:new_rpm)));
-/*  mySUI.print(F("new_OCR1a: "));
-  mySUI.println(tmpl);
+  period = (float)half_clock/(Wheels[wheel].rpm_scaler * (float)(new_rpm < 10 ? 10:new_rpm));
+  tmp = (uint32_t)period;
+  split_extended_period(tmp, &c->ext_chunks, &c->ext_final);
+  get_prescaler_bits(&tmp, &c->prescaler_bits, &bitshift);
+  /* Whole and fractional (prescaled) ticks per edge */
+  period /= (float)(1UL << bitshift);
+  ticks = (uint16_t)period;
+  c->ocr_fraction = (uint16_t)((period - ticks) * 65536.0);
+  c->new_OCR1A = ticks - 1; /* CTC mode, the timer counts OCR+1 ticks */
+}
+
+
+//! Recomputes an engine's compare value and prescaler for a fixed RPM
+/*!
+ * Goes live at the next edge, see get_fixed_period()
+ * \param e engine to update
+ * \param new_rpm RPM wanted, clamped to a minimum of 10
+ */
+void reset_new_OCR1A(engine *e, uint32_t new_rpm)
+{
+  engine_config c;
+
+  get_fixed_period(e->selected_wheel, new_rpm, &c);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    e->ext_chunks = c.ext_chunks;
+    e->ext_final = c.ext_final;
+    e->new_OCR1A = c.new_OCR1A;
+    e->ocr_fraction = c.ocr_fraction;
+    e->prescaler_bits = c.prescaler_bits;
+    e->reset_prescaler = true;
+  }
+}
+
+
+//! Sets an engine up to sweep between two RPMs
+/*!
+ * Builds the sweep stages and the per sweeper tick OC change (whole and
+ * fractional) for each, then points the sweeper at the first one. The
+ * caller holds the sweep lock.
+ * \param e engine to set up, sweep_rate (RPM/sec) must already be set
+ * \param low_rpm RPM the sweep starts from
+ * \param high_rpm RPM the sweep turns around at
+ */
+void setup_sweep(engine *e, uint16_t low_rpm, uint16_t high_rpm)
+{
+  extern wheels Wheels[];
+
+  uint8_t total_stages;
+  uint8_t sweep_edges = Wheels[e->selected_wheel].wheel_max_edges / EDGE_SWEEP_UPDATES;
+  uint32_t low_rpm_tcnt;
+  uint32_t high_rpm_tcnt;
+
+  // Get OC Register values for begin/end points
+  low_rpm_tcnt = (uint32_t)((float)half_clock / (((float)low_rpm) * Wheels[e->selected_wheel].rpm_scaler));
+  high_rpm_tcnt = (uint32_t)((float)half_clock / (((float)high_rpm) * Wheels[e->selected_wheel].rpm_scaler));
+
+  if (!sweep_edges)
+    sweep_edges = 1;
+
+  // Get number of frequency doublings, rounding
+  total_stages = (uint8_t)ceil(log((float)high_rpm / (float)low_rpm) / (2 * LOG_2));
+  if (e->SweepSteps)
+    free(e->SweepSteps);
+  /* Debugging 
+  Serial.print(F("low TCNT: "));
+  Serial.println(low_rpm_tcnt);
+  Serial.print(F("high rpm raw TCNT: "));
+  Serial.println(high_rpm_tcnt);
+  */
+  e->SweepSteps = build_sweep_steps(&low_rpm_tcnt, &high_rpm_tcnt, &total_stages, e->extended);
+
+  /* VERY BROKEN CODE 
+    SweepSteps[i+1].prescaler_bits = SweepSteps[i].prescaler_bits;
+    SweepSteps[i+1].ending_ocr = SweepSteps[i].ending_ocr;
+    SweepSteps[i].ending_ocr =  (0.38 * (float)(SweepSteps[i].beginning_ocr - SweepSteps[i].ending_ocr)) + SweepSteps[i].ending_ocr;
+    SweepSteps[i+1].beginning_ocr = SweepSteps[i].ending_ocr;
+  }
   */
-  get_prescaler_bits(&tmp,&tmp_prescaler_bits,&bitshift);
+
+  for (uint8_t i = 0; i < total_stages; i++) {
+    uint16_t this_step_low_rpm = get_rpm_from_tcnt(e, &e->SweepSteps[i].beginning_ocr, &e->SweepSteps[i].prescaler_bits);
+    uint16_t this_step_high_rpm = get_rpm_from_tcnt(e, &e->SweepSteps[i].ending_ocr, &e->SweepSteps[i].prescaler_bits);
+    /* How much RPM changes this stage */
+    uint16_t rpm_span_this_stage = this_step_high_rpm - this_step_low_rpm;
+    /* How much TCNT changes this stage */
+    uint16_t steps = (uint16_t)(1000 * (float)rpm_span_this_stage / (float)e->sweep_rate);
+    float per_isr_tcnt_change = (float)(e->SweepSteps[i].beginning_ocr - e->SweepSteps[i].ending_ocr) / steps;
+    uint32_t scaled_remainder = (uint32_t)(FACTOR_THRESHOLD * (per_isr_tcnt_change - (uint16_t)per_isr_tcnt_change));
+    e->SweepSteps[i].tcnt_per_isr = (uint16_t)per_isr_tcnt_change;
+    e->SweepSteps[i].remainder_per_isr = scaled_remainder;
+    /* Edge sweep: sweep_edges edges last sweep_edges * (OC + 1) << bitshift
+     * ticks at /1, so the OC change over them is (OC + 1) times this, see
+     * sweep_update()
+     */
+    uint8_t bitshift = e->extended ? e->SweepSteps[i].prescaler_bits : get_bitshift_from_prescaler(&e->SweepSteps[i].prescaler_bits);
+    float update_factor = per_isr_tcnt_change * sweep_edges * (float)(1UL << bitshift) / SWEEP_TICKS_PER_MS;
+    if (!(update_factor > 0.0))
+      e->SweepSteps[i].update_factor = 0;
+    else if (update_factor >= 256.0)
+      e->SweepSteps[i].update_factor = 0xFFFFFFFF;
+    else
+      e->SweepSteps[i].update_factor = (uint32_t)(update_factor * 16777216.0);
+
+    /* Debugging
+    Serial.print(F("sweep step: "));
+    Serial.println(i);
+    Serial.print(F("steps: "));
+    Serial.println(steps);
+    Serial.print(F("Beginning tcnt: "));
+    Serial.print(e->SweepSteps[i].beginning_ocr);
+    Serial.print(F(" for RPM: "));
+    Serial.println(this_step_low_rpm);
+    Serial.print(F("ending tcnt: "));
+    Serial.print(e->SweepSteps[i].ending_ocr);
+    Serial.print(F(" for RPM: "));
+    Serial.println(this_step_high_rpm);
+    Serial.print(F("prescaler bits: "));
+    Serial.println(e->SweepSteps[i].prescaler_bits);
+    Serial.print(F("tcnt_per_isr: "));
+    Serial.println(e->SweepSteps[i].tcnt_per_isr);
+    Serial.print(F("scaled remainder_per_isr: "));
+    Serial.println(e->SweepSteps[i].remainder_per_isr);
+    Serial.print(F("FP TCNT per ISR: "));
+    Serial.println(per_isr_tcnt_change,6);
+    Serial.print(F("End of step: "));
+    Serial.println(i);
+    */
+  }
+  e->total_sweep_stages = total_stages;
   /*
-  mySUI.print(F("new_OCR1a: "));
-  mySUI.println(tmp2);
+  Serial.print(F("Total sweep stages: "));
+  Serial.println(e->total_sweep_stages);
   */
-  new_OCR1A = (uint16_t)(tmp >> bitshift);
-  prescaler_bits = tmp_prescaler_bits;
-  reset_prescaler = true;
-}          
+  /* Reset params for Timer2 ISR */
+  e->sweep_stage = 0;
+  e->sweep_direction = ASCENDING;
+  e->sweep_reset_prescaler = true;
+  e->new_OCR1A = e->SweepSteps[e->sweep_stage].beginning_ocr;
+  e->ocr_fraction = 0; /* The sweeper does its own fractions */
+  if (e->extended)
+    set_extended_period(e, (uint32_t)e->new_OCR1A << e->SweepSteps[e->sweep_stage].prescaler_bits);
+  e->oc_remainder = 0;
+  e->sweep_edges = sweep_edges;
+  e->sweep_edges_left = sweep_edges;
+  e->mode = LINEAR_SWEPT_RPM;
+  e->sweep_high_rpm = high_rpm;
+  e->sweep_low_rpm = low_rpm;
+}
+
+
+//! Gets RPM from the TCNT value
+/*!
+ * Gets the RPM value based on the passed TCNT and prescaler
+ * \param e engine whose wheel the TCNT applies to
+ * \param tcnt pointer to Output Compare register value
+ * \param prescaler_bits point to prescaler bits enum (the bitshift itself in
+ * extended timer mode)
+ */
+uint16_t get_rpm_from_tcnt(engine *e, uint16_t *tcnt, uint8_t *prescaler_bits) {
+  extern wheels Wheels[];
+  uint8_t bitshift;
+  if (e->extended)
+    bitshift = *prescaler_bits;
+  else
+    bitshift = get_bitshift_from_prescaler(prescaler_bits);
+  /* CTC compare values are one tick short of the period */
+  return (uint16_t)((float)(half_clock >> bitshift) / (Wheels[e->selected_wheel].rpm_scaler * ((uint32_t)*tcnt + (e->extended ? 0 : 1))));
+}
+
+
+//! Gets bitshift value from prescaler enumeration
+/*!
+ * Gets the bit shift value based on the prescaler enumeration passed
+ * \param prescaler_bits the enumeration to analyze
+ * \returns the necessary bitshift associated with the prescale value
+ */
+uint8_t get_bitshift_from_prescaler(uint8_t *prescaler_bits) {
+  switch (*prescaler_bits) {
+    case PRESCALE_1024:
+      return 10;
+    case PRESCALE_256:
+      return 8;
+    case PRESCALE_64:
+      return 6;
+    case PRESCALE_8:
+      return 3;
+    case PRESCALE_1:
+      return 0;
+  }
+  return 0;
+}
+
+
+//! Gets the number of crank degrees a wheel's edge array covers
+/*!
+ * rpm_scaler is edges/120 for 360 degree wheels and edges/240 for 720
+ * degree (crank+cam) wheels, so degrees = 3 * edges / rpm_scaler
+ * \param wheel index into Wheels[]
+ * \returns 360 or 720 (or whatever the wheel was defined over)
+ */
+uint16_t get_wheel_degrees(uint8_t wheel)
+{
+  extern wheels Wheels[];
+
+  return (uint16_t)((3.0 * Wheels[wheel].wheel_max_edges / Wheels[wheel].rpm_scaler) + 0.5);
+}
@@ -25,8 +25,17 @@
 
 #include "structures.h"
 
-sweep_step * build_sweep_steps(uint32_t *, uint32_t *, uint8_t *);              
+sweep_step * build_sweep_steps(uint32_t *, uint32_t *, uint8_t *, bool);              
 void get_prescaler_bits(uint32_t *, uint8_t *, uint8_t *);
-void reset_new_OCR1A(uint32_t);
+void get_extended_bits(uint32_t *, uint8_t *, uint8_t *);
+void split_extended_period(uint32_t, uint16_t *, uint16_t *);
+void set_extended_period(engine *, uint32_t);
+void set_extended_timer(engine *, bool);
+void get_fixed_period(uint8_t, uint32_t, engine_config *);
+void reset_new_OCR1A(engine *, uint32_t);
+void setup_sweep(engine *, uint16_t, uint16_t);
+uint16_t get_rpm_from_tcnt(engine *, uint16_t *, uint8_t *);
+uint8_t get_bitshift_from_prescaler(uint8_t *);
+uint16_t get_wheel_degrees(uint8_t);
 
 #endif
@@ -0,0 +1,227 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "defines.h"
+#include "enums.h"
+#include "hal.h"
+#include "structures.h"
+#include "sync.h"
+#include <util/atomic.h>
+#if defined(__AVR__)
+#include <Arduino.h>
+#endif
+
+extern wheels Wheels[];
+extern engine engines[];
+
+volatile uint8_t sync_mode = SYNC_OFF;
+volatile int16_t sync_trim = 0;   /* Added to OCR1A by the Timer1 ISR */
+uint16_t sync_offset = 0;         /* Slave edge that lines up with the master's edge 0 */
+
+/* Captured by the sync input ISR, consumed by sync_service() */
+static volatile bool sync_captured = false;
+static volatile uint16_t sync_edge;
+static volatile uint16_t sync_tcnt;
+static volatile uint16_t sync_ocr;
+static int32_t sync_integral = 0;
+
+
+//! Switches between standalone, master and slave
+/*!
+ * Sets up the sync output pin (master) or the sync input interrupt (slave)
+ * and clears any trim left over from a previous lock. Engine 1 can't be a
+ * slave while it runs the extended timer (see sync.h).
+ * \param new_mode SYNC_OFF, SYNC_MASTER or SYNC_SLAVE
+ * \returns false if the mode was refused
+ */
+bool set_sync_mode(uint8_t new_mode) {
+  if ((new_mode == SYNC_SLAVE) && engines[ENGINE_1].extended)
+    return false;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    sync_mode = new_mode;
+    sync_trim = 0;
+    sync_integral = 0;
+    sync_captured = false;
+#if defined(__AVR_ATmega328P__)
+    if (new_mode == SYNC_MASTER)
+      DDRC |= (1 << PC1);
+    else
+      DDRC &= ~(1 << PC1);
+    EICRA |= (1 << ISC01) | (1 << ISC00); /* Rising edge */
+    if (new_mode == SYNC_SLAVE)
+      EIMSK |= (1 << INT0);
+    else
+      EIMSK &= ~(1 << INT0);
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+    if (new_mode == SYNC_MASTER)
+      DDRG |= (1 << PG5);
+    else
+    {
+      DDRG &= ~(1 << PG5);
+      hal_port_clear(&PORTG, 1 << PG5);
+    }
+    EICRB |= (1 << ISC41) | (1 << ISC40); /* Rising edge */
+    if (new_mode == SYNC_SLAVE)
+      EIMSK |= (1 << INT4);
+    else
+      EIMSK &= ~(1 << INT4);
+#endif
+  }
+  return true;
+}
+
+
+//! Works out how far a slave is from where it should be
+/*!
+ * \param last_edge index of the last edge the slave emitted
+ * \param offset edge that should have just been emitted
+ * \param max_edges number of edges in the slave's wheel
+ * \param tcnt timer ticks since last_edge was emitted
+ * \param ocr compare value (edge period - 1) at the time
+ * \returns phase error in timer ticks, positive when the slave is ahead
+ */
+int32_t sync_phase_error(uint16_t last_edge, uint16_t offset, uint16_t max_edges, uint16_t tcnt, uint16_t ocr) {
+  int16_t err_edges = (int16_t)((last_edge + max_edges - (offset % max_edges)) % max_edges);
+
+  if (err_edges > (int16_t)(max_edges / 2))
+    err_edges -= max_edges;
+  return ((int32_t)err_edges * ((int32_t)ocr + 1)) + tcnt;
+}
+
+
+//! Snapshot of where the slave's wheel was at a master sync pulse
+/*!
+ * Taken by the sync input ISR (or a host simulation) for sync_correct()
+ * \param edge edge_counter, the next edge to emit
+ * \param tcnt timer ticks since the last edge was emitted
+ * \param ocr compare value (edge period - 1) at the time
+ */
+void sync_capture(uint16_t edge, uint16_t tcnt, uint16_t ocr) {
+  sync_edge = edge;
+  sync_tcnt = tcnt;
+  sync_ocr = ocr;
+  sync_captured = true;
+}
+
+
+//! Turns a captured sync pulse into a new OCR1A trim
+/*!
+ * Captures taken in extended timer mode are dropped, TCNT1 and OCR1A are
+ * chunk values there
+ * \param e slave engine
+ */
+void sync_correct(engine *e) {
+  uint16_t edge, tcnt, ocr, max_edges, last_edge;
+  int32_t err, trim, limit;
+
+  if (!sync_captured)
+    return;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    edge = sync_edge;
+    tcnt = sync_tcnt;
+    ocr = sync_ocr;
+    sync_captured = false;
+  }
+  max_edges = Wheels[e->selected_wheel].wheel_max_edges;
+  if ((edge >= max_edges) || e->extended)
+    return;
+  /* edge_counter already points at the NEXT edge to emit */
+  if (e->normal)
+    last_edge = (edge == 0) ? max_edges - 1 : edge - 1;
+  else
+    last_edge = (edge + 1 == max_edges) ? 0 : edge + 1;
+
+  err = sync_phase_error(last_edge, sync_offset, max_edges, tcnt, ocr);
+  /* Way off (first lock, wheel change), jump straight to the right edge */
+  limit = (int32_t)SYNC_SNAP_EDGES * ((int32_t)ocr + 1);
+  if ((err > limit) || (err < -limit))
+  {
+    int16_t jump = (int16_t)(err / ((int32_t)ocr + 1));
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      int32_t target = (int32_t)e->edge_counter + (e->normal ? -jump : jump);
+      while (target < 0)
+        target += max_edges;
+      e->edge_counter = (uint16_t)(target % max_edges);
+    }
+    err -= (int32_t)jump * ((int32_t)ocr + 1);
+    sync_integral = 0;
+  }
+  /* PI loop, spread the correction over the next revolution */
+  sync_integral += err / 16;
+  limit = ((int32_t)ocr >> SYNC_TRIM_LIMIT) * max_edges;
+  if (sync_integral > limit)
+    sync_integral = limit;
+  if (sync_integral < -limit)
+    sync_integral = -limit;
+  trim = ((err / 2) + sync_integral) / max_edges;
+  limit = ocr >> SYNC_TRIM_LIMIT;
+  if (trim > limit)
+    trim = limit;
+  if (trim < -limit)
+    trim = -limit;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    sync_trim = (int16_t)trim;
+  }
+}
+
+
+//! Runs the slave loop on engine 1, from loop()
+/*!
+ * The capture ISR only takes a snapshot so the loop (32 bit math and a
+ * division) never delays an edge
+ */
+void sync_service() {
+  sync_correct(&engines[ENGINE_1]);
+}
+
+
+/* Sync pulse from the master, snapshot where our wheel is. If the Timer1
+ * compare already matched but its ISR hasn't run yet TCNT1 has restarted
+ * from 0 while edge_counter hasn't moved, so count that edge as emitted.
+ */
+#if defined(__AVR__)
+#if defined(__AVR_ATmega328P__)
+ISR(INT0_vect)
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+ISR(INT4_vect)
+#endif
+{
+  engine * const e = &engines[ENGINE_1];
+  uint16_t edge = e->edge_counter;
+  uint16_t tcnt = TCNT1;
+  uint16_t ocr = OCR1A;
+
+  if (TIFR1 & (1 << OCF1A))
+  {
+    if (e->normal)
+      edge = (edge + 1 == Wheels[e->selected_wheel].wheel_max_edges) ? 0 : edge + 1;
+    else
+      edge = (edge == 0) ? Wheels[e->selected_wheel].wheel_max_edges - 1 : edge - 1;
+  }
+  sync_capture(edge, tcnt, ocr);
+}
+#endif
@@ -0,0 +1,60 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __SYNC_H__
+#define __SYNC_H__
+
+#include <inttypes.h>
+#include "structures.h"
+
+/* Multi-board phase synchronization (engine 1 / Timer1 only)
+ *
+ * The master raises a sync pulse for one edge period every time it emits
+ * edge 0 of its wheel:
+ *   328P: A1 (PC1), written together with the crank port so it has no skew
+ *   Mega: D4 (PG5)
+ * Slaves capture the rising edge of that pulse on D2 (INT0 on the 328P,
+ * INT4 on the Mega), work out how far their own wheel is from
+ * sync_offset edges and trim OCR1A for the next revolution (PI loop) so
+ * they phase-lock to the master. Errors of more than SYNC_SNAP_EDGES are
+ * fixed by jumping edge_counter once, the rest is pulled in smoothly.
+ *
+ * The phase is taken from TCNT1/OCR1A, which only hold a chunk of the
+ * period in extended timer mode, so a slave can't run the extended timer.
+ * Everything but the pins and the capture ISR builds on the host too,
+ * tools/sync_sim.cpp runs a master and a slave board against each other.
+ */
+#define SYNC_SNAP_EDGES 2   /* Larger phase errors are corrected by a jump */
+#define SYNC_TRIM_LIMIT 3   /* Trim is limited to OCR1A >> 3 (12.5%) per edge */
+
+extern volatile uint8_t sync_mode;
+extern volatile int16_t sync_trim;
+extern uint16_t sync_offset;
+
+bool set_sync_mode(uint8_t);
+void sync_capture(uint16_t, uint16_t, uint16_t);
+void sync_correct(engine *);
+void sync_service(void);
+int32_t sync_phase_error(uint16_t, uint16_t, uint16_t, uint16_t, uint16_t);
+
+#endif
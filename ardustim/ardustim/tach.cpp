@@ -0,0 +1,174 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "calibration.h"
+#include "defines.h"
+#include "enums.h"
+#include "structures.h"
+#include "sweep.h"
+#include "tach.h"
+#include <Arduino.h>
+#include <util/atomic.h>
+
+uint8_t tach_pulses_per_rev = 1;
+uint16_t tach_slew_rate = 5000; /* RPM/sec */
+uint16_t tach_rpm = 0;          /* Filtered, slew limited RPM being output */
+
+static engine *tach_engine = NULL;
+/* Written by the tach ISR */
+static volatile uint16_t tach_pulses = 0;
+static volatile uint32_t tach_last_us;
+/* Background state */
+static uint32_t window_start_us;
+static uint32_t last_update_ms;
+static uint32_t last_pulse_ms;
+static uint32_t filtered_rpm = 0; /* << TACH_FILTER_SHIFT */
+static bool window_open = false;
+
+
+//! Puts an engine into tach-follow mode
+/*!
+ * \param e engine to drive
+ * \param ppr tach pulses per crank revolution
+ * \param slew maximum RPM change per second
+ */
+void start_tach_follow(engine *e, uint8_t ppr, uint16_t slew) {
+  tach_engine = e;
+  tach_pulses_per_rev = ppr;
+  tach_slew_rate = slew;
+  tach_rpm = 0;
+  filtered_rpm = 0;
+  window_open = false;
+  last_update_ms = millis();
+  last_pulse_ms = last_update_ms;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    tach_pulses = 0;
+#if defined(__AVR_ATmega328P__)
+    EICRA |= (1 << ISC11) | (1 << ISC10); /* Rising edge */
+    EIMSK |= (1 << INT1);
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+    EICRB |= (1 << ISC51) | (1 << ISC50); /* Rising edge */
+    EIMSK |= (1 << INT5);
+#endif
+  }
+  e->mode = TACH_FOLLOW_RPM;
+}
+
+
+//! Stops listening to the tach input
+void stop_tach_follow() {
+#if defined(__AVR_ATmega328P__)
+  EIMSK &= ~(1 << INT1);
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+  EIMSK &= ~(1 << INT5);
+#endif
+  tach_engine = NULL;
+}
+
+
+//! Turns the tach pulses seen so far into a new output RPM
+/*!
+ * Called from loop(). Averages the period over every pulse in the window
+ * (so fast tach signals don't lose resolution to the 4us micros() tick),
+ * filters it, limits the rate of change and only then touches new_OCR1A
+ */
+void tach_service() {
+  uint16_t pulses;
+  uint32_t last_us, prev_start_us, now_ms, elapsed_ms, measured_rpm, target, step;
+
+  if (tach_engine == NULL)
+    return;
+  if (tach_engine->mode != TACH_FOLLOW_RPM) /* User picked fixed/swept */
+  {
+    stop_tach_follow();
+    return;
+  }
+  now_ms = millis();
+  elapsed_ms = now_ms - last_update_ms;
+  if (elapsed_ms < TACH_UPDATE_MS)
+    return;
+
+  prev_start_us = window_start_us;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    pulses = tach_pulses;
+    tach_pulses = 0;
+    last_us = tach_last_us;
+  }
+  measured_rpm = filtered_rpm >> TACH_FILTER_SHIFT;
+  if (pulses) {
+    last_pulse_ms = now_ms;
+    window_start_us = last_us;
+    /* First pulse(s) after a stop only open the window */
+    if (!window_open) {
+      window_open = true;
+      last_update_ms = now_ms;
+      return;
+    }
+    uint32_t period_us = (last_us - prev_start_us) / pulses;
+    /* micros() runs off the same clock, so it's trimmed too (calibration.h) */
+    if (period_us)
+      measured_rpm = (60000000L + 60L * clock_ppm) / (period_us * tach_pulses_per_rev);
+  } else if ((now_ms - last_pulse_ms) > TACH_TIMEOUT_MS) {
+    measured_rpm = 0; /* Input stopped */
+    window_open = false;
+  } else {
+    return; /* Nothing new yet, keep the current RPM */
+  }
+
+  /* Low pass filter */
+  if (filtered_rpm == 0)
+    filtered_rpm = measured_rpm << TACH_FILTER_SHIFT;
+  else
+    filtered_rpm = filtered_rpm - (filtered_rpm >> TACH_FILTER_SHIFT) + measured_rpm;
+  target = filtered_rpm >> TACH_FILTER_SHIFT;
+
+  /* Slew limit */
+  step = ((uint32_t)tach_slew_rate * elapsed_ms) / 1000;
+  if (step == 0)
+    step = 1;
+  if (target > (uint32_t)tach_rpm + step)
+    target = tach_rpm + step;
+  else if ((target + step) < tach_rpm)
+    target = tach_rpm - step;
+
+  last_update_ms = now_ms;
+  if (target != tach_rpm) {
+    tach_rpm = target;
+    tach_engine->wanted_rpm = tach_rpm;
+    reset_new_OCR1A(tach_engine, tach_rpm);
+  }
+}
+
+
+/* Tach pulse, just timestamp it */
+#if defined(__AVR_ATmega328P__)
+ISR(INT1_vect)
+#elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+ISR(INT5_vect)
+#endif
+{
+  tach_last_us = micros();
+  tach_pulses++;
+}
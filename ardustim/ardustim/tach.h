@@ -0,0 +1,51 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __TACH_H__
+#define __TACH_H__
+
+#include <inttypes.h>
+#include "structures.h"
+
+/* Tach-follow mode
+ *
+ * Measures the frequency of a tach/shaft speed signal on D3 (INT1 on the
+ * 328P, INT5 on the Mega), converts it to RPM using the number of pulses
+ * per revolution and feeds that through reset_new_OCR1A() so the selected
+ * wheel is regenerated at the measured speed.
+ * The ISR only timestamps pulses; periods are averaged over every pulse
+ * seen in a TACH_UPDATE_MS window, low pass filtered and slew limited.
+ */
+#define TACH_UPDATE_MS 10      /* Minimum time between RPM updates */
+#define TACH_TIMEOUT_MS 1000   /* No pulse for this long means stopped */
+#define TACH_FILTER_SHIFT 2    /* IIR filter, new = old + (measured - old) / 4 */
+
+extern uint8_t tach_pulses_per_rev;
+extern uint16_t tach_slew_rate;
+extern uint16_t tach_rpm;
+
+void start_tach_follow(engine *, uint8_t, uint16_t);
+void stop_tach_follow(void);
+void tach_service(void);
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include "auxiliary.h"
+#include "defines.h"
+#include "enums.h"
+#include "structures.h"
+#include "twin_engine.h"
+#include "vr_output.h"
+#include "wide_output.h"
+#include <Arduino.h>
+
+#if NUM_ENGINES > 1
+
+volatile bool twin_engine = false;
+
+
+//! Starts or stops engine 2
+/*!
+ * Engine 2 always keeps its own settings, stopping it just masks the
+ * Timer3 interrupt and releases the port pins. Wide output and the aux
+ * speed output (auxiliary.h) have to be stopped first as they use PORTL too,
+ * as does the VR output (vr_output.h) which takes Timer3 over
+ * \param enable true to start engine 2
+ * \returns the new state
+ */
+bool set_twin_engine(bool enable) {
+  if (enable && (wide_output || aux_speed_active() || vr_output))
+    return false;
+  if (enable) {
+    DDRK = B11111111;
+    DDRL = B11111111;
+    TCNT3 = 0;
+    TIMSK3 |= (1 << OCIE3A);
+    twin_engine = true;
+  } else {
+    TIMSK3 &= ~(1 << OCIE3A);
+    twin_engine = false;
+    PORTK = 0;
+    PORTL = 0;
+    DDRK = B00000000;
+    DDRL = B00000000;
+  }
+  return twin_engine;
+}
+
+#endif
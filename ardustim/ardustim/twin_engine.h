@@ -0,0 +1,46 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __TWIN_ENGINE_H__
+#define __TWIN_ENGINE_H__
+
+#include "defines.h"
+
+/* Twin engine mode (ATmega1280/2560 only)
+ *
+ * A second, fully independent engine (wheel, RPM, sweep, direction and
+ * invert) driven from Timer3:
+ *   PORTK (A8-A15)  engine 2 crank track
+ *   PORTL (D49-D42) engine 2 cam track
+ * Engine 1 keeps its normal Timer1 outputs. PORTL is shared with wide
+ * output mode so only one of the two can be active.
+ */
+#if NUM_ENGINES > 1
+extern volatile bool twin_engine;
+
+bool set_twin_engine(bool);
+#else
+#define twin_engine false
+#endif
+
+#endif
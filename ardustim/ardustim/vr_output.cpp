@@ -0,0 +1,250 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ * 
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+
+#include "calibration.h"
+#include "defines.h"
+#include "enums.h"
+#include "structures.h"
+#include "sweep.h"
+#include "twin_engine.h"
+#include "vr_output.h"
+#include <Arduino.h>
+#include <math.h>
+#include <util/atomic.h>
+
+#ifdef VR_SUPPORTED
+
+/* Lobe of each edge */
+#define VR_FLAT 0
+#define VR_POSITIVE 1
+#define VR_NEGATIVE 2
+#define VR_LARGE 4               /* Tooth after a gap */
+#define VR_PHASE_END (VR_LOBE_SAMPLES << 8)
+
+extern wheels Wheels[];
+extern engine engines[];
+
+volatile bool vr_output = false;
+uint16_t vr_full_rpm = 0;
+
+static uint8_t vr_lobe[VR_LOBE_SAMPLES];
+static uint8_t vr_edges[MAX_WHEEL_EDGES];
+static uint32_t vr_last_ms = 0;
+/* Used in the Timer3 overflow ISR */
+static volatile uint16_t vr_wheel_edges = 0;
+static volatile uint16_t vr_step = 0;       /* Phase per sample, 1/256 of a wavetable entry */
+static volatile uint8_t vr_gain = 0;        /* Ordinary teeth, /256 */
+static volatile uint8_t vr_gain_large = 0;  /* Tooth after a gap, /256 */
+static uint16_t vr_last_edge = 0xFFFF;
+static uint16_t vr_phase = 0;
+
+
+//! Crank track bit 0 of an edge, as on the wheel
+static uint8_t crank_bit(uint8_t wheel, uint16_t edge) {
+  return pgm_read_byte(&Wheels[wheel].edge_crank_ptr[edge]) & 1;
+}
+
+
+//! Edge played before (-1) or after (1) an edge, wrapping
+static uint16_t edge_from(uint16_t edge, int8_t offset, uint16_t edges, bool normal) {
+  if (!normal)
+    offset = -offset;
+  if (offset > 0)
+    return (edge + 1 == edges) ? 0 : edge + 1;
+  return edge ? edge - 1 : edges - 1;
+}
+
+
+//! Works out the wavetable step and gains for engine 1's RPM right now
+static void update_rate() {
+  engine *e = &engines[ENGINE_1];
+  uint16_t rpm = e->wanted_rpm; /* Fixed, or kept up to date by tach follow */
+  uint32_t step;
+  uint32_t gain;
+
+  if (e->mode == LINEAR_SWEPT_RPM)
+  {
+    uint16_t ocr;
+    uint8_t prescaler_bits;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      ocr = e->new_OCR1A;
+      prescaler_bits = e->prescaler_bits;
+    }
+    rpm = ocr ? get_rpm_from_tcnt(e, &ocr, &prescaler_bits) : 0;
+  }
+  /* A lobe lasts one edge, half_clock / (rpm_scaler * rpm) cycles */
+  step = (uint32_t)((float)VR_PHASE_END * (VR_PWM_TOP + 1) * Wheels[e->selected_wheel].rpm_scaler * rpm / half_clock);
+  if (step > VR_PHASE_END)
+    step = VR_PHASE_END;
+  gain = (uint32_t)rpm * 255 / vr_full_rpm;
+  if (gain > 255)
+    gain = 255;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    vr_step = step;
+    vr_gain_large = gain;
+    vr_gain = (gain * VR_TOOTH_GAIN) >> 8;
+  }
+}
+
+
+//! Starts the VR output with full amplitude at full_rpm, or stops it (0)
+/*!
+ * \param full_rpm RPM the amplitude tops out at, 0 off
+ * \returns false if twin engine mode has Timer3
+ */
+bool set_vr_output(uint16_t full_rpm) {
+  if (full_rpm && twin_engine)
+    return false;
+  vr_full_rpm = full_rpm;
+  if (!full_rpm) {
+    /* Timer3 is only ours while running, engine 2 may have it otherwise */
+    if (!vr_output)
+      return true;
+    TIMSK3 &= ~(1 << TOIE3);
+    vr_output = false;
+    /* Back to engine 2's pattern timer as hal_setup_timers() left it */
+    TCCR3A = 0;
+    TCCR3B = (1 << WGM32) | (1 << CS30);
+    OCR3A = 1000;
+    PORTE &= ~(1 << PE3);
+    DDRE &= ~(1 << PE3);
+    return true;
+  }
+  if (!vr_output) {
+    for (uint8_t i = 0; i < VR_LOBE_SAMPLES; i++)
+      vr_lobe[i] = (uint8_t)(255.0 * sin(M_PI * (i + 0.5) / VR_LOBE_SAMPLES) + 0.5);
+    refresh_vr();
+    update_rate();
+    TCCR3B = 0;
+    TCCR3A = (1 << COM3A1) | (1 << WGM31);
+    TCCR3B = (1 << WGM33) | (1 << WGM32);
+    ICR3 = VR_PWM_TOP;
+    OCR3A = VR_PWM_MID;
+    TCNT3 = 0;
+    DDRE |= (1 << PE3);
+    TCCR3B |= (1 << CS30);
+    TIFR3 = (1 << TOV3);
+    TIMSK3 |= (1 << TOIE3);
+    vr_output = true;
+  }
+  return true;
+}
+
+
+//! Picks the lobe of every edge of engine 1's wheel
+/*!
+ * Called when engine 1 changes wheel or direction. The tooth is the crank
+ * level with the fewer edges (high on a tie), the lobes go by the order
+ * the edges are played in.
+ */
+void refresh_vr() {
+  engine *e = &engines[ENGINE_1];
+  uint8_t wheel = e->selected_wheel;
+  uint16_t edges = Wheels[wheel].wheel_max_edges;
+  uint16_t high = 0;
+  uint8_t tooth;
+
+  if (edges > MAX_WHEEL_EDGES)
+    edges = MAX_WHEEL_EDGES;
+  for (uint16_t i = 0; i < edges; i++)
+    high += crank_bit(wheel, i);
+  tooth = (high <= edges - high) ? 1 : 0;
+  vr_wheel_edges = 0; /* ISR holds mid scale while the table changes */
+  for (uint16_t i = 0; i < edges; i++)
+  {
+    uint16_t prev = edge_from(i, -1, edges, e->normal);
+    uint8_t lobe = VR_FLAT;
+
+    if (crank_bit(wheel, i) == tooth)
+    {
+      /* Negative lobe over the first edge of a tooth */
+      if (crank_bit(wheel, prev) != tooth)
+      {
+        lobe = VR_NEGATIVE;
+        prev = edge_from(prev, -1, edges, e->normal);
+      }
+    }
+    else if (crank_bit(wheel, edge_from(i, 1, edges, e->normal)) == tooth)
+      lobe = VR_POSITIVE; /* Over the edge before a tooth */
+    /* Harder for a tooth after a gap, i.e. two space edges before it */
+    if (lobe && (crank_bit(wheel, prev) != tooth))
+      lobe |= VR_LARGE;
+    vr_edges[i] = lobe;
+  }
+  vr_last_edge = 0xFFFF;
+  vr_wheel_edges = edges;
+}
+
+
+//! Keeps the wavetable step and amplitude in line with the RPM
+void vr_service() {
+  uint32_t now = millis();
+
+  if (!vr_output || ((now - vr_last_ms) < VR_UPDATE_MS))
+    return;
+  vr_last_ms = now;
+  update_rate();
+}
+
+
+/* Every PWM period, the next sample of the lobe of engine 1's current
+ * edge. Runs with interrupts enabled so the edge ISR's never wait on it.
+ */
+ISR(TIMER3_OVF_vect, ISR_NOBLOCK) {
+  uint16_t edge;
+  uint16_t duty = VR_PWM_MID;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    edge = engines[ENGINE_1].edge_counter;
+  }
+  if (edge >= vr_wheel_edges)
+  {
+    OCR3A = duty;
+    return;
+  }
+  if (edge != vr_last_edge)
+  {
+    vr_last_edge = edge;
+    vr_phase = 0;
+  }
+  else if (vr_phase < VR_PHASE_END)
+    vr_phase += vr_step;
+  if (vr_phase < VR_PHASE_END)
+  {
+    uint8_t lobe = vr_edges[edge];
+    uint8_t level = ((uint16_t)vr_lobe[vr_phase >> 8] * ((lobe & VR_LARGE) ? vr_gain_large : vr_gain)) >> 8;
+
+    if (lobe & VR_POSITIVE)
+      duty += level;
+    else if (lobe & VR_NEGATIVE)
+      duty -= level;
+  }
+  OCR3A = duty;
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ * 
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __VR_OUTPUT_H__
+#define __VR_OUTPUT_H__
+
+#include <inttypes.h>
+#include "defines.h"
+
+/* VR (variable reluctance) crank output (ATmega1280/2560 only)
+ *
+ * A sine-like crank signal for ECU's with VR inputs, so their input
+ * conditioning gets a real workout instead of PORTC's square wave:
+ *   D5 (OC3A)  9 bit PWM at 31.25 kHz around mid scale, an RC filter
+ *              (e.g. 1k/22nF) and a coupling capacitor make it bipolar
+ * Every tooth of engine 1's crank track (bit 0) gets a positive lobe over
+ * the edge before it and a negative one over its first edge, so the
+ * falling zero crossing VR conditioners trigger on lands on the square
+ * signal's edge into the tooth. Edges in a missing tooth gap stay flat,
+ * and the tooth after a gap swings harder (VR_TOOTH_GAIN for the others).
+ * The amplitude follows the RPM up to full scale at vr_full_rpm, as a VR
+ * sensor's does.
+ *
+ * The lobe shape is in a RAM wavetable and the lobe of every edge is
+ * picked when the wheel (or direction) changes. The Timer3 overflow ISR
+ * only steps through the wavetable, picking the edge up from engine 1's
+ * edge_counter, and runs with interrupts enabled like the sweeper so the
+ * edge ISR's can always get in. The step per sample (i.e. the RPM) is
+ * updated from vr_service(). Lobes start up to one sample (32 us) late,
+ * and above a few kHz of edges there are only a handful of samples per
+ * lobe for the RC filter to round off.
+ * Timer3 is engine 2's pattern timer, so twin engine mode can't run
+ * at the same time.
+ */
+#if CONFIG_VR && (defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__))
+#define VR_SUPPORTED
+
+#define VR_PWM_TOP 511          /* Fast PWM at /1, 31.25 kHz */
+#define VR_PWM_MID 256
+#define VR_LOBE_SAMPLES 64      /* Wavetable, half a sine */
+#define VR_TOOTH_GAIN 180       /* Ordinary teeth, /256 of the tooth after a gap */
+#define VR_UPDATE_MS 1
+
+extern volatile bool vr_output;
+extern uint16_t vr_full_rpm;
+
+bool set_vr_output(uint16_t);
+void refresh_vr(void);
+void vr_service(void);
+#else
+#define vr_output false
+static inline void refresh_vr(void) {}
+static inline void vr_service(void) {}
+#endif
+
+#endif
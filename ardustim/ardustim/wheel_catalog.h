@@ -0,0 +1,40 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ * 
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+/* Generated by tools/gen_catalog.py from wheel_defs.h and wheels.cpp,
+ * don't edit, rerun it (PlatformIO does before every build)
+ */
+#ifndef __WHEEL_CATALOG_H__
+#define __WHEEL_CATALOG_H__
+
+#define WHEEL_CATALOG_HASH 0xd9bde615UL
+#define WHEEL_CATALOG_NAMES_LEN 85
+
+const wheel_record wheel_catalog[MAX_WHEELS] PROGMEM = {
+  /* name offset, edges, degrees, channels, flags */
+  { 0, 240, 720, 8, 0x03 },  /* 8Cam with 1 Crank */
+  { 18, 240, 720, 4, 0x03 },  /* Inverted 8Cam with 1 Crank */
+  { 45, 240, 720, 2, 0x0b },  /* GM 60-2 with 4X cam */
+  { 65, 240, 720, 2, 0x03 },  /* GM 60-3 with 4X cam */
+};
+
+#endif
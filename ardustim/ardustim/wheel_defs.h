@@ -24,7 +24,7 @@
  #define __WHEEL_DEFS_H__
  
  #include <avr/pgmspace.h>
- #include <SerialUI.h>
+ #include "config.h"
  
  /* Wheel patterns! 
   *
@@ -45,6 +45,7 @@
   * your maximum RPM is capped because of that. Currently 60-2 can run 
   * up to about 60,000 RPM, 360and8 can only do about 10,000 RPM becasue 
   * it has 6x the number of edges...  The less edges, the faster it can go... :)
+  * The real limits come out of tools/isr_budget.py on every PlatformIO build.
   * 
   * Using more edges allows you to do things like vary the dutycycle,  
   * i.e. a simple non-missing tooth 50% duty cycle wheel can be defined 
@@ -64,12 +65,21 @@
    * Its cheaper to pre-calculcate this NOW, as division is slow in arduino and it's used in
    * time critical functions (sweep)
    * Number of edges in the edge array above, needed by the ISR to avoid going out of bounds 
+   * Wheels switched off in config.h are left out, arrays nothing points at don't take any flash
    */
  typedef enum {
+#if WHEEL_EIGHT_CAM_ONE_CRANK
   EIGHT_CAM_ONE_CRANK,
+#endif
+#if WHEEL_INVERTED_EIGHT_CAM_ONE_CRANK
   INVERTED_EIGHT_CAM_ONE_CRANK,
+#endif
+#if WHEEL_SIXTY_MINUS_TWO_WITH_4X_CRANK
   SIXTY_MINUS_TWO_WITH_4X_CRANK,
+#endif
+#if WHEEL_SIXTY_MINUS_THREE_WITH_4X_CRANK
   SIXTY_MINUS_THREE_WITH_4X_CRANK,
+#endif
   MAX_WHEELS,
 } WheelType;
 
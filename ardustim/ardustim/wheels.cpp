@@ -0,0 +1,43 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ * 
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+#include "defines.h"
+#include "structures.h"
+#include "wheel_defs.h"
+#include <avr/pgmspace.h>
+#include <stddef.h>
+
+wheels Wheels[MAX_WHEELS] = {
+  /* Pointer to friendly name string, pointer to edge array, RPM Scaler, Number of edges in the array, whether the number of edges covers 360 or 720 degrees, aux track for wide output (NULL if none) */
+#if WHEEL_EIGHT_CAM_ONE_CRANK
+  { eight_cam_one_crank_friendly_name, eight_cam_one_crank, eight_cam_one_crank_array, 1.0, 240, NULL },
+#endif
+#if WHEEL_INVERTED_EIGHT_CAM_ONE_CRANK
+  { inverted_eight_cam_one_crank_friendly_name, inverted_eight_cam_one_crank, inverted_eight_cam_one_crank_array, 1.0, 240, NULL },
+#endif
+#if WHEEL_SIXTY_MINUS_TWO_WITH_4X_CRANK
+  { sixty_minus_two_with_4X_cam_friendly_name, sixty_minus_two_with_4X_cam, sixty_minus_two_with_4X_cam, 1.0, 240, NULL },
+#endif
+#if WHEEL_SIXTY_MINUS_THREE_WITH_4X_CRANK
+  { sixty_minus_three_with_4X_cam_friendly_name, sixty_minus_three_with_4X_cam, sixty_minus_two_with_4X_cam, 1.0, 240, NULL },
+#endif
+};
@@ -0,0 +1,128 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+#include "auxiliary.h"
+#include "bitstream.h"
+#include "commit.h"
+#include "defines.h"
+#include "enums.h"
+#include "routing.h"
+#include "structures.h"
+#include "twin_engine.h"
+#include "wide_output.h"
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#ifdef WIDE_OUTPUT_SUPPORTED
+
+extern wheels Wheels[];
+extern engine engines[];
+
+volatile bool wide_output = false;
+/* One row per edge: PORTA, PORTC, PORTL values ready to be written */
+static uint8_t wide_banks[2][MAX_WHEEL_EDGES][WIDE_OUTPUT_PORTS];
+uint8_t (*wide_edge_ports)[WIDE_OUTPUT_PORTS] = wide_banks[0];  /* Bank the Timer1 ISR uses */
+uint8_t (*wide_staged)[WIDE_OUTPUT_PORTS] = wide_banks[1];      /* Bank a commit swaps in */
+
+
+//! Precomputes the port values for every edge of a wheel
+/*!
+ * Walks the crank, cam and (optional) aux tracks of the wheel and stores
+ * the final port bytes, with the invert masks and cam shift applied, so
+ * the Timer1 ISR doesn't have to do any flash reads or shifting
+ * \param bank table to fill, never the one the ISR is using
+ * \param c wheel, invert masks and cam shift to build for, the wheel has
+ * to fit (MAX_WHEEL_EDGES)
+ */
+static void wide_build(uint8_t (*bank)[WIDE_OUTPUT_PORTS], const engine_config *c) {
+  const wheels *w = &Wheels[c->selected_wheel];
+  const unsigned char *aux = w->edge_aux_ptr;
+
+  for (uint16_t i = 0; i < w->wheel_max_edges; i++) {
+    bank[i][0] = c->crank_invert_mask ^ pgm_read_byte(&w->edge_crank_ptr[i]);
+    bank[i][1] = c->cam_invert_mask ^ (uint8_t)(pgm_read_byte(&w->edge_states_ptr[i]) << c->camSignalBitShift);
+    bank[i][2] = aux ? pgm_read_byte(&aux[i]) : 0;
+  }
+}
+
+
+//! Builds the staged bank for a batch its commit will put live
+/*!
+ * Nothing to do unless wide output is active. A wheel that doesn't fit
+ * drops engine 1 back to the routed outputs before the batch is armed.
+ * \param c staged settings
+ */
+void wide_stage(const engine_config *c) {
+  if (!wide_output)
+    return;
+  if (Wheels[c->selected_wheel].wheel_max_edges > MAX_WHEEL_EDGES)
+    set_wide_output(false);
+  else
+    wide_build(wide_staged, c);
+}
+
+
+//! Enables or disables wide output mode
+/*!
+ * The live bank is filled BEFORE the ISR is told to use it, an armed
+ * commit is taken back meanwhile and armed again to build its own bank.
+ * Not available in twin engine mode as engine 2 owns PORTL, nor with the
+ * aux speed output on D46 (auxiliary.h), nor with bitstream output as that
+ * stops the Timer1 edge ISR, nor for wheels longer than MAX_WHEEL_EDGES.
+ * Switching off hands the port directions back to the pin routing.
+ * \param enable true to switch to wide output
+ * \returns the new state
+ */
+bool set_wide_output(bool enable) {
+  engine *e = &engines[ENGINE_1];
+
+  if (enable == wide_output)
+    return wide_output;
+  if (enable) {
+    engine_config live;
+    bool armed;
+
+    if (twin_engine || bitstream_output || aux_speed_active() ||
+        (Wheels[e->selected_wheel].wheel_max_edges > MAX_WHEEL_EDGES))
+      return false;
+    armed = commit_disarm(e);
+    live.selected_wheel = e->selected_wheel;
+    live.crank_invert_mask = e->crank_invert_mask;
+    live.cam_invert_mask = e->cam_invert_mask;
+    live.camSignalBitShift = e->camSignalBitShift;
+    wide_build(wide_edge_ports, &live);
+    DDRA = B11111111;
+    DDRC = B11111111;
+    DDRL = B11111111;
+    wide_output = true;
+    if (armed)
+      commit_arm(e);
+  } else {
+    wide_output = false;
+    PORTL = 0;
+    DDRL = B00000000;
+    refresh_routing(); /* Back to the routed pins and their directions */
+  }
+  return wide_output;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+#ifndef __WIDE_OUTPUT_H__
+#define __WIDE_OUTPUT_H__
+
+#include <inttypes.h>
+#include "defines.h"
+#include "structures.h"
+
+/* Wide output mode (ATmega1280/2560 only)
+ *
+ * Up to 24 channels on three whole ports:
+ *   PORTA (D22-D29) crank track, up to 8 crank sensors
+ *   PORTC (D37-D30) cam track, cam references 1-8
+ *   PORTL (D49-D42) the wheel's aux track (edge_aux_ptr), held low for
+ *                   wheels without one
+ *
+ * Every port value is precomputed per edge (invert masks and cam shift
+ * already applied) into a RAM table, so the Timer1 ISR only has to load
+ * three bytes and write them back-to-back:
+ *   out PORTA -> out PORTC : 1 cycle  (62.5 ns)
+ *   out PORTC -> sts PORTL : 2 cycles (125 ns)
+ * i.e. a fixed 187.5 ns worst case skew across all 24 channels.
+ *
+ * Like the routing tables there are two banks, the ISR reads the one
+ * wide_edge_ports points at. Wheel, invert and cam shift changes are built
+ * into the other bank (wide_stage()) and swapped in by their commit at the
+ * same edge as the new settings (commit.h), so no edge sees a half built
+ * table or one built for another wheel. Wheels longer than MAX_WHEEL_EDGES
+ * don't fit a bank, wide output is refused for them.
+ */
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#define WIDE_OUTPUT_SUPPORTED
+
+extern volatile bool wide_output;
+extern uint8_t (*wide_edge_ports)[WIDE_OUTPUT_PORTS];
+extern uint8_t (*wide_staged)[WIDE_OUTPUT_PORTS];
+
+void wide_stage(const engine_config *);
+bool set_wide_output(bool);
+
+//! Puts the staged bank live, the live one becomes the staging bank
+static inline void wide_swap(void)
+{
+  uint8_t (*live)[WIDE_OUTPUT_PORTS] = wide_edge_ports;
+
+  wide_edge_ports = wide_staged;
+  wide_staged = live;
+}
+#else
+static inline void wide_stage(const engine_config *) {}
+static inline void wide_swap(void) {}
+#endif
+
+#endif
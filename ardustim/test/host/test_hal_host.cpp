@@ -0,0 +1,295 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+/* Host tests of the HAL contract (hal.h) as the pattern engine uses
+ * it, run on the host backend (tools/host/hal_host.h) through the
+ * simulation in tools/sim.h. Build and run from the ardustim folder:
+ *
+ *   g++ -O2 -Wall -Itools -Itools/host -Iardustim -o test_hal_host test/host/test_hal_host.cpp tools/sim.cpp ardustim/sweep.cpp ardustim/wheels.cpp
+ *   ./test_hal_host
+ *
+ * Exits non zero when a check fails.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "calibration.h"
+#include "defines.h"
+#include "enums.h"
+#include "hal.h"
+#include "sim.h"
+#include "structures.h"
+#include "sweep.h"
+#include "wheel_defs.h"
+
+#define TEST_WHEEL 2 /* GM 60-2 with 4X cam, 240 edges */
+
+extern wheels Wheels[];
+
+static unsigned checks;
+static unsigned failures;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static void check(bool ok, const char *what, const char *file, int line)
+{
+  checks++;
+  if (!ok)
+  {
+    failures++;
+    printf("%s:%d: FAILED %s\n", file, line, what);
+  }
+}
+
+
+/* Edges of one run, timed from the first sweeper tick on (the prescaler
+ * is set there, see sweep_prescaler())
+ */
+typedef struct _run_result run_result;
+struct _run_result {
+  uint32_t mismatches;   /* Edges that aren't the next entry of the wheel table */
+  uint32_t timed;        /* Periods measured */
+  double mean;           /* Cycles per edge */
+  double min_period;
+  double max_period;
+  uint32_t max_prescale; /* Largest Timer1 prescaler seen */
+};
+
+static void run(sim *s, double seconds, run_result *r)
+{
+  const unsigned char *crank = Wheels[s->e.selected_wheel].edge_crank_ptr;
+  const unsigned char *cam = Wheels[s->e.selected_wheel].edge_states_ptr;
+  uint16_t edges = Wheels[s->e.selected_wheel].wheel_max_edges;
+  uint8_t crank_invert = s->e.crank_invert_mask;
+  uint8_t cam_invert = s->e.cam_invert_mask;
+  uint16_t expect = s->e.edge_counter;
+  uint64_t first = 0;
+  uint64_t last = 0;
+
+  r->mismatches = 0;
+  r->timed = 0;
+  r->min_period = HUGE_VAL;
+  r->max_period = 0;
+  r->max_prescale = 0;
+  while (sim_next_edge(s, (uint64_t)(seconds * SIM_F_CPU)))
+  {
+    if ((s->crank != (uint8_t)(crank_invert ^ pgm_read_byte(&crank[expect]))) ||
+        (s->cam != (uint8_t)(cam_invert ^ pgm_read_byte(&cam[expect]))))
+      r->mismatches++;
+    expect = s->e.normal ? (expect + 1) % edges : (expect + edges - 1) % edges;
+    if (!first)
+    {
+      if (s->now >= SIM_F_CPU / SWEEP_ISR_RATE)
+        first = s->now;
+    }
+    else
+    {
+      double period = (double)(s->now - last);
+
+      if (period < r->min_period)
+        r->min_period = period;
+      if (period > r->max_period)
+        r->max_period = period;
+      if (sim_prescale(s) > r->max_prescale)
+        r->max_prescale = sim_prescale(s);
+      r->timed++;
+    }
+    last = s->now;
+  }
+  r->mean = r->timed ? (double)(last - first) / r->timed : 0;
+}
+
+
+//! Cycles per edge at an RPM
+static double exact_period(uint8_t wheel, double rpm)
+{
+  return (double)half_clock / Wheels[wheel].rpm_scaler / rpm;
+}
+
+
+//! Clock select only touches the CS bits, compare loads the register
+static void test_registers()
+{
+  volatile uint8_t tccrb = (1 << 3) | PRESCALE_64; /* WGM12 set, CTC */
+  volatile uint16_t ocr = 0;
+  hal_timer t = { &tccrb, &ocr };
+
+  hal_timer_prescale(&t, PRESCALE_8);
+  CHECK(tccrb == ((1 << 3) | PRESCALE_8));
+  hal_timer_prescale(&t, PRESCALE_1);
+  CHECK(tccrb == ((1 << 3) | PRESCALE_1));
+  hal_timer_compare(&t, 1234);
+  CHECK(ocr == 1234);
+}
+
+
+//! Port writes and bit set/clear, pin reads and the ADC result
+static void test_ports()
+{
+  volatile uint8_t port = 0x0F;
+
+  hal_port_set(&port, 0x30);
+  CHECK(port == 0x3F);
+  hal_port_clear(&port, 0x03);
+  CHECK(port == 0x3C);
+  hal_port_write(&port, 0xA5);
+  CHECK(hal_pin_read(&port) == 0xA5);
+  hal_host_adc = 1023;
+  CHECK(hal_adc_read() == 1023);
+}
+
+
+//! The edge path writes the ports through the HAL, cam shift applied
+static void test_output_edge()
+{
+  sim s;
+
+  sim_init(&s, TEST_WHEEL);
+  s.e.camSignalBitShift = 1;
+  s.e.cam_invert_mask = 0x02;
+  CHECK(sim_next_edge(&s, SIM_F_CPU));
+  CHECK(s.crank == pgm_read_byte(&Wheels[TEST_WHEEL].edge_crank_ptr[0]));
+  CHECK(s.cam == (uint8_t)(0x02 ^ (pgm_read_byte(&Wheels[TEST_WHEEL].edge_states_ptr[0]) << 1)));
+}
+
+
+//! Fixed RPM: period is OCR + 1 ticks, fraction carried, no prescaler
+static void test_fixed_rpm()
+{
+  sim s;
+  run_result r;
+  double exact = exact_period(TEST_WHEEL, 3000);
+
+  sim_init(&s, TEST_WHEEL);
+  s.e.wanted_rpm = 3000;
+  reset_new_OCR1A(&s.e, 3000);
+  run(&s, 1.0, &r);
+  CHECK(r.mismatches == 0);
+  CHECK(r.timed > 5000);
+  CHECK(fabs(r.mean - exact) < exact * 1e-6);
+  CHECK(r.max_period - r.min_period <= 1.0);
+  CHECK(r.max_prescale == 1);
+}
+
+
+//! Low RPM: the engine picks a prescaler through hal_timer_prescale()
+static void test_prescaled()
+{
+  sim s;
+  run_result r;
+  double exact = exact_period(TEST_WHEEL, 20);
+
+  sim_init(&s, TEST_WHEEL);
+  s.e.wanted_rpm = 20;
+  reset_new_OCR1A(&s.e, 20);
+  run(&s, 2.0, &r);
+  CHECK(r.mismatches == 0);
+  CHECK(r.max_prescale > 1);
+  CHECK(fabs(r.mean - exact) < exact * 1e-3);
+}
+
+
+//! Extended timer: always /1, the period is split into chunks
+static void test_extended()
+{
+  sim s;
+  run_result r;
+  double exact = exact_period(TEST_WHEEL, 20);
+
+  sim_init(&s, TEST_WHEEL);
+  set_extended_timer(&s.e, true);
+  s.e.wanted_rpm = 20;
+  reset_new_OCR1A(&s.e, 20);
+  run(&s, 2.0, &r);
+  CHECK(r.mismatches == 0);
+  CHECK(r.max_prescale == 1);
+  CHECK(fabs(r.mean - exact) < exact * 1e-6);
+}
+
+
+//! Reverse rotation and per track invert masks
+static void test_reverse_invert()
+{
+  sim s;
+  run_result r;
+
+  sim_init(&s, TEST_WHEEL);
+  s.e.normal = false;
+  s.e.crank_invert_mask = 0x01;
+  s.e.cam_invert_mask = 0x02;
+  s.e.wanted_rpm = 6000;
+  reset_new_OCR1A(&s.e, 6000);
+  run(&s, 0.2, &r);
+  CHECK(r.timed > 1000);
+  CHECK(r.mismatches == 0);
+}
+
+
+//! Trim is added to every compare value, as on a sync slave
+static void test_trim()
+{
+  sim s;
+  run_result r;
+  double exact = exact_period(TEST_WHEEL, 3000);
+
+  sim_init(&s, TEST_WHEEL);
+  s.trim = 2;
+  s.e.wanted_rpm = 3000;
+  reset_new_OCR1A(&s.e, 3000);
+  run(&s, 0.5, &r);
+  CHECK(fabs(r.mean - (exact + 2.0)) < 0.01);
+}
+
+
+//! A Timer2 sweep reaches both ends at the fixed RPM periods
+static void test_sweep()
+{
+  sim s;
+  run_result r;
+
+  sim_init(&s, TEST_WHEEL);
+  s.e.sweep_rate = 2000;
+  setup_sweep(&s.e, 1000, 4000);
+  run(&s, 3.5, &r);
+  CHECK(r.mismatches == 0);
+  CHECK(fabs(r.max_period - exact_period(TEST_WHEEL, 1000)) < exact_period(TEST_WHEEL, 1000) * 0.01);
+  CHECK(fabs(r.min_period - exact_period(TEST_WHEEL, 4000)) < exact_period(TEST_WHEEL, 4000) * 0.01);
+  free(s.e.SweepSteps);
+}
+
+
+int main()
+{
+  test_registers();
+  test_ports();
+  test_output_edge();
+  test_fixed_rpm();
+  test_prescaled();
+  test_extended();
+  test_reverse_invert();
+  test_trim();
+  test_sweep();
+  printf("%u checks, %u failed\n", checks, failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+#!/usr/bin/env python
+#
+# vim: filetype=python expandtab shiftwidth=4 tabstop=4 softtabstop=4:
+#
+# Arbritrary crank/cam wheel pattern generator
+#
+# copyright 2014-2017 David J. Andruczyk
+#
+# Ardu-Stim software is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# ArduStim software is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+#
+
+"""isr_budget.py against a canned avr-objdump listing.
+
+    python -m unittest discover -s test/host
+"""
+
+import io
+import json
+import os
+import shutil
+import sys
+import tempfile
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, "..", "..", "tools"))
+import isr_budget  # noqa: E402
+
+SRC = os.path.join(HERE, "..", "..", "ardustim")
+
+
+def listing(text):
+    """avr-objdump separates bytes, mnemonic and operands with tabs"""
+    return [line.replace(" | ", "\t") for line in text.splitlines()]
+
+
+# An edge ISR dividing by libgcc's __udivmodqi4 (as it comes out of libgcc,
+# local labels and all) on one branch. Per instruction: push 2, in 1, eor 1,
+# lds 2, and 1, breq 1/2, ldi 1, call 4 + callee, pop 2, out 1, reti 4
+DIVIDE = listing("""
+00000068 <__vector_11>:
+  68: | 1f 92       | push | r1
+  6a: | 0f 92       | push | r0
+  6c: | 0f b6       | in | r0, 0x3f | ; 63
+  6e: | 0f 92       | push | r0
+  70: | 11 24       | eor | r1, r1
+  72: | 8f 93       | push | r24
+  74: | 9f 93       | push | r25
+  76: | 80 91 00 01 | lds | r24, 0x0100 | ; 0x800100 <divisor>
+  7a: | 88 23       | and | r24, r24
+  7c: | 19 f0       | breq | .+6      | ; 0x84 <__vector_11+0x1c>
+  7e: | 90 e0       | ldi | r25, 0x00 | ; 0
+  80: | 0e 94 50 00 | call | 0xa0 | ; 0xa0 <__udivmodqi4>
+  84: | 9f 91       | pop | r25
+  86: | 8f 91       | pop | r24
+  88: | 0f 90       | pop | r0
+  8a: | 0f be       | out | 0x3f, r0 | ; 63
+  8c: | 0f 90       | pop | r0
+  8e: | 1f 90       | pop | r1
+  90: | 18 95       | reti
+
+000000a0 <__udivmodqi4>:
+  a0: | 99 1b       | sub | r25, r25
+  a2: | 79 e0       | ldi | r23, 0x09 | ; 9
+  a4: | 04 c0       | rjmp | .+8      | ; 0xae <__udivmodqi4_ep>
+
+000000a6 <__udivmodqi4_loop>:
+  a6: | 99 1f       | adc | r25, r25
+  a8: | 96 17       | cp | r25, r22
+  aa: | 08 f0       | brcs | .+2      | ; 0xae <__udivmodqi4_ep>
+  ac: | 96 1b       | sub | r25, r22
+
+000000ae <__udivmodqi4_ep>:
+  ae: | 88 1f       | adc | r24, r24
+  b0: | 7a 95       | dec | r23
+  b2: | c9 f7       | brne | .-14     | ; 0xa6 <__udivmodqi4_loop>
+  b4: | 80 95       | com | r24
+  b6: | 69 2f       | mov | r22, r25
+  b8: | 08 95       | ret
+""")
+
+# A 16 bit variable shift, the loop gcc inlines for x << n
+SHIFT = listing("""
+00000068 <__vector_11>:
+  68: | 80 91 00 01 | lds | r24, 0x0100 | ; 0x800100 <x>
+  6c: | 90 91 01 01 | lds | r25, 0x0101 | ; 0x800101 <x+0x1>
+  70: | 20 91 02 01 | lds | r18, 0x0102 | ; 0x800102 <n>
+  74: | 02 c0       | rjmp | .+4      | ; 0x7a <__vector_11+0x12>
+  76: | 88 0f       | add | r24, r24
+  78: | 99 1f       | adc | r25, r25
+  7a: | 2a 95       | dec | r18
+  7c: | e2 f7       | brpl | .-8      | ; 0x76 <__vector_11+0xe>
+  7e: | 18 95       | reti
+""")
+
+
+class AnalyzerTest(unittest.TestCase):
+    def test_libgcc_loop(self):
+        # 13 cycles straight through, 8 trips of at most 8 cycles
+        analyzer = isr_budget.Analyzer(isr_budget.parse(DIVIDE), False)
+        self.assertEqual(analyzer.analyze("__udivmodqi4"), (13, 13 + 8 * 8))
+
+    def test_isr(self):
+        # 15 in, 15 out, the branch round the call is 2 and the call 1 + 1 + 4 + 77
+        analyzer = isr_budget.Analyzer(isr_budget.parse(DIVIDE), False)
+        self.assertEqual(analyzer.analyze("__vector_11"), (15 + 2 + 15, 15 + 83 + 15))
+
+    def test_big_pc(self):
+        # Calls and returns take a cycle longer
+        analyzer = isr_budget.Analyzer(isr_budget.parse(DIVIDE), True)
+        self.assertEqual(analyzer.analyze("__vector_11"), (32 + 1, 113 + 3))
+
+    def test_unbounded_loop(self):
+        analyzer = isr_budget.Analyzer(isr_budget.parse(DIVIDE), False, {})
+        with self.assertRaisesRegex(ValueError, "loop at 0xae in __udivmodqi4 has no bound"):
+            analyzer.analyze("__vector_11")
+
+    def test_shift_loop(self):
+        # Bounded by the 16 bits shifted, 5 cycles a trip
+        analyzer = isr_budget.Analyzer(isr_budget.parse(SHIFT), False, {})
+        self.assertEqual(analyzer.analyze("__vector_11"), (14, 14 + 16 * 5))
+
+
+class ReportTest(unittest.TestCase):
+    def test_outputs_charged(self):
+        # 16 MHz over 2 edges/rev of 100 cycles, less 50 cycles at 31.25 kHz for VR
+        out = io.StringIO()
+        isr_budget.report("atmega2560", 16e6, {"TIMER1_COMPA": (0, 100), "TIMER3_OVF": (0, 50)},
+                          [("wheel", 1.0, 60)], out)
+        self.assertRegex(out.getvalue(), r"wheel +60 edges +80000 RPM +72187 RPM")
+
+
+class BaselineTest(unittest.TestCase):
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        self.path = os.path.join(self.dir, isr_budget.BASELINE)
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def run_budget(self, baseline=None, update=False):
+        if baseline is not None:
+            with open(self.path, "w") as f:
+                json.dump(baseline, f)
+        out = io.StringIO()
+        rc = isr_budget.run(DIVIDE, "atmega328p", 16e6, SRC, self.path, update, out)
+        return rc, out.getvalue()
+
+    def test_missing_baseline_warns(self):
+        rc, out = self.run_budget()
+        self.assertEqual(rc, 0)
+        self.assertIn("WARNING: no atmega328p baseline for TIMER1_COMPA", out)
+        self.assertFalse(os.path.exists(self.path))
+
+    def test_update_records(self):
+        self.assertEqual(self.run_budget(update=True)[0], 0)
+        with open(self.path) as f:
+            self.assertEqual(json.load(f), {"atmega328p": {"TIMER1_COMPA": 113 + 7}})
+        self.assertEqual(self.run_budget()[0], 0)
+
+    def test_slower_fails(self):
+        rc, out = self.run_budget({"atmega328p": {"TIMER1_COMPA": 119}})
+        self.assertEqual(rc, 1)
+        self.assertIn("went from 119 to 120 cycles", out)
+
+    def test_unbounded_loop_fails(self):
+        bounds = isr_budget.LOOP_BOUNDS
+        isr_budget.LOOP_BOUNDS = {}
+        try:
+            rc, out = self.run_budget({"atmega328p": {"TIMER1_COMPA": 120}})
+        finally:
+            isr_budget.LOOP_BOUNDS = bounds
+        self.assertEqual(rc, 1)
+        self.assertIn("has no bound", out)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,161 @@
+#!/usr/bin/env python
+#
+# vim: filetype=python expandtab shiftwidth=4 tabstop=4 softtabstop=4:
+#
+# Arbritrary crank/cam wheel pattern generator
+#
+# copyright 2014-2017 David J. Andruczyk
+#
+# Ardu-Stim software is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# ArduStim software is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+#
+
+"""Generates the packed wheel catalog (ardustim/wheel_catalog.h).
+
+One fixed size record per wheel, in Wheels[] order, little endian:
+
+    uint16 name offset   into the names, every decoder_name NUL terminated
+                         in wheel order (served from Wheels[], not stored)
+    uint16 edges
+    uint16 degrees       360 or 720, 3 * edges / rpm_scaler
+    uint8  channels      output bits used across all tracks
+    uint8  flags         CATALOG_* in catalog.h
+
+plus an FNV-1a hash over the records and names, so the host can keep its
+copy of the catalog until the hash changes.
+
+PlatformIO runs this before every build (extra_scripts in platformio.ini).
+Standalone, from the ardustim folder:
+
+    python tools/gen_catalog.py            rewrite the header
+    python tools/gen_catalog.py --check    fail if it is out of date
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+HEADER = "wheel_catalog.h"
+# catalog.h
+CATALOG_CRANK = 0x01
+CATALOG_CAM = 0x02
+CATALOG_AUX = 0x04
+CATALOG_COMBINED = 0x08
+
+
+def load(src):
+    """[(name, states, crank, aux, rpm_scaler, edges)] in Wheels[] order"""
+    with open(os.path.join(src, "wheel_defs.h")) as f:
+        text = re.sub(r"/\*.*?\*/|//[^\n]*", "", f.read(), flags=re.S)
+    names = dict(re.findall(r"const char (\w+)\[\] PROGMEM = \"([^\"]*)\"", text))
+    arrays = dict((name, [int(v, 0) for v in body.replace(",", " ").split()])
+                  for name, body in re.findall(r"const unsigned char (\w+)\[\] PROGMEM = \{(.*?)\};", text, re.S))
+    with open(os.path.join(src, "wheels.cpp")) as f:
+        rows = re.findall(r"\{\s*(\w+),\s*(\w+),\s*(\w+),\s*([0-9.]+),\s*(\d+)\s*(?:,\s*(\w+)\s*)?\}", f.read())
+    wheels = []
+    for name, states, crank, scaler, edges, aux in rows:
+        wheels.append((names[name], arrays[states], arrays[crank],
+                       arrays[aux] if aux and aux != "NULL" else None,
+                       float(scaler), int(edges), states == crank))
+    return wheels
+
+
+def fnv1a(data):
+    h = 0x811c9dc5
+    for b in bytearray(data):
+        h = ((h ^ b) * 0x01000193) & 0xffffffff
+    return h
+
+
+def build(wheels):
+    """(records, names bytes, hash)"""
+    records = []
+    names = b""
+    for name, states, crank, aux, scaler, edges, combined in wheels:
+        used = 0
+        for track in (states, crank, aux or []):
+            for v in track[:edges]:
+                used |= v
+        flags = 0
+        if any(crank[:edges]):
+            flags |= CATALOG_CRANK
+        if combined or any(states[:edges]):
+            flags |= CATALOG_CAM
+        if aux and any(aux[:edges]):
+            flags |= CATALOG_AUX
+        if combined:
+            flags |= CATALOG_COMBINED
+        records.append((len(names), edges, int(3.0 * edges / scaler + 0.5), bin(used).count("1"), flags))
+        names += name.encode() + b"\0"
+    packed = b"".join(struct.pack("<HHHBB", *r) for r in records)
+    return records, names, fnv1a(packed + names)
+
+
+def render(wheels):
+    records, names, digest = build(wheels)
+    lines = [
+        "/* Generated by tools/gen_catalog.py from wheel_defs.h and wheels.cpp,",
+        " * don't edit, rerun it (PlatformIO does before every build)",
+        " */",
+        "#ifndef __WHEEL_CATALOG_H__",
+        "#define __WHEEL_CATALOG_H__",
+        "",
+        "#define WHEEL_CATALOG_HASH 0x%08lxUL" % digest,
+        "#define WHEEL_CATALOG_NAMES_LEN %d" % len(names),
+        "",
+        "const wheel_record wheel_catalog[MAX_WHEELS] PROGMEM = {",
+        "  /* name offset, edges, degrees, channels, flags */",
+    ]
+    for (offset, edges, degrees, channels, flags), wheel in zip(records, wheels):
+        lines.append("  { %d, %d, %d, %d, 0x%02x },  /* %s */" % (offset, edges, degrees, channels, flags, wheel[0]))
+    lines += ["};", "", "#endif", ""]
+    return "\n".join(lines)
+
+
+def generate(src, check=False, out=sys.stdout):
+    path = os.path.join(src, HEADER)
+    with open(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "ardustim", "defines.h")) as f:
+        gpl = f.read().split("*/", 1)[0] + "*/\n\n"
+    text = gpl + render(load(src))
+    current = None
+    if os.path.exists(path):
+        with open(path) as f:
+            current = f.read()
+    if current == text:
+        return 0
+    if check:
+        out.write("%s is out of date, run tools/gen_catalog.py\n" % path)
+        return 1
+    with open(path, "w") as f:
+        f.write(text)
+    out.write("Regenerated %s\n" % path)
+    return 0
+
+
+def main(argv):
+    here = os.path.dirname(os.path.abspath(argv[0]))
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--check", action="store_true", help="only check the header is current")
+    args = parser.parse_args(argv[1:])
+    return generate(os.path.normpath(os.path.join(here, "..", "ardustim")), args.check)
+
+
+try:
+    Import("env")  # noqa: F821, PlatformIO extra_scripts
+except NameError:
+    if __name__ == "__main__":
+        sys.exit(main(sys.argv))
+else:
+    generate(env.subst("$PROJECT_SRC_DIR"))  # noqa: F821
@@ -0,0 +1,81 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __HAL_HOST_H__
+#define __HAL_HOST_H__
+
+#include <inttypes.h>
+
+/* Host simulation backend (see ../sim.h), the timer registers are plain
+ * variables in the simulation, which works out the compare match times
+ */
+#define CS10 0
+#define CS11 1
+#define CS12 2
+
+typedef struct _hal_timer hal_timer;
+struct _hal_timer {
+  volatile uint8_t *tccrb;  /* Only the clock select bits are used */
+  volatile uint16_t *ocr;
+};
+
+static inline void hal_timer_prescale(const hal_timer *t, uint8_t prescaler_bits)
+{
+  *t->tccrb = (*t->tccrb & ~((1 << CS10) | (1 << CS11) | (1 << CS12))) | prescaler_bits;
+}
+
+static inline void hal_timer_compare(const hal_timer *t, uint16_t ocr)
+{
+  *t->ocr = ocr;
+}
+
+/* Ports are plain variables too (e.g. sim's crank and cam) */
+static inline void hal_port_write(volatile uint8_t *port, uint8_t value)
+{
+  *port = value;
+}
+
+static inline void hal_port_set(volatile uint8_t *port, uint8_t bits)
+{
+  *port |= bits;
+}
+
+static inline void hal_port_clear(volatile uint8_t *port, uint8_t bits)
+{
+  *port &= ~bits;
+}
+
+static inline uint8_t hal_pin_read(volatile uint8_t *pin)
+{
+  return *pin;
+}
+
+/* The ADC result is whatever the host put in hal_host_adc */
+extern volatile uint16_t hal_host_adc;
+
+static inline uint16_t hal_adc_read(void)
+{
+  return hal_host_adc;
+}
+
+#endif
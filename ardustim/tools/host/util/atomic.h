@@ -0,0 +1,33 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __HOST_ATOMIC_H__
+#define __HOST_ATOMIC_H__
+
+/* Host build of the firmware pattern code, the "ISR's" are called in line
+ * from the simulation loop so there is nothing to protect against
+ */
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_BLOCK(type) for (int __todo = 1; __todo; __todo = 0)
+
+#endif
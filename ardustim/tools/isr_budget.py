@@ -0,0 +1,426 @@
+#!/usr/bin/env python
+#
+# vim: filetype=python expandtab shiftwidth=4 tabstop=4 softtabstop=4:
+#
+# Arbritrary crank/cam wheel pattern generator
+#
+# copyright 2014-2017 David J. Andruczyk
+#
+# Ardu-Stim software is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# ArduStim software is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+#
+
+"""ISR cycle budget and max RPM report.
+
+Disassembles the firmware ELF, walks every path through the Timer1 (edge)
+and Timer2 (sweeper) compare ISR's counting AVR instruction cycles, and
+turns the worst case into the top RPM of every wheel in wheels.cpp.
+
+Every loop needs a bound: gcc's variable shift loops are bounded by the
+width shifted, anything else by its function's entry in LOOP_BOUNDS. An
+ISR calling or inlining a loop that isn't in there fails the build.
+
+The worst cases are checked against isr_budget.json, the build fails when
+an ISR got slower (an ISR without a baseline is only warned about). Run
+with --update to accept new numbers, and commit the file.
+
+PlatformIO runs this after every firmware link (extra_scripts in
+platformio.ini). Standalone:
+
+    python tools/isr_budget.py .pio/build/<env>/firmware.elf --mcu atmega328p
+    python tools/isr_budget.py --disasm firmware.lst --mcu atmega2560
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+SWEEP_ISR_RATE = 1000       # defines.h
+VR_PWM_TOP = 511            # vr_output.h, Timer3 overflow per PWM period
+AUX_PWM_TOP = 2047          # auxiliary.h, Timer4 overflow per PWM period
+NUM_ENGINES = 2             # defines.h, Mega
+BASELINE = "isr_budget.json"
+
+# Max trips round any loop (back edge) per call, by function symbol or ISR
+# name. Loops nested in each other multiply
+LOOP_BOUNDS = {
+    # libgcc, one trip per quotient bit
+    "__udivmodqi4": 8,
+    "__udivmodhi4": 16,
+    "__udivmodsi4": 32,
+    # The engines loop, and sweep_engine()'s oc_remainder loop which runs
+    # once at most as remainder_per_isr < FACTOR_THRESHOLD
+    "TIMER2_COMPA": NUM_ENGINES,
+}
+
+# Vector numbers, as avr-gcc names the ISR's __vector_N
+VECTORS = {
+    "atmega328p": {"TIMER1_COMPA": 11, "TIMER2_COMPA": 7},
+    "atmega1280": {"TIMER1_COMPA": 17, "TIMER2_COMPA": 13, "TIMER3_COMPA": 32, "TIMER3_OVF": 35, "TIMER4_OVF": 45, "USART3_UDRE": 55},
+    "atmega2560": {"TIMER1_COMPA": 17, "TIMER2_COMPA": 13, "TIMER3_COMPA": 32, "TIMER3_OVF": 35, "TIMER4_OVF": 45, "USART3_UDRE": 55},
+}
+# Devices with a 22 bit PC take a cycle longer on calls, returns and
+# interrupt response
+BIG_PC = ("atmega2560",)
+
+# Cycles per instruction (datasheet instruction set summary), branches and
+# skips are handled separately
+ONE = set("""add adc sub subi sbc sbci and andi or ori eor com neg sbr cbr inc
+dec tst clr ser mov movw ldi cp cpc cpi lsl lsr rol ror asr swap bset bclr
+bst bld sec clc sen cln sez clz sei cli ses cls sev clv set clt seh clh nop
+in out sleep wdr break""".split())
+TWO = set("""adiw sbiw mul muls mulsu fmul fmuls fmulsu sbi cbi ld ldd lds st
+std sts push pop rjmp ijmp eijmp""".split())
+THREE = set("lpm elpm jmp".split())
+SKIPS = set("cpse sbrc sbrs sbic sbis".split())
+SHIFTS = set("lsl lsr asr rol ror".split())
+INSN = re.compile(r"^\s*([0-9a-f]+):\s+((?:[0-9a-f]{2}\s)+)\s*([a-z]+)\s*(.*)$")
+FUNC = re.compile(r"^([0-9a-f]+) <(.+)>:$")
+TARGET = re.compile(r";\s*0x([0-9a-f]+)")
+
+
+class Insn(object):
+    def __init__(self, addr, size, op, args):
+        self.addr = addr
+        self.size = size
+        self.op = op
+        self.args = args
+        m = TARGET.search(args)
+        if not (op.startswith("br") or op in ("call", "rcall", "jmp", "rjmp")):
+            self.target = None  # Just an I/O or data address
+        elif m:
+            self.target = int(m.group(1), 16)
+        elif args.startswith("0x"):
+            self.target = int(args.split()[0], 16)
+        else:
+            self.target = None
+
+
+def parse(lines):
+    """Splits an avr-objdump -d listing into {name: [Insn]}
+
+    Local labels (libgcc's __udivmodhi4_loop etc.) show up as symbols of
+    their own, those and anything the previous code falls through into are
+    kept with the function they belong to.
+    """
+    funcs = {}
+    current = None
+    name = None
+    for line in lines:
+        m = FUNC.match(line.strip())
+        if m:
+            label = m.group(2)
+            falls_in = current and current[-1].op not in ("ret", "reti", "jmp", "rjmp", "ijmp", "eijmp")
+            if name is None or not (label.startswith(name + "_") or falls_in):
+                name = label
+                current = funcs.setdefault(name, [])
+            continue
+        m = INSN.match(line)
+        if m and current is not None:
+            size = len(m.group(2).split())
+            current.append(Insn(int(m.group(1), 16), size, m.group(3), m.group(4)))
+    return funcs
+
+
+class Analyzer(object):
+    def __init__(self, funcs, big_pc, bounds=LOOP_BOUNDS):
+        self.funcs = funcs
+        self.big_pc = big_pc
+        self.bounds = bounds
+        self.by_addr = {}
+        for name, insns in funcs.items():
+            if insns:
+                self.by_addr[insns[0].addr] = name
+        self.cache = {}
+
+    def callee(self, insn):
+        name = self.by_addr.get(insn.target)
+        if name is None:
+            raise ValueError("call to unknown address 0x%x" % insn.target)
+        return self.analyze(name)[1]
+
+    def edges(self, insns, index, i):
+        """[(successor index or None for exit, cycles)] for instruction i"""
+        insn = insns[i]
+        op = insn.op
+        nxt = i + 1
+        if op in ("ret", "reti"):
+            return [(None, 5 if self.big_pc else 4)]
+        if op in ("icall", "eicall", "ijmp", "eijmp"):
+            raise ValueError("indirect %s at 0x%x can't be bounded" % (op, insn.addr))
+        if op in ("call", "rcall"):
+            cost = (3 if op == "call" else 2) + (2 if self.big_pc else 1)
+            return [(nxt, cost + self.callee(insn))]
+        if op in ("jmp", "rjmp"):
+            cost = 3 if op == "jmp" else 2
+            if insn.target in index:
+                return [(index[insn.target], cost)]
+            return [(None, cost + self.callee(insn))]  # Tail call
+        if op.startswith("br") and op not in ("break",):
+            if insn.target not in index:
+                raise ValueError("branch out of the function at 0x%x" % insn.addr)
+            return [(nxt, 1), (index[insn.target], 2)]
+        if op in SKIPS:
+            return [(nxt, 1), (nxt + 1, 1 + insns[nxt].size // 2)]
+        if op in ONE:
+            return [(nxt, 1)]
+        if op in TWO:
+            return [(nxt, 2)]
+        if op in THREE:
+            return [(nxt, 3)]
+        raise ValueError("unknown instruction %s at 0x%x" % (op, insn.addr))
+
+    def analyze(self, name):
+        """(best, worst) cycles from entry to return of a function"""
+        if name in self.cache:
+            if self.cache[name] is None:
+                raise ValueError("recursion through %s" % name)
+            return self.cache[name]
+        self.cache[name] = None
+        insns = self.funcs[name]
+        index = dict((insn.addr, i) for i, insn in enumerate(insns))
+        succ = {0: self.edges(insns, index, 0)}
+
+        # Depth first order, edges back to a node on the stack close a loop.
+        # Only reachable instructions are looked at (padding, data etc.)
+        order = []
+        back = []
+        state = [0] * len(insns)
+        stack = [(0, iter(succ[0]))]
+        state[0] = 1
+        while stack:
+            node, it = stack[-1]
+            for s, cost in it:
+                if s is None:
+                    continue
+                if state[s] == 1:
+                    back.append((node, s, cost))
+                elif state[s] == 0:
+                    state[s] = 1
+                    succ[s] = self.edges(insns, index, s)
+                    stack.append((s, iter(succ[s])))
+                    break
+            else:
+                state[node] = 2
+                order.append(node)
+                stack.pop()
+        order.reverse()
+        back_set = set((u, v) for u, v, _ in back)
+
+        def paths(start, stop=None):
+            """Shortest/longest acyclic path from start to an exit (or stop)"""
+            best = {start: 0}
+            worst = {start: 0}
+            lo = hi = None
+            for node in order:
+                if node not in worst:
+                    continue
+                if node == stop:
+                    return best[node], worst[node]
+                for s, cost in succ[node]:
+                    if (node, s) in back_set:
+                        continue
+                    if s is None:
+                        if stop is None:
+                            b, w = best[node] + cost, worst[node] + cost
+                            lo = b if lo is None else min(lo, b)
+                            hi = w if hi is None else max(hi, w)
+                        continue
+                    best[s] = min(best.get(s, best[node] + cost), best[node] + cost)
+                    worst[s] = max(worst.get(s, 0), worst[node] + cost)
+            return lo, hi
+
+        # Back edges into the same instruction close one loop. Every loop
+        # costs bound * (its worst trip + the loops nested inside it)
+        heads = {}
+        for u, v, cost in back:
+            trip = paths(v, u)[1] + cost
+            body = self.loop_body(succ, back_set, u, v)
+            if v in heads:
+                trip = max(trip, heads[v][0])
+                body |= heads[v][1]
+            heads[v] = (trip, body)
+        loops = sorted(((body, self.loop_bound(name, insns, v, body), trip)
+                        for v, (trip, body) in heads.items()), key=lambda l: len(l[0]))
+        total = [0] * len(loops)
+        lo, hi = paths(0)
+        for i, (body, bound, trip) in enumerate(loops):
+            total[i] += bound * trip
+            for j in range(i + 1, len(loops)):
+                if body < loops[j][0]:
+                    total[j] += loops[j][1] * total[i]
+                    break
+            else:
+                hi += total[i]
+        self.cache[name] = (lo, hi)
+        return lo, hi
+
+    @staticmethod
+    def loop_body(succ, back_set, u, v):
+        """Instructions on a path from the loop head v to its back edge at u"""
+        pred = {}
+        seen = set([v])
+        todo = [v]
+        while todo:
+            node = todo.pop()
+            for s, _ in succ[node]:
+                if s is None or (node, s) in back_set:
+                    continue
+                pred.setdefault(s, set()).add(node)
+                if s not in seen:
+                    seen.add(s)
+                    todo.append(s)
+        body = set([u])
+        todo = [u]
+        while todo:
+            for p in pred.get(todo.pop(), ()):
+                if p not in body:
+                    body.add(p)
+                    todo.append(p)
+        return body
+
+    def loop_bound(self, name, insns, v, body):
+        """Max trips round the loop at v"""
+        ops = [insns[i] for i in body]
+        shifts = [i for i in ops if i.op in SHIFTS or
+                  (i.op in ("add", "adc") and len(set(i.args.replace(" ", "").split(","))) == 1)]
+        if shifts and all(i in shifts or i.op in ("dec", "subi", "brpl", "brne") for i in ops):
+            return 8 * len(shifts)  # Variable shift, never more than its width
+        if name in self.bounds:
+            return self.bounds[name]
+        raise ValueError("loop at 0x%x in %s has no bound, add it to LOOP_BOUNDS" % (insns[v].addr, name))
+
+
+def load_wheels(src):
+    """[(name, rpm_scaler, edges)] from wheels.cpp and wheel_defs.h"""
+    with open(os.path.join(src, "wheel_defs.h")) as f:
+        names = dict(re.findall(r"const char (\w+)\[\] PROGMEM = \"([^\"]*)\"", f.read()))
+    with open(os.path.join(src, "wheels.cpp")) as f:
+        rows = re.findall(r"\{\s*(\w+),[^{}]*?,\s*([0-9.]+),\s*(\d+)\s*[,}]", f.read())
+    return [(names.get(n, n), float(scaler), int(edges)) for n, scaler, edges in rows]
+
+
+def report(mcu, f_cpu, results, wheels, out):
+    out.write("ISR cycle budget (%s @ %.0f MHz, incl. interrupt entry)\n" % (mcu, f_cpu / 1e6))
+    for name in sorted(results):
+        lo, hi = results[name]
+        out.write("  %-14s best %4d  worst %4d cycles\n" % (name, lo, hi))
+    edge = results["TIMER1_COMPA"][1]
+    sweep = results.get("TIMER2_COMPA", (0, 0))[1]  # No sweeper without CONFIG_SWEEP
+    free = f_cpu - sweep * SWEEP_ISR_RATE
+    # The VR and aux outputs (Mega) run their PWM overflow ISR's at a fixed
+    # rate whatever the RPM, the second column charges them too
+    outputs = (results.get("TIMER3_OVF", (0, 0))[1] * f_cpu / (VR_PWM_TOP + 1) +
+               results.get("TIMER4_OVF", (0, 0))[1] * f_cpu / (AUX_PWM_TOP + 1))
+    out.write("\nMax RPM per wheel (edge ISR at 100% of what the sweeper leaves, "
+              "serial UI stalls well before this):\n")
+    if outputs:
+        out.write("  %-40s %10s  %7s  %s\n" % ("", "", "alone", "with VR and aux outputs"))
+    for name, scaler, edges in wheels:
+        # Edges/sec = 2 * RPM * rpm_scaler, see reset_new_OCR1A()
+        line = "  %-40s %4d edges  %7d RPM" % (name, edges, int(free / (2.0 * scaler * edge)))
+        if outputs:
+            line += "  %7d RPM" % max(0, int((free - outputs) / (2.0 * scaler * edge)))
+        out.write(line + "\n")
+    out.write("Not charged: engine 2 (TIMER3_COMPA) in twin engine mode shares what's "
+              "left with engine 1, the bitstream ISR (USART3_UDRE) only runs with the "
+              "edge ISR stopped.\n")
+
+
+def check(results, baseline_path, mcu, update, out):
+    baseline = {}
+    if os.path.exists(baseline_path):
+        with open(baseline_path) as f:
+            baseline = json.load(f)
+    known = baseline.get(mcu) or {}
+    worst = dict((name, hi) for name, (lo, hi) in results.items())
+    if update:
+        baseline[mcu] = worst
+        with open(baseline_path, "w") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write("\n")
+        out.write("\nRecorded %s baseline in %s, commit it\n" % (mcu, baseline_path))
+        return 0
+    failed = 0
+    for name, hi in sorted(worst.items()):
+        if name not in known:
+            out.write("\nWARNING: no %s baseline for %s in %s, check the numbers "
+                      "and record them with --update\n" % (mcu, name, baseline_path))
+        elif hi > known[name]:
+            out.write("\nERROR: %s worst case went from %d to %d cycles\n" % (name, known[name], hi))
+            failed = 1
+    return failed
+
+
+def run(disasm, mcu, f_cpu, src, baseline_path, update=False, out=sys.stdout):
+    # ISR names in LOOP_BOUNDS go by their vector symbol
+    bounds = dict(LOOP_BOUNDS)
+    for name, vector in VECTORS[mcu].items():
+        if name in bounds:
+            bounds["__vector_%d" % vector] = bounds.pop(name)
+    analyzer = Analyzer(parse(disasm), mcu in BIG_PC, bounds)
+    entry = 8 if mcu in BIG_PC else 7  # Interrupt response + vector jmp
+    results = {}
+    for name, vector in VECTORS[mcu].items():
+        symbol = "__vector_%d" % vector
+        if symbol in analyzer.funcs:
+            try:
+                lo, hi = analyzer.analyze(symbol)
+            except ValueError as e:
+                out.write("ERROR: %s: %s\n" % (name, e))
+                return 1
+            results[name] = (lo + entry, hi + entry)
+    report(mcu, f_cpu, results, load_wheels(src), out)
+    return check(results, baseline_path, mcu, update, out)
+
+
+def main(argv):
+    here = os.path.dirname(os.path.abspath(argv[0]))
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("elf", nargs="?", help="firmware ELF")
+    parser.add_argument("--disasm", help="avr-objdump -d output instead of an ELF")
+    parser.add_argument("--mcu", required=True, choices=sorted(VECTORS))
+    parser.add_argument("--f-cpu", type=float, default=16e6)
+    parser.add_argument("--objdump", default="avr-objdump")
+    parser.add_argument("--update", action="store_true", help="accept the current numbers")
+    args = parser.parse_args(argv[1:])
+    if args.disasm:
+        with open(args.disasm) as f:
+            disasm = f.read().splitlines()
+    elif args.elf:
+        disasm = subprocess.check_output([args.objdump, "-d", args.elf]).decode().splitlines()
+    else:
+        parser.error("need an ELF or --disasm")
+    return run(disasm, args.mcu, args.f_cpu, os.path.join(here, "..", "ardustim"),
+               os.path.join(here, BASELINE), args.update)
+
+
+try:
+    Import("env")  # noqa: F821, PlatformIO extra_scripts
+except NameError:
+    if __name__ == "__main__":
+        sys.exit(main(sys.argv))
+else:
+    def budget_action(target, source, env):
+        elf = str(target[0])
+        objdump = env.subst("$OBJCOPY").replace("objcopy", "objdump")
+        disasm = subprocess.check_output([objdump, "-d", elf]).decode().splitlines()
+        tools = os.path.join(env.subst("$PROJECT_DIR"), "tools")
+        return run(disasm, env.BoardConfig().get("build.mcu"),
+                   float(env.BoardConfig().get("build.f_cpu").rstrip("L")),
+                   env.subst("$PROJECT_SRC_DIR"), os.path.join(tools, BASELINE))
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", budget_action)  # noqa: F821
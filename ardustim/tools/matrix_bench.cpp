@@ -0,0 +1,507 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ * 
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+
+
+/* Regression run of the edge engine over every wheel x RPM x mode, fed
+ * from the firmware's own wheel tables, RPM/sweep math and edge code (see
+ * sim.h). The modes are every combination of reverse rotation, inverted
+ * outputs and extended timer, each at a fixed RPM, swept by Timer2 and
+ * swept from the edge ISR. Sweeps run from rpm / SWEEP_SPAN up to rpm
+ * and back, at no more than rpm RPM/sec so each leg spans enough edges.
+ *
+ * Every case is a sim of its own (the engine state lives in it, nothing
+ * the edge code touches is shared), so the cases are spread over a pool
+ * of threads. Each worker starts with its own block of the matrix and
+ * takes cases from the front of its queue; once that runs dry it steals
+ * from the back of another's, so the slow cases (long sweeps, many edge
+ * wheels at high RPM) never leave cores idle at the end. Results go into
+ * the case's own slot and are merged once every worker is done, so the
+ * report doesn't depend on the number of threads.
+ *
+ * Per case:
+ * - mismatches: edges whose crank/cam state isn't the next entry of the
+ *   wheel table (invert and direction applied), any of these fail the run
+ * - fixed RPM: average period error over the run (from the first sweeper
+ *   tick on, as the pattern timer's prescaler is set then) and the worst single
+ *   period, both in ppm of the exact period
+ * - sweeps: how far the lowest and highest RPM reached are off the ends
+ * - throughput: simulated edges per second of wall time
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "calibration.h"
+#include "defines.h"
+#include "enums.h"
+#include "sim.h"
+#include "structures.h"
+#include "sweep.h"
+#include "wheel_defs.h"
+
+#define MAX_RPMS 16
+#define SWEEP_SPAN 4           /* Sweeps run from rpm / SWEEP_SPAN to rpm */
+#define PROGRESS_EVERY 200     /* Cases between progress lines */
+
+extern wheels Wheels[];
+
+/* Mode bits, a mode is one column of the matrix */
+enum {
+  MODE_REVERSE = 1,
+  MODE_INVERT = 2,
+  MODE_EXTENDED = 4,
+  MODE_SWEEP = 8,
+  MODE_EDGE_SWEEP = 16,        /* Only with MODE_SWEEP */
+  MODES = 32
+};
+
+/* One cell of the matrix and what it measured */
+typedef struct _matrix_case matrix_case;
+struct _matrix_case {
+  uint8_t wheel;
+  uint16_t rpm;
+  uint8_t mode;
+  uint64_t edges;
+  uint64_t mismatches;
+  double mean_ppm;         /* Fixed RPM, average period vs exact */
+  double worst_ppm;        /* Fixed RPM, worst single period vs exact */
+  double low_error;        /* Sweep, lowest RPM reached vs low end, % */
+  double high_error;       /* Sweep, highest RPM reached vs high end, % */
+  double wall;             /* Seconds of wall time */
+};
+
+/* Run settings */
+typedef struct _bench bench;
+struct _bench {
+  double seconds;          /* Simulated per case, sweeps run one full cycle at least */
+  unsigned rate;           /* Sweep rate, RPM/sec */
+  unsigned threads;
+  bool fixed_only;
+  bool verbose;
+};
+
+/* A worker's share of the matrix, case indexes */
+struct work_queue {
+  std::mutex lock;
+  std::deque<uint32_t> cases;
+};
+
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+    "usage: %s [-w wheel] [-r rpm,rpm,...] [-S rate] [-t seconds] [-j threads] [-F] [-v]\n"
+    "  -w  wheel number as in the serial menu (default all)\n"
+    "  -r  RPMs to run at, up to %u (default 10,100,500,1000,3000,6000,12000)\n"
+    "  -S  sweep rate in RPM/sec, at most rpm/sec (default 5000)\n"
+    "  -t  simulated seconds per case (default 1)\n"
+    "  -j  worker threads (default one per core)\n"
+    "  -F  fixed RPM modes only\n"
+    "  -v  one line per case\n", name, MAX_RPMS);
+}
+
+
+static const char *mode_name(uint8_t mode, char *buf)
+{
+  strcpy(buf, (mode & MODE_EDGE_SWEEP) ? "edgesweep" : (mode & MODE_SWEEP) ? "sweep" : "fixed");
+  if (mode & MODE_REVERSE)
+    strcat(buf, "+rev");
+  if (mode & MODE_INVERT)
+    strcat(buf, "+inv");
+  if (mode & MODE_EXTENDED)
+    strcat(buf, "+ext");
+  return buf;
+}
+
+
+static bool valid_mode(uint8_t mode, const bench *b)
+{
+  if ((mode & MODE_EDGE_SWEEP) && !(mode & MODE_SWEEP))
+    return false;
+  return !(b->fixed_only && (mode & MODE_SWEEP));
+}
+
+
+//! Runs one case and fills in its results
+/*!
+ * Set up the way vcd_export does it, i.e. as the serial menu would.
+ * \param c case to run
+ * \param b run settings
+ */
+static void run_case(matrix_case *c, const bench *b)
+{
+  const unsigned char *crank = Wheels[c->wheel].edge_crank_ptr;
+  const unsigned char *cam = Wheels[c->wheel].edge_states_ptr;
+  uint16_t edges = Wheels[c->wheel].wheel_max_edges;
+  uint8_t invert = (c->mode & MODE_INVERT) ? 0xFF : 0;
+  /* Timer cycles per edge at 1 RPM */
+  double per_rpm = (double)half_clock / Wheels[c->wheel].rpm_scaler;
+  double exact = per_rpm / c->rpm;
+  double seconds = b->seconds;
+  double min_period = HUGE_VAL;
+  double max_period = 0;
+  uint16_t low = c->rpm / SWEEP_SPAN;
+  uint16_t expect = 0;
+  uint64_t first = 0;
+  uint64_t last = 0;
+  uint32_t timed = 0;      /* Periods measured */
+  sim s;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  sim_init(&s, c->wheel);
+  s.e.crank_invert_mask = invert;
+  s.e.cam_invert_mask = invert;
+  s.e.normal = !(c->mode & MODE_REVERSE);
+  if (c->mode & MODE_EXTENDED)
+    set_extended_timer(&s.e, true);
+  s.e.edge_sweep = (c->mode & MODE_EDGE_SWEEP) != 0;
+  if (c->mode & MODE_SWEEP)
+  {
+    if (low < 10)
+      low = 10;
+    /* At least 3/4 s a leg, or the ends fall inside one edge at low RPM */
+    s.e.sweep_rate = (b->rate < c->rpm) ? b->rate : c->rpm;
+    setup_sweep(&s.e, low, c->rpm);
+    if (seconds < 2.0 * (c->rpm - low) / s.e.sweep_rate + 0.1)
+      seconds = 2.0 * (c->rpm - low) / s.e.sweep_rate + 0.1;
+  }
+  else
+  {
+    s.e.wanted_rpm = c->rpm;
+    reset_new_OCR1A(&s.e, c->rpm);
+  }
+
+  while (sim_next_edge(&s, (uint64_t)(seconds * SIM_F_CPU)))
+  {
+    if ((s.crank != (uint8_t)(invert ^ pgm_read_byte(&crank[expect]))) ||
+        (s.cam != (uint8_t)(invert ^ pgm_read_byte(&cam[expect]))))
+      c->mismatches++;
+    expect = s.e.normal ? (expect + 1) % edges : (expect + edges - 1) % edges;
+    /* Timing starts at the first edge after the first sweeper tick, the
+     * periods before that were loaded before the sweeper set the prescaler
+     */
+    if (!first)
+    {
+      if (s.now >= SIM_F_CPU / SWEEP_ISR_RATE)
+      {
+        first = s.now;
+        timed = 0;
+      }
+    }
+    else
+    {
+      double period = (double)(s.now - last);
+
+      if (period < min_period)
+        min_period = period;
+      if (period > max_period)
+        max_period = period;
+      timed++;
+    }
+    last = s.now;
+  }
+  free(s.e.SweepSteps);
+
+  c->edges = s.edges;
+  if (timed)
+  {
+    if (c->mode & MODE_SWEEP)
+    {
+      c->low_error = (per_rpm / max_period - low) * 100.0 / low;
+      c->high_error = (per_rpm / min_period - c->rpm) * 100.0 / c->rpm;
+    }
+    else
+    {
+      double mean = (double)(last - first) / timed;
+
+      c->mean_ppm = (mean - exact) * 1e6 / exact;
+      c->worst_ppm = fmax(max_period - exact, exact - min_period) * 1e6 / exact;
+    }
+  }
+  c->wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+//! Gets a worker its next case, its own first, then stolen
+static bool next_case(std::vector<work_queue> &queues, unsigned self, uint32_t *index)
+{
+  {
+    std::lock_guard<std::mutex> guard(queues[self].lock);
+
+    if (!queues[self].cases.empty())
+    {
+      *index = queues[self].cases.front();
+      queues[self].cases.pop_front();
+      return true;
+    }
+  }
+  for (unsigned i = 1; i < queues.size(); i++)
+  {
+    work_queue &q = queues[(self + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(q.lock);
+
+    if (!q.cases.empty())
+    {
+      *index = q.cases.back();
+      q.cases.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+
+static void worker(std::vector<work_queue> *queues, unsigned self, std::vector<matrix_case> *cases,
+                   const bench *b, std::atomic<uint32_t> *done, uint32_t *stolen)
+{
+  uint32_t index;
+
+  while (next_case(*queues, self, &index))
+  {
+    uint32_t n;
+
+    if ((uint64_t)index * (*queues).size() / cases->size() != self)
+      (*stolen)++;
+    run_case(&(*cases)[index], b);
+    n = ++(*done);
+    if (!(n % PROGRESS_EVERY))
+      fprintf(stderr, "%u/%zu cases\n", n, cases->size());
+  }
+}
+
+
+static void print_case(const matrix_case *c)
+{
+  char mode[32];
+
+  printf("  %3u %-28.28s %5u %-22s %10" PRIu64, c->wheel + 1, Wheels[c->wheel].decoder_name, c->rpm,
+         mode_name(c->mode, mode), c->edges);
+  if (c->mode & MODE_SWEEP)
+    printf(" %+9.3f%% %+9.3f%%", c->low_error, c->high_error);
+  else
+    printf(" %+9.3f %10.1f", c->mean_ppm, c->worst_ppm);
+  if (c->mismatches)
+    printf("  %" PRIu64 " MISMATCHED", c->mismatches);
+  printf("\n");
+}
+
+
+int main(int argc, char **argv)
+{
+  bench b = { 1.0, 5000, std::thread::hardware_concurrency(), false, false };
+  unsigned rpms[MAX_RPMS] = { 10, 100, 500, 1000, 3000, 6000, 12000 };
+  unsigned rpm_count = 7;
+  unsigned wheel = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "w:r:S:t:j:Fv")) != -1)
+  {
+    switch (opt) {
+      case 'w':
+        wheel = atoi(optarg);
+        break;
+      case 'r':
+        {
+          char *p = optarg;
+
+          for (rpm_count = 0; *p && (rpm_count < MAX_RPMS); rpm_count++)
+          {
+            rpms[rpm_count] = strtoul(p, &p, 10);
+            if ((rpms[rpm_count] < 10) || (rpms[rpm_count] > 65535) || (*p && (*p++ != ',')))
+            {
+              usage(argv[0]);
+              return 1;
+            }
+          }
+        }
+        break;
+      case 'S':
+        b.rate = atoi(optarg);
+        break;
+      case 't':
+        b.seconds = atof(optarg);
+        break;
+      case 'j':
+        b.threads = atoi(optarg);
+        break;
+      case 'F':
+        b.fixed_only = true;
+        break;
+      case 'v':
+        b.verbose = true;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (!b.threads)
+    b.threads = 1;
+  /* Same limits as the serial menu */
+  if ((wheel > MAX_WHEELS) || (b.seconds <= 0) || !rpm_count || (b.rate < 1) || (b.rate >= 51200))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  /* The matrix in report order */
+  std::vector<matrix_case> cases;
+  unsigned modes = 0;
+
+  for (uint8_t m = 0; m < MODES; m++)
+    if (valid_mode(m, &b))
+      modes++;
+  for (uint8_t w = 0; w < MAX_WHEELS; w++)
+  {
+    if (wheel && (w != wheel - 1))
+      continue;
+    for (unsigned r = 0; r < rpm_count; r++)
+      for (uint8_t m = 0; m < MODES; m++)
+      {
+        matrix_case c;
+
+        /* A sweep needs room above the 10 RPM minimum */
+        if (!valid_mode(m, &b) || ((m & MODE_SWEEP) && (rpms[r] <= 10)))
+          continue;
+        memset(&c, 0, sizeof(c));
+        c.wheel = w;
+        c.rpm = rpms[r];
+        c.mode = m;
+        cases.push_back(c);
+      }
+  }
+  if (b.threads > cases.size())
+    b.threads = cases.size();
+  printf("%zu cases (%u wheels x %u RPMs x %u modes), %.1f simulated seconds each, sweeps %u-100%% at up to %u RPM/sec, %u threads\n",
+         cases.size(), wheel ? 1 : MAX_WHEELS, rpm_count, modes, b.seconds, 100 / SWEEP_SPAN, b.rate, b.threads);
+
+  /* Each worker starts with a contiguous block, the stealing evens it out */
+  std::vector<work_queue> queues(b.threads);
+  std::vector<uint32_t> stolen(b.threads, 0);
+  std::vector<std::thread> pool;
+  std::atomic<uint32_t> done(0);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for (uint32_t i = 0; i < cases.size(); i++)
+    queues[(uint64_t)i * b.threads / cases.size()].cases.push_back(i);
+  for (unsigned t = 0; t < b.threads; t++)
+    pool.push_back(std::thread(worker, &queues, t, &cases, &b, &done, &stolen[t]));
+  for (unsigned t = 0; t < b.threads; t++)
+    pool[t].join();
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  /* Merge, per mode and overall */
+  uint64_t total_edges = 0;
+  uint64_t failed = 0;
+  double cpu = 0;
+  const matrix_case *worst_mean = NULL;
+  const matrix_case *worst_edge = NULL;
+  const matrix_case *worst_sweep = NULL;
+
+  for (size_t i = 0; i < cases.size(); i++)
+  {
+    total_edges += cases[i].edges;
+    cpu += cases[i].wall;
+    if (cases[i].mismatches)
+      failed++;
+  }
+  for (uint8_t m = 0; m < MODES; m++)
+  {
+    uint64_t edges = 0;
+    uint64_t mismatched = 0;
+    unsigned count = 0;
+    double mean = 0, worst = 0, low = 0, high = 0;
+    char name[32];
+
+    if (!valid_mode(m, &b))
+      continue;
+    for (size_t i = 0; i < cases.size(); i++)
+    {
+      const matrix_case *c = &cases[i];
+
+      if (c->mode != m)
+        continue;
+      count++;
+      edges += c->edges;
+      mismatched += c->mismatches ? 1 : 0;
+      if (m & MODE_SWEEP)
+      {
+        low = fmax(low, fabs(c->low_error));
+        high = fmax(high, fabs(c->high_error));
+        if (!worst_sweep || (fmax(fabs(c->low_error), fabs(c->high_error)) >
+                             fmax(fabs(worst_sweep->low_error), fabs(worst_sweep->high_error))))
+          worst_sweep = c;
+      }
+      else
+      {
+        mean = fmax(mean, fabs(c->mean_ppm));
+        worst = fmax(worst, c->worst_ppm);
+        if (!worst_mean || (fabs(c->mean_ppm) > fabs(worst_mean->mean_ppm)))
+          worst_mean = c;
+        if (!worst_edge || (c->worst_ppm > worst_edge->worst_ppm))
+          worst_edge = c;
+      }
+    }
+    if (!count)
+      continue;
+    if (!m || (m == MODE_SWEEP))
+      printf("\n  %-22s %6s %12s %10s %12s %12s\n", "mode", "cases", "edges", "mismatched",
+             (m & MODE_SWEEP) ? "low end %" : "mean ppm", (m & MODE_SWEEP) ? "high end %" : "worst ppm");
+    printf("  %-22s %6u %12" PRIu64 " %10" PRIu64 " %12.3f %12.3f\n", mode_name(m, name), count, edges, mismatched,
+           (m & MODE_SWEEP) ? low : mean, (m & MODE_SWEEP) ? high : worst);
+  }
+  if (b.verbose || failed)
+  {
+    printf("\n  %3s %-28s %5s %-22s %10s %10s %10s\n", "#", "wheel", "rpm", "mode", "edges", "mean ppm", "worst ppm");
+    for (size_t i = 0; i < cases.size(); i++)
+      if (b.verbose || cases[i].mismatches)
+        print_case(&cases[i]);
+  }
+
+  printf("\nWorst cases (#, wheel, rpm, mode, edges, mean ppm/low end %%, worst ppm/high end %%):\n");
+  if (worst_mean)
+    print_case(worst_mean);
+  if (worst_edge && (worst_edge != worst_mean))
+    print_case(worst_edge);
+  if (worst_sweep)
+    print_case(worst_sweep);
+  printf("\n%" PRIu64 " edges in %.1f s (%.1f s of worker time), %.1f M edges/s, %.1f M edges/s per thread\n",
+         total_edges, wall, cpu, total_edges / wall / 1e6, cpu ? total_edges / cpu / 1e6 : 0.0);
+  printf("Cases stolen by each thread:");
+  for (unsigned t = 0; t < b.threads; t++)
+    printf(" %u", stolen[t]);
+  printf("\n");
+  if (failed)
+    printf("%" PRIu64 " cases emitted edges that don't match their wheel table\n", failed);
+  return failed ? 1 : 0;
+}
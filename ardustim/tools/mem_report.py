@@ -0,0 +1,179 @@
+#!/usr/bin/env python
+#
+# vim: filetype=python expandtab shiftwidth=4 tabstop=4 softtabstop=4:
+#
+# Arbritrary crank/cam wheel pattern generator
+#
+# copyright 2014-2017 David J. Andruczyk
+#
+# Ardu-Stim software is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# ArduStim software is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+#
+
+"""Flash and RAM report per subsystem and per wheel table.
+
+Sizes every named symbol of the firmware ELF (avr-nm -S) and books it to
+the wheel tables it belongs to (wheel_defs.h/wheels.cpp), the
+firmware source file that defines it, F() strings, interrupt handlers or
+the Arduino core and libc. Tracks shared between wheels are booked to the first wheel using
+them. Stack and heap use are only known at run time, see the info
+command (memory.cpp).
+
+PlatformIO runs this after every firmware link (extra_scripts in
+platformio.ini). Standalone:
+
+    python tools/mem_report.py .pio/build/<env>/firmware.elf --mcu atmega328p
+    python tools/mem_report.py --nm firmware.nm --mcu atmega2560
+"""
+
+import argparse
+import glob
+import os
+import re
+import subprocess
+import sys
+
+# Flash (minus the Optiboot/stk500v2 bootloader) and RAM
+LIMITS = {
+    "atmega328p": (32256, 2048),
+    "atmega1280": (126976, 8192),
+    "atmega2560": (253952, 8192),
+}
+SYMBOL = re.compile(r"^([0-9a-f]+) ([0-9a-f]+) ([A-Za-z]) (.+)$")
+DEFINITION = re.compile(r"^(?!extern\b|return\b)(?:[\w:<>]+[\s\*&]+)+\**(\w+)\s*(?:\(|\[|=|;)", re.M)
+
+
+def load_wheels(src):
+    """[(friendly name, [symbols])] from wheels.cpp and wheel_defs.h"""
+    with open(os.path.join(src, "wheel_defs.h")) as f:
+        names = dict(re.findall(r"const char (\w+)\[\] PROGMEM = \"([^\"]*)\"", f.read()))
+    with open(os.path.join(src, "wheels.cpp")) as f:
+        rows = re.findall(r"\{\s*(\w+),\s*(\w+),\s*(\w+),\s*[0-9.]+,\s*\d+\s*(?:,\s*(\w+)\s*)?\}", f.read())
+    return [(names.get(row[0], row[0]), [s for s in row if s and s != "NULL"]) for row in rows]
+
+
+def load_sources(src):
+    """{symbol: subsystem}, every top level definition of every source file
+
+    Sources go before headers so a prototype doesn't claim a function that
+    is defined in another file
+    """
+    owners = {}
+    sources = sorted(glob.glob(os.path.join(src, "*.cpp")) + glob.glob(os.path.join(src, "*.ino")))
+    for path in sources + sorted(glob.glob(os.path.join(src, "*.h"))):
+        stem = os.path.splitext(os.path.basename(path))[0]
+        with open(path) as f:
+            text = f.read()
+        for name in DEFINITION.findall(text):
+            owners.setdefault(name, stem)
+    return owners
+
+
+def base_name(symbol):
+    """sweep_engine(engine*) -> sweep_engine, HardwareSerial::write() -> write"""
+    return symbol.split("(")[0].split("::")[-1].strip()
+
+
+def classify(lines, src):
+    """Books every sized symbol, returns ({subsystem: [flash, ram]}, [(wheel, flash, shared)])"""
+    wheels = load_wheels(src)
+    owners = load_sources(src)
+    wheel_of = {}
+    for index, (name, symbols) in enumerate(wheels):
+        for symbol in symbols:
+            wheel_of.setdefault(symbol, index)
+    subsystems = {}
+    wheel_flash = [0] * len(wheels)
+    for line in lines:
+        m = SYMBOL.match(line.strip())
+        if not m:
+            continue
+        size = int(m.group(2), 16)
+        kind = m.group(3).lower()
+        symbol = m.group(4)
+        flash = size if kind in "tdrw" else 0
+        ram = size if kind in "db" else 0
+        name = base_name(symbol)
+        if name in wheel_of:
+            wheel_flash[wheel_of[name]] += flash
+            where = "wheel tables"
+        elif name == "Wheels":
+            where = "wheel tables"
+        elif symbol.startswith("__c."):
+            where = "F() strings"
+        elif symbol.startswith("__vector_"):
+            where = "interrupt handlers"
+        elif name in owners:
+            where = owners[name]
+        else:
+            where = "core/libc"
+        totals = subsystems.setdefault(where, [0, 0])
+        totals[0] += flash
+        totals[1] += ram
+    shared = {}
+    for index, (name, symbols) in enumerate(wheels):
+        shared[index] = [s for s in symbols if wheel_of[s] != index]
+    return subsystems, [(wheels[i][0], wheel_flash[i], shared[i]) for i in range(len(wheels))]
+
+
+def report(mcu, subsystems, wheels, out):
+    flash_limit, ram_limit = LIMITS[mcu]
+    flash = sum(f for f, r in subsystems.values())
+    ram = sum(r for f, r in subsystems.values())
+    out.write("Memory report (%s, named symbols, stack/heap not included)\n" % mcu)
+    out.write("  %-24s %7s %7s\n" % ("subsystem", "flash", "RAM"))
+    for name, (f, r) in sorted(subsystems.items(), key=lambda item: -item[1][0]):
+        out.write("  %-24s %7d %7d\n" % (name, f, r))
+    out.write("  %-24s %7d %7d\n" % ("total", flash, ram))
+    out.write("  %-24s %7d %7d\n" % ("left", flash_limit - flash, ram_limit - ram))
+    out.write("\nFlash per wheel table:\n")
+    for name, f, shared in wheels:
+        out.write("  %-40s %6d%s\n" % (name, f, ("  (+ shared %s)" % ", ".join(shared)) if shared else ""))
+
+
+def run(nm, mcu, src, out=sys.stdout):
+    subsystems, wheels = classify(nm, src)
+    report(mcu, subsystems, wheels, out)
+    return 0
+
+
+def main(argv):
+    here = os.path.dirname(os.path.abspath(argv[0]))
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("elf", nargs="?", help="firmware ELF")
+    parser.add_argument("--nm", help="avr-nm -S -C output instead of an ELF")
+    parser.add_argument("--mcu", required=True, choices=sorted(LIMITS))
+    parser.add_argument("--nm-tool", default="avr-nm")
+    args = parser.parse_args(argv[1:])
+    if args.nm:
+        with open(args.nm) as f:
+            nm = f.read().splitlines()
+    elif args.elf:
+        nm = subprocess.check_output([args.nm_tool, "-S", "-C", args.elf]).decode().splitlines()
+    else:
+        parser.error("need an ELF or --nm")
+    return run(nm, args.mcu, os.path.join(here, "..", "ardustim"))
+
+
+try:
+    Import("env")  # noqa: F821, PlatformIO extra_scripts
+except NameError:
+    if __name__ == "__main__":
+        sys.exit(main(sys.argv))
+else:
+    def report_action(target, source, env):
+        nm_tool = env.subst("$OBJCOPY").replace("objcopy", "nm")
+        nm = subprocess.check_output([nm_tool, "-S", "-C", str(target[0])]).decode().splitlines()
+        return run(nm, env.BoardConfig().get("build.mcu"), env.subst("$PROJECT_SRC_DIR"))
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report_action)  # noqa: F821
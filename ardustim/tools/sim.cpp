@@ -0,0 +1,120 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#include <string.h>
+#include "commit.h"
+#include "defines.h"
+#include "enums.h"
+#include "pattern.h"
+#include "sim.h"
+#include "sweep.h"
+#include "user_defaults.h"
+
+volatile uint16_t hal_host_adc; /* Pot reading hal_adc_read() returns */
+
+
+//! Sets up a simulated engine the way setup() does on the board
+/*!
+ * Same defaults as init_engine(), Timer1 at /1 with OCR1A = 1000, the
+ * caller then picks the RPM with reset_new_OCR1A() or setup_sweep()
+ * \param s simulation to initialize
+ * \param wheel index into Wheels[]
+ */
+void sim_init(sim *s, uint8_t wheel)
+{
+  memset(s, 0, sizeof(sim));
+  s->e.selected_wheel = wheel;
+  s->e.normal = true;
+  s->e.new_OCR1A = 5000;
+  s->e.sweep_reset_prescaler = true;
+  s->e.sweep_direction = ASCENDING;
+  s->e.mode = FIXED_RPM;
+  s->e.wanted_rpm = DEFAULT_RPM;
+  s->tccrb = PRESCALE_1;
+  s->ocr = 1000;
+  s->timer1.tccrb = &s->tccrb;
+  s->timer1.ocr = &s->ocr;
+  s->next_edge = s->ocr + 1;
+  s->next_sweep = SIM_F_CPU / SWEEP_ISR_RATE;
+}
+
+
+//! Gets the Timer1 prescaler the simulation is running at
+uint32_t sim_prescale(sim *s)
+{
+  switch (s->tccrb & ((1 << CS10) | (1 << CS11) | (1 << CS12))) {
+    case PRESCALE_1024:
+      return 1024;
+    case PRESCALE_256:
+      return 256;
+    case PRESCALE_64:
+      return 64;
+    case PRESCALE_8:
+      return 8;
+  }
+  return 1;
+}
+
+
+//! Runs the simulation up to the next emitted edge
+/*!
+ * Steps through Timer2 sweeper ticks and Timer1 compare matches in time
+ * order (Timer2 first on a tie, as its vector has the higher priority).
+ * Idle extended timer chunks don't count as edges.
+ * \param s simulation to run
+ * \param end cycle to stop at
+ * \returns true with now, crank and cam set for the edge, false once the
+ * next edge would be past end
+ */
+bool sim_next_edge(sim *s, uint64_t end)
+{
+  engine *e = &s->e;
+
+  while (1)
+  {
+    if (s->next_sweep <= s->next_edge)
+    {
+      if (s->next_sweep > end)
+        return false;
+      s->now = s->next_sweep;
+      sweep_engine(e);
+      s->next_sweep += SIM_F_CPU / SWEEP_ISR_RATE;
+      continue;
+    }
+    if (s->next_edge > end)
+      return false;
+    s->now = s->next_edge;
+    if (!extended_idle(e, &s->timer1))
+    {
+      if (e->commit_armed && (e->edge_counter == e->commit_edge))
+        apply_commit(e);
+      output_edge(e, &s->crank, &s->cam);
+      advance_edge(e);
+      load_next_period(e, &s->timer1, s->trim);
+      s->next_edge = s->now + ((uint64_t)s->ocr + 1) * sim_prescale(s);
+      s->edges++;
+      return true;
+    }
+    s->next_edge = s->now + ((uint64_t)s->ocr + 1) * sim_prescale(s);
+  }
+}
@@ -0,0 +1,56 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <inttypes.h>
+#include "hal.h"
+#include "structures.h"
+
+#define SIM_F_CPU 16000000UL /* Cycles per second, as on the boards */
+
+/* One engine running the firmware's own edge/sweeper code (pattern.h) on a
+ * simulated Timer1, with time kept in CPU cycles. Compare matches are the
+ * event times, the (constant) ISR entry latency isn't modelled.
+ */
+typedef struct _sim sim;
+struct _sim {
+  engine e;
+  volatile uint8_t tccrb;  /* Timer1 TCCR1B, only the clock select bits */
+  volatile uint16_t ocr;   /* Timer1 OCR1A */
+  hal_timer timer1;        /* HAL view of the two above */
+  uint64_t now;            /* Cycle of the last event */
+  uint64_t next_edge;      /* Cycle of the next Timer1 compare match */
+  uint64_t next_sweep;     /* Cycle of the next Timer2 (sweeper) tick */
+  uint32_t edges;          /* Edges emitted so far */
+  int16_t trim;            /* Added to every edge period, sync_trim on a sync slave */
+  volatile uint8_t crank;  /* Crank and cam ports (output_edge()), the */
+  volatile uint8_t cam;    /* values of the last emitted edge */
+};
+
+void sim_init(sim *, uint8_t);
+bool sim_next_edge(sim *, uint64_t);
+uint32_t sim_prescale(sim *);
+
+#endif
@@ -0,0 +1,862 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+
+/* Benchmarks how quickly reference decoders sync on each wheel, fed from
+ * the firmware's own wheel tables, RPM/sweep math and edge code (see
+ * sim.h), and how they cope with glitches:
+ * - missing tooth: crank only, a gap longer than (missing + 2) / 2 times
+ *   the one before marks the tooth after the gap, the teeth counted
+ *   between gaps confirm it
+ * - missing tooth + cam: the above, the cam pulses counted over each
+ *   revolution tell the two revolutions of a 720 degree cycle apart
+ * - N+1 cam: one cam pulse per cycle restarts the crank tooth count, the
+ *   count has to match again at the next cam pulse
+ * The crank is track bit 0, the cam is the cam track bit with the fewest
+ * pulses per cycle that isn't a copy of the crank. A tooth or pulse is the
+ * edge into the level the track spends the least time at. A decoder that
+ * can't work with a wheel says why.
+ *
+ * Time to first sync is taken over a spread of starting angles without
+ * faults. The fault run then injects an extra crank tooth, a dropped crank
+ * tooth and a dropped cam pulse in turn, and reports how many of them
+ * made a decoder that was in sync lose it, how long it took to be back in
+ * sync, and the sync losses no fault explains (e.g. a sweep too steep for
+ * the gap ratio). Every sync point is checked against the true crank
+ * angle, one at the wrong angle counts as a false sync.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "defines.h"
+#include "enums.h"
+#include "sim.h"
+#include "structures.h"
+#include "sweep.h"
+#include "wheel_defs.h"
+
+#define CYCLES_PER_MS (SIM_F_CPU / 1000.0)
+#define FIRST_SYNC_CYCLES 4  /* Wheel cycles a decoder gets for its first sync */
+#define NO_ANGLE -1.0        /* Injected tooth, not on the wheel */
+
+extern wheels Wheels[];
+
+/* What the reference decoders need to know about a wheel, from its tables */
+typedef struct _wheel_profile wheel_profile;
+struct _wheel_profile {
+  uint16_t edges;
+  uint16_t degrees;
+  double edge_degrees;
+  uint8_t crank_bit;
+  uint8_t crank_level;   /* Level a tooth starts */
+  uint8_t cam_bit;
+  uint8_t cam_level;
+  uint16_t teeth;        /* Crank teeth per cycle */
+  uint16_t cams;         /* Cam pulses per cycle, 0 without a cam track */
+  /* Missing tooth layout, total is 0 if the crank isn't one */
+  uint16_t total;        /* Teeth per revolution, missing ones included */
+  uint8_t missing;
+  uint16_t gap_edge[2];  /* Edge of the tooth after each gap */
+  uint8_t cam_rev[2];    /* Cam pulses in the revolution up to each gap */
+  uint16_t cam_tooth;    /* Edge of the first crank tooth after the cam pulse */
+};
+
+enum {
+  MISSING_TOOTH,
+  MISSING_TOOTH_CAM,
+  N_PLUS_ONE,
+  DECODERS
+};
+
+enum {
+  FAULT_EXTRA_TOOTH,
+  FAULT_DROP_TOOTH,
+  FAULT_DROP_CAM,
+  FAULTS
+};
+
+/* Missing tooth crank results */
+enum {
+  MT_NONE,
+  MT_GAP,
+  MT_LOST
+};
+
+/* A reference decoder and what the bench measured on it */
+typedef struct _decoder decoder;
+struct _decoder {
+  uint8_t type;
+  const char *why;        /* Why it can't decode the wheel, NULL if it can */
+  double modulo;          /* Degrees its sync points repeat over */
+  double ref_angle[2];    /* True crank angle of each sync point */
+  /* Decoder state */
+  bool synced;
+  bool crank_synced;      /* Missing tooth part */
+  uint64_t last_tooth;
+  uint64_t last_gap;
+  uint8_t history;        /* Teeth seen, up to 2 */
+  uint16_t count;         /* Teeth since the gap/cam pulse */
+  bool cams_valid;        /* Cam count started at a gap */
+  uint8_t cams;
+  uint8_t phase;
+  bool armed;             /* N+1, cam pulse seen */
+  /* Time to first sync */
+  bool first_done;
+  uint16_t first_runs;
+  uint16_t first_never;
+  double first_deg_sum, first_deg_max;
+  double first_ms_sum, first_ms_max;
+  /* Fault run */
+  bool pending;           /* A fault hit while in sync */
+  bool pending_lost;
+  uint64_t fault_time;
+  double fault_travel;
+  uint32_t faults;
+  uint32_t caught;
+  uint32_t resyncs;
+  double resync_ms_sum, resync_ms_max;
+  double resync_deg_sum, resync_deg_max;
+  uint32_t spurious;
+  uint32_t false_syncs;
+};
+
+/* Run settings */
+typedef struct _bench bench;
+struct _bench {
+  unsigned rpm;
+  unsigned low, high, rate;
+  unsigned fault_ms;
+  double seconds;
+  unsigned starts;
+};
+
+static const char *decoder_names[DECODERS] = {
+  "missing tooth",
+  "missing tooth+cam",
+  "N+1 cam",
+};
+
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+    "usage: %s [-w wheel] [-r rpm | -s low,high,rate] [-g fault_ms] [-t seconds]\n"
+    "          [-p starts]\n"
+    "  -w  wheel number as in the serial menu (default all)\n"
+    "  -r  fixed RPM (default 1000)\n"
+    "  -s  sweep low,high RPM at rate RPM/sec\n"
+    "  -g  ms between injected faults in the fault run (default 250, 0 for none)\n"
+    "  -t  length of the fault run in seconds (default 10)\n"
+    "  -p  starting angles for time to first sync (default 24)\n", name);
+}
+
+
+static uint8_t track_bit(const unsigned char *track, uint8_t bit, uint16_t edge)
+{
+  return (pgm_read_byte(&track[edge]) >> bit) & 1;
+}
+
+
+/* Edges into level over one cycle, listed in edge_list if not NULL */
+static uint16_t track_pulses(const unsigned char *track, uint8_t bit, uint8_t level, uint16_t edges, uint16_t *edge_list)
+{
+  uint16_t pulses = 0;
+
+  for (uint16_t i = 0; i < edges; i++)
+  {
+    if ((track_bit(track, bit, i) == level) && (track_bit(track, bit, (i + edges - 1) % edges) != level))
+    {
+      if (edge_list)
+        edge_list[pulses] = i;
+      pulses++;
+    }
+  }
+  return pulses;
+}
+
+
+/* The level a track spends the fewest edges at, 1 on a tie */
+static uint8_t track_level(const unsigned char *track, uint8_t bit, uint16_t edges)
+{
+  uint16_t high = 0;
+
+  for (uint16_t i = 0; i < edges; i++)
+    high += track_bit(track, bit, i);
+  return (high * 2 <= edges) ? 1 : 0;
+}
+
+
+/* Listed edges in [from, to), cyclic */
+static uint8_t edges_between(const uint16_t *edge_list, uint16_t count, uint16_t from, uint16_t to, uint16_t edges)
+{
+  uint16_t span = (to - from + edges) % edges;
+  uint8_t n = 0;
+
+  if (!span)
+    span = edges;
+  for (uint16_t i = 0; i < count; i++)
+    if ((edge_list[i] - from + edges) % edges < span)
+      n++;
+  return n;
+}
+
+
+//! Works out the crank and cam layout of a wheel from its tables
+static void build_profile(uint8_t wheel, wheel_profile *p)
+{
+  const unsigned char *crank = Wheels[wheel].edge_crank_ptr;
+  const unsigned char *cam = Wheels[wheel].edge_states_ptr;
+  uint16_t teeth[MAX_WHEEL_EDGES];
+  uint16_t cams[MAX_WHEEL_EDGES];
+  uint16_t revs;
+
+  memset(p, 0, sizeof(wheel_profile));
+  p->edges = Wheels[wheel].wheel_max_edges;
+  p->degrees = get_wheel_degrees(wheel);
+  p->edge_degrees = (double)p->degrees / p->edges;
+  p->crank_level = track_level(crank, p->crank_bit, p->edges);
+  p->teeth = track_pulses(crank, p->crank_bit, p->crank_level, p->edges, teeth);
+
+  for (uint8_t bit = 0; bit < 8; bit++)
+  {
+    bool copy = true;
+    uint8_t level;
+    uint16_t pulses;
+
+    for (uint16_t i = 0; copy && (i < p->edges); i++)
+      copy = (track_bit(cam, bit, i) == track_bit(crank, p->crank_bit, i));
+    if (copy)
+      continue;
+    level = track_level(cam, bit, p->edges);
+    pulses = track_pulses(cam, bit, level, p->edges, NULL);
+    if (pulses && (!p->cams || (pulses < p->cams)))
+    {
+      p->cams = pulses;
+      p->cam_bit = bit;
+      p->cam_level = level;
+    }
+  }
+  if (p->cams)
+    track_pulses(cam, p->cam_bit, p->cam_level, p->edges, cams);
+
+  /* Missing tooth: one gap per revolution, the same number of pitches
+   * long, every other tooth one pitch apart
+   */
+  revs = p->degrees / 360;
+  if ((p->teeth >= 3) && ((revs == 1) || (revs == 2)) && (p->degrees % 360 == 0))
+  {
+    uint16_t pitch = p->edges;
+    uint16_t gaps = 0;
+    uint16_t gap_pitches = 0;
+    bool regular = true;
+
+    for (uint16_t j = 0; j < p->teeth; j++)
+    {
+      uint16_t gap = (teeth[(j + 1) % p->teeth] - teeth[j] + p->edges) % p->edges;
+      if (gap < pitch)
+        pitch = gap;
+    }
+    for (uint16_t j = 0; regular && (j < p->teeth); j++)
+    {
+      uint16_t gap = (teeth[(j + 1) % p->teeth] - teeth[j] + p->edges) % p->edges;
+      uint16_t pitches = (gap + pitch / 2) / pitch;
+
+      if (pitches * pitch != gap)
+        regular = false;
+      else if (pitches > 1)
+      {
+        if ((gaps == revs) || (gap_pitches && (pitches != gap_pitches)))
+          regular = false;
+        else
+        {
+          p->gap_edge[gaps++] = teeth[(j + 1) % p->teeth];
+          gap_pitches = pitches;
+        }
+      }
+    }
+    if (regular && (gaps == revs))
+    {
+      uint16_t total = (uint16_t)(360.0 / (pitch * p->edge_degrees) + 0.5);
+
+      if (p->teeth / revs == total - (gap_pitches - 1))
+      {
+        p->total = total;
+        p->missing = gap_pitches - 1;
+      }
+    }
+    if (p->total && p->cams)
+    {
+      for (uint8_t k = 0; k < revs; k++)
+        p->cam_rev[k] = edges_between(cams, p->cams, p->gap_edge[(k + revs - 1) % revs], p->gap_edge[k], p->edges);
+    }
+  }
+
+  /* N+1: the crank is fed before the cam on the same edge, so the sync
+   * tooth is the first one strictly after the cam pulse
+   */
+  if (p->cams == 1)
+  {
+    uint16_t best = p->edges + 1;
+
+    for (uint16_t j = 0; j < p->teeth; j++)
+    {
+      uint16_t d = (teeth[j] - cams[0] + p->edges) % p->edges;
+      if (!d)
+        d = p->edges;
+      if (d < best)
+      {
+        best = d;
+        p->cam_tooth = teeth[j];
+      }
+    }
+  }
+}
+
+
+//! Sets up a decoder for a wheel, results zeroed
+static void decoder_init(decoder *d, uint8_t type, const wheel_profile *p)
+{
+  memset(d, 0, sizeof(decoder));
+  d->type = type;
+  switch (type)
+  {
+    case MISSING_TOOTH:
+      if (!p->total)
+        d->why = "crank isn't a missing tooth wheel";
+      d->modulo = 360;
+      d->ref_angle[0] = fmod(p->gap_edge[0] * p->edge_degrees, 360);
+      break;
+    case MISSING_TOOTH_CAM:
+      if (!p->total)
+        d->why = "crank isn't a missing tooth wheel";
+      else if (p->degrees != 720)
+        d->why = "360 degree wheel, no cycle to phase";
+      else if (!p->cams)
+        d->why = "no cam track";
+      else if (p->cam_rev[0] == p->cam_rev[1])
+        d->why = "same cam pulses in both revolutions";
+      d->modulo = 720;
+      d->ref_angle[0] = p->gap_edge[0] * p->edge_degrees;
+      d->ref_angle[1] = p->gap_edge[1] * p->edge_degrees;
+      break;
+    case N_PLUS_ONE:
+      if (p->cams != 1)
+        d->why = "cam doesn't pulse once per cycle";
+      d->modulo = p->degrees;
+      d->ref_angle[0] = p->cam_tooth * p->edge_degrees;
+      break;
+  }
+}
+
+
+//! Clears the decoding state, keeps the results
+static void decoder_restart(decoder *d)
+{
+  d->synced = false;
+  d->crank_synced = false;
+  d->history = 0;
+  d->count = 0;
+  d->cams_valid = false;
+  d->cams = 0;
+  d->armed = false;
+  d->first_done = false;
+  d->pending = false;
+}
+
+
+/* Missing tooth logic shared by both missing tooth decoders */
+static uint8_t missing_tooth(decoder *d, const wheel_profile *p, uint64_t t)
+{
+  uint8_t result = MT_NONE;
+  uint16_t expected = p->total - p->missing;
+
+  if (d->history)
+  {
+    uint64_t gap = t - d->last_tooth;
+
+    if ((d->history > 1) && (gap * 2 > d->last_gap * (p->missing + 2)))
+    {
+      if (d->crank_synced && (d->count != expected))
+      {
+        d->crank_synced = false;
+        result = MT_LOST;
+      }
+      else
+      {
+        d->crank_synced = true;
+        result = MT_GAP;
+      }
+      d->count = 1;
+    }
+    else
+    {
+      d->count++;
+      if (d->crank_synced && (d->count > expected))
+      {
+        d->crank_synced = false;
+        result = MT_LOST;
+      }
+    }
+    d->last_gap = gap;
+  }
+  if (d->history < 2)
+    d->history++;
+  d->last_tooth = t;
+  return result;
+}
+
+
+/* Feeds a crank tooth, sets lost if sync was lost and returns true at a
+ * sync point with the sync point's index in ref
+ */
+static bool decoder_crank(decoder *d, const wheel_profile *p, uint64_t t, bool *lost, uint8_t *ref)
+{
+  uint8_t result;
+
+  *lost = false;
+  *ref = 0;
+  switch (d->type)
+  {
+    case MISSING_TOOTH:
+      result = missing_tooth(d, p, t);
+      *lost = (result == MT_LOST);
+      d->synced = d->crank_synced;
+      return result == MT_GAP;
+    case MISSING_TOOTH_CAM:
+      result = missing_tooth(d, p, t);
+      if (result == MT_LOST)
+      {
+        *lost = d->synced;
+        d->synced = false;
+        d->cams_valid = false;
+        return false;
+      }
+      if (result != MT_GAP)
+        return false;
+      if (d->cams_valid)
+      {
+        if (d->synced)
+        {
+          d->phase ^= 1;
+          if (d->cams != p->cam_rev[d->phase])
+          {
+            *lost = true;
+            d->synced = false;
+          }
+        }
+        else if ((d->cams == p->cam_rev[0]) || (d->cams == p->cam_rev[1]))
+        {
+          d->phase = (d->cams == p->cam_rev[1]) ? 1 : 0;
+          d->synced = true;
+        }
+      }
+      d->cams_valid = true;
+      d->cams = 0;
+      *ref = d->phase;
+      return d->synced;
+    case N_PLUS_ONE:
+      d->count++;
+      if (d->armed)
+      {
+        d->armed = false;
+        d->synced = true;
+        return true;
+      }
+      if (d->synced && (d->count > p->teeth))
+      {
+        *lost = true;
+        d->synced = false;
+      }
+      return false;
+  }
+  return false;
+}
+
+
+/* Feeds a cam pulse, sets lost if sync was lost */
+static void decoder_cam(decoder *d, const wheel_profile *p, bool *lost)
+{
+  *lost = false;
+  switch (d->type)
+  {
+    case MISSING_TOOTH_CAM:
+      if (d->cams < 255)
+        d->cams++;
+      break;
+    case N_PLUS_ONE:
+      if (d->synced && (d->count != p->teeth))
+      {
+        *lost = true;
+        d->synced = false;
+      }
+      d->count = 0;
+      d->armed = true;
+      break;
+  }
+}
+
+
+/* Books what one fed event did to a decoder */
+static void note_event(decoder *d, bool was_synced, bool lost, bool sync_point, uint8_t ref,
+                       uint64_t t, double angle, double travel, bool fault_run)
+{
+  if (sync_point)
+  {
+    double off = fmod(angle - d->ref_angle[ref] + 2 * d->modulo, d->modulo);
+
+    if ((angle == NO_ANGLE) || ((off > 0.01) && (off < d->modulo - 0.01)))
+      d->false_syncs++;
+  }
+  if (!fault_run)
+  {
+    if (!d->first_done && d->synced)
+    {
+      double ms = t / CYCLES_PER_MS;
+
+      d->first_done = true;
+      d->first_runs++;
+      d->first_deg_sum += travel;
+      d->first_ms_sum += ms;
+      if (travel > d->first_deg_max)
+        d->first_deg_max = travel;
+      if (ms > d->first_ms_max)
+        d->first_ms_max = ms;
+    }
+    return;
+  }
+  if (lost)
+  {
+    if (!d->pending)
+      d->spurious++;
+    else if (!d->pending_lost)
+    {
+      d->pending_lost = true;
+      d->caught++;
+    }
+  }
+  if (!was_synced && d->synced && d->pending && d->pending_lost)
+  {
+    double ms = (t - d->fault_time) / CYCLES_PER_MS;
+    double deg = travel - d->fault_travel;
+
+    d->pending = false;
+    d->resyncs++;
+    d->resync_ms_sum += ms;
+    d->resync_deg_sum += deg;
+    if (ms > d->resync_ms_max)
+      d->resync_ms_max = ms;
+    if (deg > d->resync_deg_max)
+      d->resync_deg_max = deg;
+  }
+}
+
+
+static void feed_crank(decoder *ds, const wheel_profile *p, uint64_t t, double angle, double travel, bool fault_run)
+{
+  for (uint8_t i = 0; i < DECODERS; i++)
+  {
+    decoder *d = &ds[i];
+    bool was_synced = d->synced;
+    bool lost;
+    uint8_t ref;
+    bool sync_point;
+
+    if (d->why)
+      continue;
+    sync_point = decoder_crank(d, p, t, &lost, &ref);
+    note_event(d, was_synced, lost, sync_point, ref, t, angle, travel, fault_run);
+  }
+}
+
+
+static void feed_cam(decoder *ds, const wheel_profile *p, uint64_t t, double travel, bool fault_run)
+{
+  for (uint8_t i = 0; i < DECODERS; i++)
+  {
+    decoder *d = &ds[i];
+    bool was_synced = d->synced;
+    bool lost;
+
+    if (d->why || (d->type == MISSING_TOOTH))
+      continue;
+    decoder_cam(d, p, &lost);
+    note_event(d, was_synced, lost, false, 0, t, 0, travel, fault_run);
+  }
+}
+
+
+/* A fault counts against the decoders in sync that use the signal hit */
+static void start_fault(decoder *ds, uint8_t fault, uint64_t t, double travel)
+{
+  for (uint8_t i = 0; i < DECODERS; i++)
+  {
+    decoder *d = &ds[i];
+
+    if (d->why || !d->synced || ((fault == FAULT_DROP_CAM) && (d->type == MISSING_TOOTH)))
+      continue;
+    d->faults++;
+    d->pending = true;
+    d->pending_lost = false;
+    d->fault_time = t;
+    d->fault_travel = travel;
+  }
+}
+
+
+/* Faults take turns, no cam faults without a cam track */
+static uint8_t next_fault_type(uint8_t fault, const wheel_profile *p)
+{
+  fault = (fault + 1) % FAULTS;
+  if ((fault == FAULT_DROP_CAM) && !p->cams)
+    fault = FAULT_EXTRA_TOOTH;
+  return fault;
+}
+
+
+static bool all_synced(decoder *ds)
+{
+  for (uint8_t i = 0; i < DECODERS; i++)
+    if (!ds[i].why && !ds[i].first_done)
+      return false;
+  return true;
+}
+
+
+//! Runs one wheel from a starting edge, feeding the decoders
+/*!
+ * \param ds decoders, restarted here
+ * \param p wheel layout
+ * \param wheel index into Wheels[]
+ * \param start edge the wheel starts at
+ * \param b run settings
+ * \param fault_run inject faults for b->seconds, otherwise stop once every
+ * decoder synced (or after FIRST_SYNC_CYCLES wheel cycles)
+ * \returns the crank degrees travelled
+ */
+static double run_wheel(decoder *ds, const wheel_profile *p, uint8_t wheel, uint16_t start, const bench *b, bool fault_run)
+{
+  const unsigned char *crank_track = Wheels[wheel].edge_crank_ptr;
+  const unsigned char *cam_track = Wheels[wheel].edge_states_ptr;
+  uint16_t before = (start + p->edges - 1) % p->edges;
+  uint8_t last_crank = track_bit(crank_track, p->crank_bit, before);
+  uint8_t last_cam = track_bit(cam_track, p->cam_bit, before);
+  uint64_t end = fault_run ? (uint64_t)(b->seconds * SIM_F_CPU) : UINT64_MAX;
+  uint64_t fault_every = (uint64_t)b->fault_ms * SIM_F_CPU / 1000;
+  uint64_t next_fault = fault_every;
+  uint64_t last_tooth = 0;
+  bool have_tooth = false;
+  bool fault_due = false;
+  uint8_t fault = FAULT_EXTRA_TOOTH;
+  double travel = 0;
+  sim s;
+
+  for (uint8_t i = 0; i < DECODERS; i++)
+    decoder_restart(&ds[i]);
+  sim_init(&s, wheel);
+  s.e.edge_counter = start;
+  if (b->rate)
+  {
+    s.e.sweep_rate = b->rate;
+    setup_sweep(&s.e, b->low, b->high);
+  }
+  else
+  {
+    s.e.wanted_rpm = b->rpm;
+    reset_new_OCR1A(&s.e, b->rpm);
+  }
+
+  while (sim_next_edge(&s, end))
+  {
+    double angle = ((start + s.edges - 1) % p->edges) * p->edge_degrees;
+    uint8_t crank = (s.crank >> p->crank_bit) & 1;
+    uint8_t cam = (s.cam >> p->cam_bit) & 1;
+
+    travel = s.edges * p->edge_degrees;
+    if (fault_run && fault_every && (s.now >= next_fault))
+    {
+      fault_due = true;
+      next_fault += fault_every;
+    }
+    if ((crank != last_crank) && (crank == p->crank_level))
+    {
+      bool swallow = false;
+
+      if (fault_due && (fault == FAULT_EXTRA_TOOTH) && have_tooth)
+      {
+        uint64_t extra = (last_tooth + s.now) / 2;
+
+        start_fault(ds, fault, extra, travel - p->edge_degrees / 2);
+        feed_crank(ds, p, extra, NO_ANGLE, travel - p->edge_degrees / 2, true);
+        fault_due = false;
+        fault = next_fault_type(fault, p);
+      }
+      else if (fault_due && (fault == FAULT_DROP_TOOTH))
+      {
+        start_fault(ds, fault, s.now, travel);
+        swallow = true;
+        fault_due = false;
+        fault = next_fault_type(fault, p);
+      }
+      if (!swallow)
+        feed_crank(ds, p, s.now, angle, travel, fault_run);
+      last_tooth = s.now;
+      have_tooth = true;
+    }
+    if ((cam != last_cam) && (cam == p->cam_level))
+    {
+      if (fault_due && (fault == FAULT_DROP_CAM))
+      {
+        start_fault(ds, fault, s.now, travel);
+        fault_due = false;
+        fault = next_fault_type(fault, p);
+      }
+      else
+        feed_cam(ds, p, s.now, travel, fault_run);
+    }
+    last_crank = crank;
+    last_cam = cam;
+    if (!fault_run && (all_synced(ds) || (s.edges >= (uint32_t)FIRST_SYNC_CYCLES * p->edges)))
+      break;
+  }
+  free(s.e.SweepSteps);
+  return travel;
+}
+
+
+static void print_wheel(uint8_t wheel, const wheel_profile *p, decoder *ds, double revs)
+{
+  printf("%u:%s, %u degrees, crank %u teeth", wheel + 1, Wheels[wheel].decoder_name, p->degrees, p->teeth);
+  if (p->total)
+    printf(" (%u-%u)", p->total, p->missing);
+  if (p->cams)
+    printf(", cam bit %u %u pulses", p->cam_bit, p->cams);
+  printf(", %.0f revolutions with faults\n", revs);
+  printf("  %-18s %17s %17s %5s %6s %6s %17s %17s %9s\n", "decoder", "1st sync deg", "1st sync ms",
+         "false", "faults", "caught", "resync deg", "resync ms", "loss/krev");
+  for (uint8_t i = 0; i < DECODERS; i++)
+  {
+    decoder *d = &ds[i];
+
+    printf("  %-18s ", decoder_names[i]);
+    if (d->why)
+    {
+      printf("n/a, %s\n", d->why);
+      continue;
+    }
+    if (d->first_runs)
+      printf("%8.1f/%-8.1f %8.2f/%-8.2f ", d->first_deg_sum / d->first_runs, d->first_deg_max,
+             d->first_ms_sum / d->first_runs, d->first_ms_max);
+    else
+      printf("%17s %17s ", "never", "never");
+    printf("%5u %6u %6u ", d->false_syncs, d->faults, d->caught);
+    if (d->resyncs)
+      printf("%8.1f/%-8.1f %8.2f/%-8.2f ", d->resync_deg_sum / d->resyncs, d->resync_deg_max,
+             d->resync_ms_sum / d->resyncs, d->resync_ms_max);
+    else
+      printf("%17s %17s ", "-", "-");
+    printf("%9.2f", revs ? d->spurious * 1000.0 / revs : 0.0);
+    if (d->first_never)
+      printf("  (no sync from %u of the starts)", d->first_never);
+    printf("\n");
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  bench b = { 1000, 0, 0, 0, 250, 10.0, 24 };
+  unsigned wheel = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "w:r:s:g:t:p:")) != -1)
+  {
+    switch (opt) {
+      case 'w':
+        wheel = atoi(optarg);
+        break;
+      case 'r':
+        b.rpm = atoi(optarg);
+        break;
+      case 's':
+        if (sscanf(optarg, "%u,%u,%u", &b.low, &b.high, &b.rate) != 3)
+        {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'g':
+        b.fault_ms = atoi(optarg);
+        break;
+      case 't':
+        b.seconds = atof(optarg);
+        break;
+      case 'p':
+        b.starts = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  /* Same limits as the serial menu */
+  if ((wheel > MAX_WHEELS) || (b.seconds <= 0) || (b.starts < 1) ||
+      (b.rpm < 10) || (b.rpm > 65535) ||
+      (b.rate && ((b.low < 10) || (b.low >= b.high) || (b.high > 65535))))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (b.rate)
+    printf("Sweep %u-%u RPM at %u RPM/sec", b.low, b.high, b.rate);
+  else
+    printf("Fixed %u RPM", b.rpm);
+  printf(", first sync from %u starting angles, a fault every %u ms for %.1f seconds\n\n", b.starts, b.fault_ms, b.seconds);
+  for (uint8_t w = 0; w < MAX_WHEELS; w++)
+  {
+    wheel_profile p;
+    decoder ds[DECODERS];
+    double travel;
+
+    if (wheel && (w != wheel - 1))
+      continue;
+    build_profile(w, &p);
+    for (uint8_t i = 0; i < DECODERS; i++)
+      decoder_init(&ds[i], i, &p);
+    for (unsigned i = 0; i < b.starts; i++)
+    {
+      run_wheel(ds, &p, w, (uint16_t)((uint32_t)i * p.edges / b.starts), &b, false);
+      for (uint8_t j = 0; j < DECODERS; j++)
+        if (!ds[j].why && !ds[j].first_done)
+          ds[j].first_never++;
+    }
+    travel = run_wheel(ds, &p, w, 0, &b, true);
+    print_wheel(w, &p, ds, travel / 360);
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+/* Two boards on one sync wire: a master and a slave whose crystal is off
+ * by a set amount, each running the firmware's own edge code (see sim.h).
+ * Every time the master emits edge 0 the slave takes the snapshot its
+ * sync input ISR would (next edge, TCNT1, OCR1A) and runs the firmware's
+ * slave loop (sync.cpp) on it, the trim it works out goes into every
+ * slave period after that, as sync_trim does in the Timer1 ISR.
+ *
+ * The phase error is measured independently of the loop: the time from
+ * the slave emitting its sync_offset edge to the master emitting edge 0,
+ * positive when the slave is ahead. The slave is locked once that stays
+ * within the lock window (crank degrees, the trim is whole ticks per edge
+ * so the phase keeps wandering by about a tick per edge per revolution).
+ * Exits 1 if the slave never locks.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "defines.h"
+#include "enums.h"
+#include "sim.h"
+#include "structures.h"
+#include "sweep.h"
+#include "sync.h"
+#include "wheel_defs.h"
+
+extern wheels Wheels[];
+/* sync_service() and set_sync_mode() look at engine 1 of the firmware,
+ * the boards here run their own engines and call sync_correct()
+ */
+engine engines[NUM_ENGINES];
+
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+    "usage: %s [-w wheel] [-r rpm] [-p ppm] [-o offset] [-P start_edge]\n"
+    "          [-l lock_degrees] [-t seconds] [-v]\n"
+    "  -w  wheel number as in the serial menu (default 3)\n"
+    "  -r  fixed RPM of both boards (default 3000)\n"
+    "  -p  slave crystal error in ppm, positive runs fast (default 1000)\n"
+    "  -o  slave edge that lines up with the master's edge 0 (default 0)\n"
+    "  -P  edge the slave starts at (default half a wheel away)\n"
+    "  -l  lock window in crank degrees (default 0.25)\n"
+    "  -t  length of the run in seconds (default 2)\n"
+    "  -v  one line per sync pulse\n", name);
+}
+
+
+/* Seconds of a board's cycle count */
+static double board_time(uint64_t cycles, double hz)
+{
+  return cycles / hz;
+}
+
+
+int main(int argc, char **argv)
+{
+  sim master;
+  sim slave;
+  int opt;
+  unsigned wheel = 3;
+  unsigned rpm = 3000;
+  double ppm = 1000.0;
+  unsigned offset = 0;
+  int start = -1;
+  double lock_degrees = 0.25;
+  double seconds = 2.0;
+  bool verbose = false;
+  double master_hz = SIM_F_CPU;
+  double slave_hz;
+  double last_offset = -1.0;   /* Time the slave last emitted its offset edge */
+  double locked_at = -1.0;     /* First pulse of the current lock, -1 if not locked */
+  double worst_locked = 0.0;
+  uint32_t pulses = 0;
+  uint16_t edges;
+
+  while ((opt = getopt(argc, argv, "w:r:p:o:P:l:t:v")) != -1)
+  {
+    switch (opt) {
+      case 'w':
+        wheel = atoi(optarg);
+        break;
+      case 'r':
+        rpm = atoi(optarg);
+        break;
+      case 'p':
+        ppm = atof(optarg);
+        break;
+      case 'o':
+        offset = atoi(optarg);
+        break;
+      case 'P':
+        start = atoi(optarg);
+        break;
+      case 'l':
+        lock_degrees = atof(optarg);
+        break;
+      case 't':
+        seconds = atof(optarg);
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if ((wheel < 1) || (wheel > MAX_WHEELS) || (rpm < 10) || (rpm > 65535) || (seconds <= 0) ||
+      (fabs(ppm) > 50000) || (lock_degrees <= 0))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  edges = Wheels[wheel - 1].wheel_max_edges;
+  if ((offset >= edges) || (start >= (int)edges))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  if (start < 0)
+    start = (offset + edges / 2) % edges;
+  slave_hz = SIM_F_CPU * (1.0 + ppm / 1e6);
+
+  sim_init(&master, wheel - 1);
+  sim_init(&slave, wheel - 1);
+  master.e.wanted_rpm = slave.e.wanted_rpm = rpm;
+  reset_new_OCR1A(&master.e, rpm);
+  reset_new_OCR1A(&slave.e, rpm);
+  slave.e.edge_counter = start;
+  sync_offset = offset;
+  set_sync_mode(SYNC_SLAVE);
+
+  while (1)
+  {
+    double master_next = board_time(master.next_edge, master_hz);
+    double slave_next = board_time(slave.next_edge, slave_hz);
+
+    if (slave_next <= master_next)
+    {
+      uint16_t edge = slave.e.edge_counter;
+
+      if (slave_next > seconds)
+        break;
+      sim_next_edge(&slave, slave.next_edge);
+      if (edge == offset)
+        last_offset = board_time(slave.now, slave_hz);
+    }
+    else
+    {
+      uint16_t edge = master.e.edge_counter;
+      double now, err, rev, degrees;
+      uint32_t prescale = sim_prescale(&slave);
+      uint64_t period_start = slave.next_edge - ((uint64_t)slave.ocr + 1) * prescale;
+
+      if (master_next > seconds)
+        break;
+      sim_next_edge(&master, master.next_edge);
+      if (edge != 0)
+        continue;
+      /* Sync pulse: the slave's snapshot, then its loop */
+      now = board_time(master.now, master_hz);
+      sync_capture(slave.e.edge_counter,
+                   (uint16_t)((uint64_t)(now * slave_hz - period_start) / prescale), slave.ocr);
+      sync_correct(&slave.e);
+      slave.trim = sync_trim;
+      pulses++;
+      if (last_offset < 0)
+        continue;
+      rev = board_time((uint64_t)edges * (master.ocr + 1) * sim_prescale(&master), master_hz);
+      err = now - last_offset;
+      while (err > rev / 2)
+        err -= rev;
+      degrees = err / rev * get_wheel_degrees(wheel - 1);
+      if (fabs(degrees) <= lock_degrees)
+      {
+        if (locked_at < 0)
+        {
+          locked_at = now;
+          worst_locked = 0.0;
+        }
+        if (fabs(degrees) > worst_locked)
+          worst_locked = fabs(degrees);
+      }
+      else
+        locked_at = -1.0;
+      if (verbose)
+        printf("%10.6f s  phase error %+12.3f us %+9.4f degrees  trim %+6d ticks%s\n", now, err * 1e6,
+               degrees, sync_trim, (locked_at >= 0) ? "  locked" : "");
+    }
+  }
+
+  printf("%s at %u RPM, slave %+.0f ppm, offset %u edges, started at edge %d\n",
+         Wheels[wheel - 1].decoder_name, rpm, ppm, offset, start);
+  if (locked_at < 0)
+  {
+    printf("Not locked within +-%.3f degrees after %u sync pulses\n", lock_degrees, pulses);
+    return 1;
+  }
+  printf("Locked within +-%.3f degrees after %.3f s (%u sync pulses), worst %.4f degrees since, trim %+d ticks\n",
+         lock_degrees, locked_at, (unsigned)(locked_at * rpm / 60.0 * 360 / get_wheel_degrees(wheel - 1)),
+         worst_locked, sync_trim);
+  return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * vim: filetype=c expandtab shiftwidth=2 tabstop=2 softtabstop=2:
+ *
+ * Arbritrary crank/cam wheel pattern generator
+ *
+ * copyright 2014-2017 David J. Andruczyk
+ *
+ * Ardu-Stim software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ArduStim software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with any ArduStim software.  If not, see http://www.gnu.org/licenses/
+ *
+ */
+
+
+/* Renders what the stimulator would emit to a VCD file, from the firmware's
+ * own wheel tables, RPM/sweep math and edge code (see sim.h). Every edge is
+ * written as soon as it is produced so memory use doesn't grow with the
+ * length of the run.
+ *
+ * Channels crank1-8 and cam1-8 are the logical tracks (invert masks and cam
+ * shift applied) that routing.h maps onto pins, timestamps are exact to
+ * the CPU cycle (62.5ns).
+ * For a sigrok/PulseView session: sigrok-cli -I vcd -i out.vcd -o out.sr
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "defines.h"
+#include "enums.h"
+#include "sim.h"
+#include "structures.h"
+#include "sweep.h"
+#include "wheel_defs.h"
+
+#define VCD_UNITS_PER_CYCLE 625 /* 100ps timescale, 62.5ns per cycle */
+#define VCD_CHANNELS 16
+
+extern wheels Wheels[];
+
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+    "usage: %s [-l] [-w wheel] (-r rpm | -s low,high,rate) [-i crank_invert]\n"
+    "          [-I cam_invert] [-c cam_shift] [-x] [-e] [-R] [-t seconds] [-o file.vcd]\n"
+    "  -l  list wheels\n"
+    "  -w  wheel number as in the serial menu (default 1)\n"
+    "  -r  fixed RPM\n"
+    "  -s  sweep low,high RPM at rate RPM/sec\n"
+    "  -i  crank invert mask, 0-255, bit 0 crank1 (default 0)\n"
+    "  -I  cam invert mask, 0-255, bit 0 cam1 (default 0)\n"
+    "  -c  cam bit shift, 0-7 (default 0)\n"
+    "  -x  extended (32 bit, /1) timer mode\n"
+    "  -e  edge sweep, RPM updated once per revolution instead of by Timer2\n"
+    "  -R  reverse rotation\n"
+    "  -t  length of the run in seconds (default 1)\n"
+    "  -o  output file (default stdout)\n", name);
+}
+
+
+static void list_wheels(void)
+{
+  for (uint8_t i = 0; i < MAX_WHEELS; i++)
+    printf("%u:%s\n", i + 1, Wheels[i].decoder_name);
+}
+
+
+/* Header, one wire per port bit, identifiers '!' onwards */
+static void vcd_header(FILE *out, sim *s)
+{
+  fprintf(out, "$version ardustim vcd_export $end\n");
+  fprintf(out, "$comment wheel %u: %s $end\n", s->e.selected_wheel + 1, Wheels[s->e.selected_wheel].decoder_name);
+  fprintf(out, "$timescale 100ps $end\n");
+  fprintf(out, "$scope module ardustim $end\n");
+  for (uint8_t i = 0; i < VCD_CHANNELS; i++)
+    fprintf(out, "$var wire 1 %c %s%u $end\n", '!' + i, (i < 8) ? "crank" : "cam", (i & 7) + 1);
+  fprintf(out, "$upscope $end\n$enddefinitions $end\n");
+}
+
+
+/* Writes the bits that changed since the last edge */
+static void vcd_edge(FILE *out, uint64_t cycle, uint16_t value, uint16_t last, bool first)
+{
+  uint16_t changed = first ? 0xFFFF : (value ^ last);
+
+  if (!changed)
+    return;
+  fprintf(out, "#%" PRIu64 "\n", cycle * VCD_UNITS_PER_CYCLE);
+  for (uint8_t i = 0; i < VCD_CHANNELS; i++)
+    if (changed & (1 << i))
+      fprintf(out, "%c%c\n", (value & (1 << i)) ? '1' : '0', '!' + i);
+}
+
+
+int main(int argc, char **argv)
+{
+  static char buffer[65536];
+  FILE *out = stdout;
+  sim s;
+  int opt;
+  unsigned wheel = 1;
+  unsigned rpm = 0;
+  unsigned low = 0, high = 0, rate = 0;
+  unsigned invert = 0;
+  unsigned cam_invert = 0;
+  unsigned shift = 0;
+  bool extended = false;
+  bool edge_sweep = false;
+  bool reverse = false;
+  double seconds = 1.0;
+  uint16_t last = 0;
+  bool first = true;
+
+  while ((opt = getopt(argc, argv, "lw:r:s:i:I:c:xeRt:o:")) != -1)
+  {
+    switch (opt) {
+      case 'l':
+        list_wheels();
+        return 0;
+      case 'w':
+        wheel = atoi(optarg);
+        break;
+      case 'r':
+        rpm = atoi(optarg);
+        break;
+      case 's':
+        if (sscanf(optarg, "%u,%u,%u", &low, &high, &rate) != 3)
+        {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'i':
+        invert = strtoul(optarg, NULL, 0);
+        break;
+      case 'I':
+        cam_invert = strtoul(optarg, NULL, 0);
+        break;
+      case 'c':
+        shift = atoi(optarg);
+        break;
+      case 'x':
+        extended = true;
+        break;
+      case 'e':
+        edge_sweep = true;
+        break;
+      case 'R':
+        reverse = true;
+        break;
+      case 't':
+        seconds = atof(optarg);
+        break;
+      case 'o':
+        out = fopen(optarg, "w");
+        if (!out)
+        {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  /* Same limits as the serial menu */
+  if ((wheel < 1) || (wheel > MAX_WHEELS) || (invert > 255) || (cam_invert > 255) || (shift > 7) || (seconds <= 0) ||
+      ((rpm == 0) == (rate == 0)) || (rpm > 65535) ||
+      (rate && ((low < 10) || (low >= high) || (high > 65535))))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  setvbuf(out, buffer, _IOFBF, sizeof(buffer));
+  sim_init(&s, wheel - 1);
+  s.e.crank_invert_mask = invert;
+  s.e.cam_invert_mask = cam_invert;
+  s.e.camSignalBitShift = shift;
+  s.e.normal = !reverse;
+  if (extended)
+    set_extended_timer(&s.e, true);
+  s.e.edge_sweep = edge_sweep;
+  if (rate)
+  {
+    s.e.sweep_rate = rate;
+    setup_sweep(&s.e, low, high);
+  }
+  else
+  {
+    s.e.wanted_rpm = rpm;
+    reset_new_OCR1A(&s.e, rpm);
+  }
+
+  vcd_header(out, &s);
+  while (sim_next_edge(&s, (uint64_t)(seconds * SIM_F_CPU)))
+  {
+    uint16_t value = s.crank | (s.cam << 8);
+
+    vcd_edge(out, s.now, value, last, first);
+    last = value;
+    first = false;
+  }
+  fprintf(out, "#%" PRIu64 "\n", (uint64_t)(seconds * SIM_F_CPU) * VCD_UNITS_PER_CYCLE);
+  fprintf(stderr, "%u edges in %.3f seconds\n", s.edges, seconds);
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}